@@ -41,6 +41,106 @@ private Q_SLOTS:
         QCOMPARE(vec2, vec);
     }
 
+    void testEmpty() {
+        PostingCodec codec;
+
+        QVector<quint64> vec;
+        QCOMPARE(codec.decode(codec.encode(vec)), vec);
+        QCOMPARE(codec.decode(QByteArray()), vec);
+    }
+
+    void testMultipleBlocks() {
+        PostingCodec codec;
+
+        // Same device, increasing inodes
+        QVector<quint64> vec;
+        for (quint64 inode = 10; inode < 5000; inode += 11) {
+            vec << (inode << 32 | 2049);
+        }
+        QByteArray arr = codec.encode(vec);
+        QVERIFY(arr.size() < vec.size() * 2);
+        QCOMPARE(codec.decode(arr), vec);
+
+        // Ids from different devices
+        vec.clear();
+        for (quint64 i = 1; i < 500; i++) {
+            vec << ((i / 3) << 32 | (i % 3 + 20));
+        }
+        QCOMPARE(codec.decode(codec.encode(vec)), vec);
+
+        vec = {0, 1, 0xffffffffffffff00ULL, 0xffffffffffffffffULL};
+        QCOMPARE(codec.decode(codec.encode(vec)), vec);
+    }
+
+    void testDecoder() {
+        PostingCodec codec;
+
+        QVector<quint64> vec;
+        for (quint64 i = 1; i <= 300; i++) {
+            vec << i * 5;
+        }
+        QByteArray arr = codec.encode(vec);
+
+        PostingDecoder decoder(arr.constData(), arr.size());
+        QCOMPARE(decoder.size(), static_cast<uint>(vec.size()));
+
+        QVector<quint64> result;
+        quint64 block[PostingDecoder::MaxBlockSize];
+        while (int count = decoder.nextBlock(block)) {
+            QVERIFY(count <= PostingDecoder::MaxBlockSize);
+            for (int i = 0; i < count; i++) {
+                result << block[i];
+            }
+        }
+        QCOMPARE(result, vec);
+    }
+
+    void testBitmap() {
+        PostingCodec codec;
+
+        QVector<quint64> vec;
+        for (quint64 inode = 100; inode < 3000; inode++) {
+            if (inode % 3 != 0 || inode % 7 == 0) {
+                vec << (inode << 32 | 2049);
+            }
+        }
+        QByteArray arr = codec.encode(vec);
+        QVERIFY(arr.size() < 400);
+        QCOMPARE(codec.decode(arr), vec);
+
+        PostingDecoder decoder(arr.constData(), arr.size());
+        QCOMPARE(decoder.size(), static_cast<uint>(vec.size()));
+        QVERIFY(!decoder.bitmap().isNull());
+        QCOMPARE(decoder.bitmap().deviceId(), static_cast<quint32>(2049));
+        QCOMPARE(decoder.bitmap().firstInode(), static_cast<quint32>(100));
+        QCOMPARE(decoder.bitmap().endInode(), static_cast<quint64>(3000));
+        QCOMPARE(decoder.bitmap().nextInode(0), static_cast<quint64>(100));
+        QCOMPARE(decoder.bitmap().nextInode(102), static_cast<quint64>(103));
+        QCOMPARE(decoder.bitmap().word(96) & 0xfff, static_cast<quint64>(0xfb0));
+
+        // Skipping to an id of a later device moves on to the next inode
+        quint64 block[PostingDecoder::MaxBlockSize];
+        QCOMPARE(decoder.skipToBlock(1000ULL << 32 | 2050, block), static_cast<int>(PostingDecoder::MaxBlockSize));
+        QCOMPARE(block[0], 1001ULL << 32 | 2049);
+        QCOMPARE(decoder.skipToBlock(2999ULL << 32, block), 1);
+        QCOMPARE(block[0], 2999ULL << 32 | 2049);
+        QCOMPARE(decoder.nextBlock(block), 0);
+
+        // Sparse lists or lists across devices keep the packed format
+        vec = {1ULL << 32 | 1, 2ULL << 32 | 2};
+        arr = codec.encode(vec);
+        PostingDecoder sparse(arr.constData(), arr.size());
+        QVERIFY(sparse.bitmap().isNull());
+    }
+
+    void testDecodeRaw() {
+        PostingCodec codec;
+
+        QVector<quint64> vec = {1, 2, 9, 12};
+        QByteArray arr(reinterpret_cast<const char*>(vec.constData()), vec.size() * sizeof(quint64));
+        QCOMPARE(codec.decodeRaw(arr), vec);
+    }
+
 };
 
 QTEST_MAIN(PostingCodecTest)
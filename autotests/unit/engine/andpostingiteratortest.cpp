@@ -25,12 +25,63 @@
 
 using namespace Baloo;
 
+namespace {
+class FilterPostingIterator : public VectorPostingIterator
+{
+public:
+    explicit FilterPostingIterator(const QVector<quint64>& values)
+        : VectorPostingIterator(values)
+        , m_values(values)
+    {
+    }
+
+    quint64 next() Q_DECL_OVERRIDE {
+        listed = true;
+        return VectorPostingIterator::next();
+    }
+
+    bool isFilter() const Q_DECL_OVERRIDE {
+        return true;
+    }
+
+    bool contains(quint64 docId) Q_DECL_OVERRIDE {
+        return m_values.contains(docId);
+    }
+
+    bool listed = false;
+
+private:
+    QVector<quint64> m_values;
+};
+
+class CountingPostingIterator : public VectorPostingIterator
+{
+public:
+    explicit CountingPostingIterator(const QVector<quint64>& values)
+        : VectorPostingIterator(values)
+    {
+    }
+
+    quint64 next() Q_DECL_OVERRIDE {
+        nextCalls++;
+        return VectorPostingIterator::next();
+    }
+
+    int nextCalls = 0;
+};
+}
+
 class AndPostingIteratorTest : public QObject
 {
     Q_OBJECT
 private Q_SLOTS:
     void test();
     void testNullIterators();
+    void testSkipTo();
+    void testFilters();
+    void testOnlyFilters();
+    void testShortestListFirst();
+    void testNextBlock();
 };
 
 void AndPostingIteratorTest::test()
@@ -72,6 +123,114 @@ void AndPostingIteratorTest::testNullIterators()
     QCOMPARE(it.docId(), static_cast<quint64>(0));
 }
 
+void AndPostingIteratorTest::testSkipTo()
+{
+    QVector<quint64> l1 = {1, 3, 5, 7};
+    QVector<quint64> l2 = {3, 4, 5, 7, 9, 11};
+    QVector<quint64> l3 = {1, 3, 7};
+
+    VectorPostingIterator* it1 = new VectorPostingIterator(l1);
+    VectorPostingIterator* it2 = new VectorPostingIterator(l2);
+    VectorPostingIterator* it3 = new VectorPostingIterator(l3);
+
+    QVector<PostingIterator*> vec = {it1, it2, it3};
+    AndPostingIterator it(vec);
+
+    QVector<quint64> result = {7};
+    QCOMPARE(it.skipTo(6), result[0]);
+    QCOMPARE(it.docId(), result[0]);
+
+    // Skipping backwards does not move the iterator
+    QCOMPARE(it.skipTo(2), result[0]);
+
+    for (int i = 1; i < result.size(); i++) {
+        QCOMPARE(it.next(), result[i]);
+    }
+    QCOMPARE(it.skipTo(100), static_cast<quint64>(0));
+    QCOMPARE(it.docId(), static_cast<quint64>(0));
+}
+
+void AndPostingIteratorTest::testFilters()
+{
+    QVector<quint64> l1 = {1, 3, 5, 7, 9};
+    QVector<quint64> l2 = {3, 4, 5, 7, 9, 11};
+
+    FilterPostingIterator* filter = new FilterPostingIterator({2, 5, 9, 11});
+    QVector<PostingIterator*> vec = {filter, new VectorPostingIterator(l1), new VectorPostingIterator(l2)};
+    AndPostingIterator it(vec);
+
+    QCOMPARE(it.next(), static_cast<quint64>(5));
+    QCOMPARE(it.next(), static_cast<quint64>(9));
+    QCOMPARE(it.next(), static_cast<quint64>(0));
+
+    // The filter was only asked about the common documents
+    QVERIFY(!filter->listed);
+}
+
+void AndPostingIteratorTest::testOnlyFilters()
+{
+    FilterPostingIterator* filter1 = new FilterPostingIterator({1, 3, 5});
+    FilterPostingIterator* filter2 = new FilterPostingIterator({3, 4, 5});
+    QVector<PostingIterator*> vec = {filter1, filter2};
+    AndPostingIterator it(vec);
+
+    QCOMPARE(it.next(), static_cast<quint64>(3));
+    QCOMPARE(it.next(), static_cast<quint64>(5));
+    QCOMPARE(it.next(), static_cast<quint64>(0));
+    QVERIFY(filter1->listed);
+    QVERIFY(!filter2->listed);
+}
+
+void AndPostingIteratorTest::testShortestListFirst()
+{
+    QVector<quint64> l1;
+    for (quint64 i = 1; i <= 1000; i++) {
+        l1 << i;
+    }
+
+    CountingPostingIterator* it1 = new CountingPostingIterator(l1);
+    CountingPostingIterator* it2 = new CountingPostingIterator({10, 500, 2000});
+    QVector<PostingIterator*> vec = {it1, it2};
+    AndPostingIterator it(vec);
+    QCOMPARE(it.estimatedSize(), static_cast<quint64>(3));
+
+    QCOMPARE(it.next(), static_cast<quint64>(10));
+    QCOMPARE(it.next(), static_cast<quint64>(500));
+    QCOMPARE(it.next(), static_cast<quint64>(0));
+
+    // The long list was only skipped through
+    QCOMPARE(it1->nextCalls, 0);
+    QCOMPARE(it2->nextCalls, 3);
+}
+
+void AndPostingIteratorTest::testNextBlock()
+{
+    QVector<quint64> l1;
+    QVector<quint64> l2;
+    QVector<quint64> result;
+    for (quint64 i = 1; i <= 1000; i++) {
+        l1 << i * 2;
+        l2 << i * 3;
+        if (i % 3 == 0) {
+            result << i * 2;
+        }
+    }
+
+    FilterPostingIterator* filter = new FilterPostingIterator(result.mid(1));
+    QVector<PostingIterator*> vec = {new VectorPostingIterator(l1), new VectorPostingIterator(l2), filter};
+    AndPostingIterator it(vec);
+
+    QVector<quint64> ids;
+    quint64 block[PostingIterator::BlockSize];
+    while (int count = it.nextBlock(block, PostingIterator::BlockSize)) {
+        for (int i = 0; i < count; i++) {
+            ids << block[i];
+        }
+        QCOMPARE(it.docId(), ids.last());
+    }
+    QCOMPARE(ids, result.mid(1));
+    QCOMPARE(it.docId(), static_cast<quint64>(0));
+}
 
 QTEST_MAIN(AndPostingIteratorTest)
 
@@ -0,0 +1,162 @@
+/*
+   This file is part of the KDE Baloo project.
+ * Copyright (C) 2016  Vishesh Handa <vhanda@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "bulkloader.h"
+#include "postingdb.h"
+#include "positiondb.h"
+#include "positioninfo.h"
+
+#include <QObject>
+#include <QTemporaryDir>
+#include <QTest>
+
+using namespace Baloo;
+
+class BulkLoaderTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init() {
+        m_tempDir = new QTemporaryDir();
+
+        mdb_env_create(&m_env);
+        mdb_env_set_maxdbs(m_env, 2);
+
+        QByteArray path = QFile::encodeName(m_tempDir->path());
+        mdb_env_open(m_env, path.constData(), 0, 0664);
+        mdb_txn_begin(m_env, NULL, 0, &m_txn);
+
+        m_postingDbi = PostingDB::create(m_txn);
+        m_positionDbi = PositionDB::create(m_txn);
+    }
+
+    void cleanup() {
+        mdb_txn_abort(m_txn);
+        mdb_env_close(m_env);
+        delete m_tempDir;
+    }
+
+    void testWrite() {
+        QTemporaryDir runDir;
+        BulkLoader loader(runDir.path(), 4096);
+
+        PostingList fire;
+        for (quint64 id = 3000; id > 0; id--) {
+            loader.add("fire", id, QVector<uint>());
+            loader.add("abc", id * 2, QVector<uint>());
+            fire.prepend(id);
+        }
+        loader.add("water", 7, {1, 4});
+        loader.add("water", 5, {2});
+        loader.add("water", 5, {9});
+        loader.add("water", 6, QVector<uint>());
+        QVERIFY(loader.runCount() > 1);
+
+        QVERIFY(loader.write(m_txn, m_postingDbi, m_positionDbi));
+        QCOMPARE(loader.runCount(), 0);
+        QVERIFY(!loader.hasFailed());
+
+        PostingDB postingDb(m_postingDbi, m_txn);
+        QCOMPARE(postingDb.get("fire"), fire);
+        QCOMPARE(postingDb.get("abc").size(), 3000);
+        QCOMPARE(postingDb.get("water"), PostingList({5, 6, 7}));
+        QCOMPARE(postingDb.fetchTermsStartingWith(""), QVector<QByteArray>({"abc", "fire", "water"}));
+
+        PositionDB positionDb(m_positionDbi, m_txn);
+        QVector<PositionInfo> positions = positionDb.get("water");
+        QCOMPARE(positions.size(), 2);
+        QCOMPARE(positions[0].docId, static_cast<quint64>(5));
+        QCOMPARE(positions[0].positions, QVector<uint>({2}));
+        QCOMPARE(positions[1].docId, static_cast<quint64>(7));
+        QCOMPARE(positions[1].positions, QVector<uint>({1, 4}));
+    }
+
+    void testWriteNonEmpty() {
+        PostingDB postingDb(m_postingDbi, m_txn);
+        postingDb.put("fire", {1, 8});
+
+        QTemporaryDir runDir;
+        BulkLoader loader(runDir.path(), 1024 * 1024);
+        loader.add("fire", 5, QVector<uint>());
+        loader.add("abc", 2, QVector<uint>());
+        loader.write(m_txn, m_postingDbi, m_positionDbi);
+
+        QCOMPARE(postingDb.get("fire"), PostingList({1, 5, 8}));
+        QCOMPARE(postingDb.get("abc"), PostingList({2}));
+    }
+
+    void testRollback() {
+        QTemporaryDir runDir;
+        BulkLoader loader(runDir.path(), 4096);
+
+        for (quint64 id = 1; id <= 1000; id++) {
+            loader.add("fire", id, QVector<uint>());
+        }
+        QVERIFY(loader.checkpoint());
+        const int runCount = loader.runCount();
+        const qint64 size = loader.size();
+
+        for (quint64 id = 1001; id <= 2000; id++) {
+            loader.add("fire", id, QVector<uint>());
+            loader.add("water", id, QVector<uint>());
+        }
+        QVERIFY(loader.runCount() > runCount);
+
+        loader.rollback();
+        QCOMPARE(loader.runCount(), runCount);
+        QCOMPARE(loader.size(), size);
+
+        loader.add("water", 7, QVector<uint>());
+        QVERIFY(loader.write(m_txn, m_postingDbi, m_positionDbi));
+
+        PostingDB postingDb(m_postingDbi, m_txn);
+        QCOMPARE(postingDb.get("fire").size(), 1000);
+        QCOMPARE(postingDb.get("water"), PostingList({7}));
+    }
+
+    void testUnwritableRunDirectory() {
+        BulkLoader loader(m_tempDir->path() + QStringLiteral("/missing"), 1024);
+
+        bool added = true;
+        for (quint64 id = 1; id <= 100 && added; id++) {
+            added = loader.add("fire", id, QVector<uint>());
+        }
+        QVERIFY(!added);
+        QVERIFY(loader.hasFailed());
+        QCOMPARE(loader.size(), static_cast<qint64>(0));
+        QVERIFY(!loader.add("water", 1, QVector<uint>()));
+        QCOMPARE(loader.size(), static_cast<qint64>(0));
+
+        QVERIFY(!loader.write(m_txn, m_postingDbi, m_positionDbi));
+        PostingDB postingDb(m_postingDbi, m_txn);
+        QVERIFY(postingDb.get("fire").isEmpty());
+    }
+
+private:
+    QTemporaryDir* m_tempDir;
+    MDB_env* m_env;
+    MDB_txn* m_txn;
+    MDB_dbi m_postingDbi;
+    MDB_dbi m_positionDbi;
+};
+
+QTEST_MAIN(BulkLoaderTest)
+
+#include "bulkloadertest.moc"
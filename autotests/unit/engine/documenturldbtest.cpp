@@ -19,10 +19,14 @@
  */
 
 #include "documenturldb.h"
+#include "metadatadb.h"
 #include "singledbtest.h"
 #include "idutils.h"
+#include "andpostingiterator.h"
+#include "vectorpostingiterator.h"
 
 #include <QDebug>
+#include <QDir>
 
 using namespace Baloo;
 
@@ -42,7 +46,7 @@ private Q_SLOTS:
         m_tempDir = new QTemporaryDir();
 
         mdb_env_create(&m_env);
-        mdb_env_set_maxdbs(m_env, 2);
+        mdb_env_set_maxdbs(m_env, 4);
 
         // The directory needs to be created before opening the environment
         QByteArray path = QFile::encodeName(m_tempDir->path());
@@ -147,6 +151,158 @@ private Q_SLOTS:
         QCOMPARE(db.getId(id, QByteArray("file")), id1);
         QCOMPARE(db.getId(id, QByteArray("file2")), id2);
     }
+
+    void testGetIdWithFileNameIndex() {
+        QTemporaryDir dir;
+        const QByteArray path = QFile::encodeName(dir.path());
+        quint64 id = filePathToId(path);
+
+        QByteArray filePath1(path + "/file");
+        touchFile(filePath1);
+        quint64 id1 = filePathToId(filePath1);
+        QByteArray filePath2(path + "/file2");
+        touchFile(filePath2);
+        quint64 id2 = filePathToId(filePath2);
+
+        FilenameIdDB fileNameIdDb(FilenameIdDB::create(m_txn), m_txn);
+        DocumentUrlDB db(IdTreeDB::create(m_txn), IdFilenameDB::create(m_txn), FilenameIdDB::create(m_txn), m_txn);
+        db.put(id, path);
+        db.put(id1, filePath1);
+        db.put(id2, filePath2);
+
+        QCOMPARE(db.getId(id, QByteArray("file")), id1);
+        QCOMPARE(db.getId(id, QByteArray("file2")), id2);
+        QCOMPARE(db.getId(id, QByteArray("file3")), static_cast<quint64>(0));
+
+        db.rename(id1, "file3");
+        QCOMPARE(db.getId(id, QByteArray("file")), static_cast<quint64>(0));
+        QCOMPARE(db.getId(id, QByteArray("file3")), id1);
+
+        db.del(id2, [](quint64) { return false; });
+        QCOMPARE(db.getId(id, QByteArray("file2")), static_cast<quint64>(0));
+        QCOMPARE(fileNameIdDb.get(id, "file3"), id1);
+    }
+
+    void testUrlCache() {
+        QTemporaryDir dir;
+        const QByteArray dirPath = QFile::encodeName(dir.path());
+        quint64 did = filePathToId(dirPath);
+
+        QByteArray filePath1(dirPath + "/file");
+        touchFile(filePath1);
+        quint64 id1 = filePathToId(filePath1);
+        QByteArray filePath2(dirPath + "/file2");
+        touchFile(filePath2);
+        quint64 id2 = filePathToId(filePath2);
+
+        DocumentUrlDB db(IdTreeDB::create(m_txn), IdFilenameDB::create(m_txn), m_txn);
+        db.put(id1, filePath1);
+        db.put(id2, filePath2);
+
+        DocumentUrlCache cache;
+        db.setUrlCache(&cache);
+
+        QCOMPARE(db.get(id1), filePath1);
+        QCOMPARE(cache.get(m_txn, did), dirPath);
+        QCOMPARE(db.get(id2), filePath2);
+        QCOMPARE(db.get(did), dirPath);
+
+        // Paths which were moved are dropped after the commit
+        cache.update(mdb_txn_id(m_txn) + 1, true);
+        QCOMPARE(cache.get(m_txn, did), QByteArray());
+    }
+
+    void testUrlCacheGeneration() {
+        QTemporaryDir dir;
+        const QByteArray dirPath = QFile::encodeName(dir.path());
+        quint64 did = filePathToId(dirPath);
+
+        QByteArray filePath(dirPath + "/file");
+        touchFile(filePath);
+        quint64 id = filePathToId(filePath);
+
+        const MDB_dbi idTreeDbi = IdTreeDB::create(m_txn);
+        const MDB_dbi idFilenameDbi = IdFilenameDB::create(m_txn);
+        const MDB_dbi metadataDbi = MetadataDB::create(m_txn);
+        DocumentUrlDB(idTreeDbi, idFilenameDbi, m_txn).put(id, filePath);
+        mdb_txn_commit(m_txn);
+
+        DocumentUrlCache cache;
+        cache.setMetadataDbi(metadataDbi);
+
+        mdb_txn_begin(m_env, NULL, MDB_RDONLY, &m_txn);
+        DocumentUrlDB db(idTreeDbi, idFilenameDbi, m_txn);
+        db.setUrlCache(&cache);
+        QCOMPARE(db.get(id), filePath);
+        QCOMPARE(cache.get(m_txn, did), dirPath);
+        mdb_txn_abort(m_txn);
+
+        // Another process committed without moving anything
+        mdb_txn_begin(m_env, NULL, 0, &m_txn);
+        MetadataDB(metadataDbi, m_txn).put(MetadataDB::UrlGeneration, 0);
+        mdb_txn_commit(m_txn);
+
+        mdb_txn_begin(m_env, NULL, MDB_RDONLY, &m_txn);
+        QCOMPARE(cache.get(m_txn, did), dirPath);
+        mdb_txn_abort(m_txn);
+
+        // Another process moved documents
+        mdb_txn_begin(m_env, NULL, 0, &m_txn);
+        MetadataDB(metadataDbi, m_txn).put(MetadataDB::UrlGeneration, 1);
+        mdb_txn_commit(m_txn);
+
+        mdb_txn_begin(m_env, NULL, MDB_RDONLY, &m_txn);
+        QCOMPARE(cache.get(m_txn, did), QByteArray());
+    }
+
+    void testIterAsFilter() {
+        QTemporaryDir dir;
+        const QByteArray dirPath = QFile::encodeName(dir.path());
+        QVERIFY(QDir().mkpath(dir.path() + "/a/b"));
+        QVERIFY(QDir().mkpath(dir.path() + "/c"));
+
+        QByteArray filePath1(dirPath + "/a/file");
+        QByteArray filePath2(dirPath + "/a/b/file");
+        QByteArray filePath3(dirPath + "/c/file");
+        touchFile(filePath1);
+        touchFile(filePath2);
+        touchFile(filePath3);
+
+        quint64 did = filePathToId(dirPath + "/a");
+        quint64 id1 = filePathToId(filePath1);
+        quint64 id2 = filePathToId(filePath2);
+        quint64 id3 = filePathToId(filePath3);
+
+        DocumentUrlDB db(IdTreeDB::create(m_txn), IdFilenameDB::create(m_txn), m_txn);
+        db.put(id1, filePath1);
+        db.put(id2, filePath2);
+        db.put(id3, filePath3);
+
+        QVector<quint64> subtree = {did, id1, id2, filePathToId(dirPath + "/a/b")};
+        std::sort(subtree.begin(), subtree.end());
+
+        PostingIterator* it = db.iter(did);
+        QVector<quint64> result;
+        while (it->next()) {
+            result << it->docId();
+        }
+        delete it;
+        QCOMPARE(result, subtree);
+
+        QVector<quint64> docs = {id1, id2, id3};
+        std::sort(docs.begin(), docs.end());
+
+        QVector<PostingIterator*> vec = {db.iter(did), new VectorPostingIterator(docs)};
+        AndPostingIterator andIt(vec);
+        QVector<quint64> expected = {id1, id2};
+        std::sort(expected.begin(), expected.end());
+
+        result.clear();
+        while (andIt.next()) {
+            result << andIt.docId();
+        }
+        QCOMPARE(result, expected);
+    }
 protected:
     MDB_env* m_env;
     MDB_txn* m_txn;
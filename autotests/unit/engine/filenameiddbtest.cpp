@@ -0,0 +1,72 @@
+/*
+   This file is part of the KDE Baloo project.
+ * Copyright (C) 2016  Vishesh Handa <vhanda@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "filenameiddb.h"
+#include "singledbtest.h"
+
+using namespace Baloo;
+
+class FilenameIdDBTest : public SingleDBTest
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void test() {
+        FilenameIdDB db(FilenameIdDB::create(m_txn), m_txn);
+
+        db.put(5, "fire", 1);
+        db.put(5, "water", 2);
+        db.put(6, "fire", 3);
+
+        QCOMPARE(db.get(5, "fire"), static_cast<quint64>(1));
+        QCOMPARE(db.get(5, "water"), static_cast<quint64>(2));
+        QCOMPARE(db.get(6, "fire"), static_cast<quint64>(3));
+        QCOMPARE(db.get(5, "earth"), static_cast<quint64>(0));
+
+        db.del(5, "fire", 1);
+        QCOMPARE(db.get(5, "fire"), static_cast<quint64>(0));
+        QCOMPARE(db.get(6, "fire"), static_cast<quint64>(3));
+    }
+
+    void testDelOtherId() {
+        FilenameIdDB db(FilenameIdDB::create(m_txn), m_txn);
+
+        // The file was replaced by another one with the same name
+        db.put(5, "fire", 1);
+        db.put(5, "fire", 2);
+
+        db.del(5, "fire", 1);
+        QCOMPARE(db.get(5, "fire"), static_cast<quint64>(2));
+    }
+
+    void testLongName() {
+        FilenameIdDB db(FilenameIdDB::create(m_txn), m_txn);
+
+        const QByteArray name(600, 'a');
+        QVERIFY(!FilenameIdDB::canStore(name));
+
+        db.put(5, name, 1);
+        QCOMPARE(db.get(5, name), static_cast<quint64>(0));
+        QVERIFY(db.toTestMap().isEmpty());
+    }
+};
+
+QTEST_MAIN(FilenameIdDBTest)
+
+#include "filenameiddbtest.moc"
@@ -0,0 +1,155 @@
+/*
+   This file is part of the KDE Baloo project.
+ * Copyright (C) 2016  Vishesh Handa <vhanda@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "filenametrigramdb.h"
+#include "idfilenamedb.h"
+#include "documenttimedb.h"
+
+#include <QTest>
+#include <QTemporaryDir>
+
+using namespace Baloo;
+
+class FilenameTrigramDBTest : public QObject
+{
+    Q_OBJECT
+
+    void putName(quint64 id, const QByteArray& name, bool document = true) {
+        IdFilenameDB::FilePath path;
+        path.parentId = 1;
+        path.name = name;
+        m_idFilenameDb->put(id, path);
+
+        if (document) {
+            m_docTimeDb->put(id, DocumentTimeDB::TimeInfo(1, 1));
+        }
+    }
+
+    QVector<quint64> matches(FilenameTrigramDB& db, const QByteArray& text) {
+        QVector<quint64> ids;
+        PostingIterator* it = db.iter(text, m_idFilenameDbi);
+        if (!it) {
+            return ids;
+        }
+        while (it->next()) {
+            ids << it->docId();
+        }
+        delete it;
+        return ids;
+    }
+
+private Q_SLOTS:
+    void init()
+    {
+        m_tempDir = new QTemporaryDir();
+
+        mdb_env_create(&m_env);
+        mdb_env_set_maxdbs(m_env, 3);
+
+        // The directory needs to be created before opening the environment
+        QByteArray path = QFile::encodeName(m_tempDir->path());
+        mdb_env_open(m_env, path.constData(), 0, 0664);
+        mdb_txn_begin(m_env, NULL, 0, &m_txn);
+
+        m_idFilenameDbi = IdFilenameDB::create(m_txn);
+        m_idFilenameDb = new IdFilenameDB(m_idFilenameDbi, m_txn);
+
+        m_docTimeDbi = DocumentTimeDB::create(m_txn);
+        m_docTimeDb = new DocumentTimeDB(m_docTimeDbi, m_txn);
+    }
+
+    void cleanup()
+    {
+        delete m_idFilenameDb;
+        delete m_docTimeDb;
+
+        mdb_txn_abort(m_txn);
+        mdb_env_close(m_env);
+        delete m_tempDir;
+    }
+
+    void testTrigrams() {
+        QCOMPARE(FilenameTrigramDB::trigrams("Report.pdf"),
+                 QVector<QByteArray>({".pd", "epo", "ort", "pdf", "por", "rep", "rt.", "t.p"}));
+        QCOMPARE(FilenameTrigramDB::trigrams("aaaa"), QVector<QByteArray>({"aaa"}));
+        QCOMPARE(FilenameTrigramDB::trigrams("ab"), QVector<QByteArray>());
+
+        // Characters are counted, not bytes
+        QCOMPARE(FilenameTrigramDB::trigrams("r\xc3\xb8" "dt"), QVector<QByteArray>({"r\xc3\xb8" "d", "\xc3\xb8" "dt"}));
+    }
+
+    void testIter() {
+        FilenameTrigramDB db(FilenameTrigramDB::create(m_txn), m_txn);
+
+        putName(1, "quarterly-report.odt");
+        putName(2, "Reports");
+        putName(3, "repo.txt");
+        putName(4, "portrait.png");
+
+        db.build(m_idFilenameDbi, m_docTimeDbi);
+
+        QCOMPARE(matches(db, "port"), QVector<quint64>({1, 2, 4}));
+        QCOMPARE(matches(db, "REPORT"), QVector<quint64>({1, 2}));
+        QCOMPARE(matches(db, "epo"), QVector<quint64>({1, 2, 3}));
+        QCOMPARE(matches(db, "fire"), QVector<quint64>());
+
+        // Too short for a trigram
+        QVERIFY(!db.iter("po", m_idFilenameDbi));
+    }
+
+    void testCandidatesAreVerified() {
+        FilenameTrigramDB db(FilenameTrigramDB::create(m_txn), m_txn);
+
+        // Both trigrams of "abcd" appear in the names, but not next to each other
+        putName(1, "abcxbcd");
+        putName(2, "xabcdx");
+        db.build(m_idFilenameDbi, m_docTimeDbi);
+
+        QCOMPARE(db.get("abc"), PostingList({1, 2}));
+        QCOMPARE(db.get("bcd"), PostingList({1, 2}));
+        QCOMPARE(matches(db, "abcd"), QVector<quint64>({2}));
+    }
+
+    void testBuildOnlyIndexesDocuments() {
+        FilenameTrigramDB db(FilenameTrigramDB::create(m_txn), m_txn);
+
+        putName(1, "home", false);
+        putName(2, "homework.txt");
+        db.build(m_idFilenameDbi, m_docTimeDbi);
+
+        QCOMPARE(db.get("hom"), PostingList({2}));
+        QCOMPARE(db.toTestMap().value("ome"), PostingList({2}));
+        QVERIFY(db.toTestMap().contains("wor"));
+    }
+
+private:
+    QTemporaryDir* m_tempDir;
+    MDB_env* m_env;
+    MDB_txn* m_txn;
+
+    MDB_dbi m_idFilenameDbi;
+    MDB_dbi m_docTimeDbi;
+    IdFilenameDB* m_idFilenameDb;
+    DocumentTimeDB* m_docTimeDb;
+};
+
+QTEST_MAIN(FilenameTrigramDBTest)
+
+#include "filenametrigramdbtest.moc"
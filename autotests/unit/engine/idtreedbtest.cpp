@@ -22,6 +22,8 @@
 #include "singledbtest.h"
 #include "postingiterator.h"
 
+#include <algorithm>
+
 using namespace Baloo;
 
 class BALOO_ENGINE_EXPORT IdTreeDBTest : public SingleDBTest
@@ -40,6 +42,61 @@ private Q_SLOTS:
         QCOMPARE(db.get(1), QVector<quint64>());
     }
 
+    void testAddRemove() {
+        IdTreeDB db(IdTreeDB::create(m_txn), m_txn);
+
+        db.add(1, 7);
+        db.add(1, 5);
+        db.add(1, 9);
+        db.add(1, 7);
+        QCOMPARE(db.get(1), QVector<quint64>({5, 7, 9}));
+        QCOMPARE(db.childCount(1), 3u);
+
+        db.remove(1, 7);
+        db.remove(1, 8);
+        QCOMPARE(db.get(1), QVector<quint64>({5, 9}));
+        QCOMPARE(db.childCount(1), 2u);
+
+        db.remove(1, 5);
+        db.remove(1, 9);
+        QCOMPARE(db.get(1), QVector<quint64>());
+        QCOMPARE(db.childCount(1), 0u);
+        QVERIFY(db.toTestMap().isEmpty());
+    }
+
+    void testManyChildren() {
+        IdTreeDB db(IdTreeDB::create(m_txn), m_txn);
+
+        QVector<quint64> children;
+        for (quint64 id = 2; id < 3000; id++) {
+            children << id;
+            db.add(1, id);
+        }
+
+        QCOMPARE(db.get(1), children);
+        QCOMPARE(db.childCount(1), static_cast<uint>(children.size()));
+    }
+
+    void testConvertFromBlobFormat() {
+        MDB_dbi dbi;
+        QCOMPARE(mdb_dbi_open(m_txn, "idtree", MDB_CREATE | MDB_INTEGERKEY, &dbi), 0);
+
+        QVector<quint64> children = {5, 6, 7};
+        quint64 id = 1;
+        MDB_val key = {sizeof(quint64), &id};
+        MDB_val val = {children.size() * sizeof(quint64), children.data()};
+        QCOMPARE(mdb_put(m_txn, dbi, &key, &val, 0), 0);
+
+        QCOMPARE(IdTreeDB::open(m_txn), static_cast<MDB_dbi>(0));
+
+        IdTreeDB db(IdTreeDB::create(m_txn), m_txn);
+        QCOMPARE(db.get(1), children);
+
+        db.add(1, 3);
+        QCOMPARE(db.get(1), QVector<quint64>({3, 5, 6, 7}));
+        QVERIFY(IdTreeDB::open(m_txn));
+    }
+
     void testIter() {
         IdTreeDB db(IdTreeDB::create(m_txn), m_txn);
 
@@ -57,6 +114,40 @@ private Q_SLOTS:
             QCOMPARE(it->docId(), static_cast<quint64>(val));
         }
     }
+
+    void testIterManyChildren() {
+        IdTreeDB db(IdTreeDB::create(m_txn), m_txn);
+
+        // The children span several pages, with folders in between
+        QVector<quint64> result = {1};
+        for (quint64 id = 2; id < 3000; id += 2) {
+            db.add(1, id);
+            result << id;
+        }
+        for (quint64 id = 100; id < 3000; id += 100) {
+            db.add(id, id + 1);
+            result << id + 1;
+        }
+        db.add(5000, 5001);
+        std::sort(result.begin(), result.end());
+
+        PostingIterator* it = db.iter(1);
+        QVector<quint64> ids;
+        while (quint64 id = it->next()) {
+            ids << id;
+        }
+        QCOMPARE(ids, result);
+        delete it;
+
+        it = db.iter(1);
+        QCOMPARE(it->skipTo(1001), static_cast<quint64>(1001));
+        QCOMPARE(it->next(), static_cast<quint64>(1002));
+        QCOMPARE(it->skipTo(2950), static_cast<quint64>(2950));
+        QCOMPARE(it->skipTo(2901), static_cast<quint64>(2950));
+        QCOMPARE(it->next(), static_cast<quint64>(2952));
+        QCOMPARE(it->skipTo(3000), static_cast<quint64>(0));
+        delete it;
+    }
 };
 
 QTEST_MAIN(IdTreeDBTest)
@@ -49,6 +49,21 @@ private Q_SLOTS:
         QCOMPARE(db.get(5), QVector<quint64>() << 1 << 3);
     }
 
+    void testNewest() {
+        MTimeDB db(MTimeDB::create(m_txn), m_txn);
+
+        db.put(5, 1);
+        db.put(6, 2);
+        db.put(6, 3);
+        db.put(7, 4);
+        db.put(9, 5);
+
+        QCOMPARE(db.size(), 5u);
+        QCOMPARE(db.newest({1, 2, 3, 5}, 3), QVector<quint64>({5, 3, 2}));
+        QCOMPARE(db.newest({1, 4}, 5), QVector<quint64>({4, 1}));
+        QCOMPARE(db.newest({1, 4}, 0), QVector<quint64>());
+    }
+
     void testIter() {
         MTimeDB db(MTimeDB::create(m_txn), m_txn);
 
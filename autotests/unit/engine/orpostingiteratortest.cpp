@@ -23,6 +23,8 @@
 
 #include <QTest>
 
+#include <algorithm>
+
 using namespace Baloo;
 
 class OrPostingIteratorTest : public QObject
@@ -31,6 +33,9 @@ class OrPostingIteratorTest : public QObject
 private Q_SLOTS:
     void test();
     void testNullIterators();
+    void testSkipTo();
+    void testSkipToFirst();
+    void testManyIterators();
 };
 
 void OrPostingIteratorTest::test()
@@ -79,6 +84,86 @@ void OrPostingIteratorTest::testNullIterators()
     QCOMPARE(it.docId(), static_cast<quint64>(0));
 }
 
+void OrPostingIteratorTest::testSkipTo()
+{
+    QVector<quint64> l1 = {1, 3, 5, 7};
+    QVector<quint64> l2 = {3, 4, 5, 7, 9, 11};
+    QVector<quint64> l3 = {1, 3, 7};
+
+    VectorPostingIterator* it1 = new VectorPostingIterator(l1);
+    VectorPostingIterator* it2 = new VectorPostingIterator(l2);
+    VectorPostingIterator* it3 = new VectorPostingIterator(l3);
+
+    QVector<PostingIterator*> vec = {it1, it2, it3};
+    OrPostingIterator it(vec);
+
+    QVector<quint64> result = {7, 9, 11};
+    QCOMPARE(it.skipTo(6), result[0]);
+    QCOMPARE(it.docId(), result[0]);
+
+    // Skipping backwards does not move the iterator
+    QCOMPARE(it.skipTo(2), result[0]);
+
+    for (int i = 1; i < result.size(); i++) {
+        QCOMPARE(it.next(), result[i]);
+    }
+    QCOMPARE(it.skipTo(100), static_cast<quint64>(0));
+    QCOMPARE(it.docId(), static_cast<quint64>(0));
+}
+
+void OrPostingIteratorTest::testSkipToFirst()
+{
+    QVector<quint64> l1 = {1, 3, 5, 7};
+    QVector<quint64> l2 = {3, 4, 5, 7, 9, 11};
+
+    QVector<PostingIterator*> vec = {new VectorPostingIterator(l1), new VectorPostingIterator(l2)};
+    OrPostingIterator it(vec);
+    QCOMPARE(it.estimatedSize(), static_cast<quint64>(10));
+
+    QCOMPARE(it.skipTo(4), static_cast<quint64>(4));
+    QCOMPARE(it.next(), static_cast<quint64>(5));
+    QCOMPARE(it.skipTo(8), static_cast<quint64>(9));
+    QCOMPARE(it.next(), static_cast<quint64>(11));
+    QCOMPARE(it.next(), static_cast<quint64>(0));
+}
+
+void OrPostingIteratorTest::testManyIterators()
+{
+    // Enough iterators for the documents to be read into a list
+    QVector<PostingIterator*> vec;
+    QVector<quint64> result;
+    for (quint64 i = 1; i <= 2000; i++) {
+        const QVector<quint64> list = {i * 2, i * 2 + 2, 5000 + i};
+        vec << new VectorPostingIterator(list);
+        result << list;
+    }
+    vec << new VectorPostingIterator(QVector<quint64>());
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+
+    OrPostingIterator it(vec);
+    QVector<quint64> ids;
+    QCOMPARE(it.next(), result.first());
+    ids << it.docId();
+
+    quint64 block[PostingIterator::BlockSize];
+    while (int count = it.nextBlock(block, PostingIterator::BlockSize)) {
+        for (int i = 0; i < count; i++) {
+            ids << block[i];
+        }
+    }
+    QCOMPARE(ids, result);
+
+    vec.clear();
+    for (quint64 i = 1; i <= 2000; i++) {
+        vec << new VectorPostingIterator({i * 2});
+    }
+    OrPostingIterator it2(vec);
+    QCOMPARE(it2.skipTo(101), static_cast<quint64>(102));
+    QCOMPARE(it2.next(), static_cast<quint64>(104));
+    QCOMPARE(it2.skipTo(3999), static_cast<quint64>(4000));
+    QCOMPARE(it2.next(), static_cast<quint64>(0));
+}
 
 QTEST_MAIN(OrPostingIteratorTest)
 
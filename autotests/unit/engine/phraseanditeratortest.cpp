@@ -32,6 +32,7 @@ class PhraseAndIteratorTest : public QObject
 private Q_SLOTS:
     void test();
     void testNullIterators();
+    void testRarestWordFirst();
 };
 
 void PhraseAndIteratorTest::test()
@@ -109,6 +110,26 @@ void PhraseAndIteratorTest::testNullIterators()
     QCOMPARE(it.docId(), static_cast<quint64>(0));
 }
 
+void PhraseAndIteratorTest::testRarestWordFirst()
+{
+    // Term 1 is in every document, always at position 1
+    QVector<PositionInfo> vec1;
+    for (quint64 i = 1; i <= 100; i++) {
+        vec1 << PositionInfo(i, {1});
+    }
+
+    // Term 2 is rare, and only follows term 1 in document 50
+    QVector<PositionInfo> vec2;
+    vec2 << PositionInfo(50, {2}) << PositionInfo(60, {5});
+
+    QVector<PostingIterator*> vec = {new VectorPositionInfoIterator(vec1), new VectorPositionInfoIterator(vec2)};
+    PhraseAndIterator it(vec);
+    QCOMPARE(it.estimatedSize(), static_cast<quint64>(2));
+
+    QCOMPARE(it.next(), static_cast<quint64>(50));
+    QCOMPARE(it.next(), static_cast<quint64>(0));
+}
+
 QTEST_MAIN(PhraseAndIteratorTest)
 
 #include "phraseanditeratortest.moc"
@@ -64,7 +64,7 @@ private Q_SLOTS:
 
         db.put(word, list);
 
-        PostingIterator* it = db.iter(word);
+        PostingIterator* it = db.iter(word, list.size());
         QCOMPARE(it->docId(), static_cast<quint64>(0));
         QVERIFY(it->positions().isEmpty());
 
@@ -80,6 +80,52 @@ private Q_SLOTS:
         QCOMPARE(it->docId(), static_cast<quint64>(0));
         QVERIFY(it->positions().isEmpty());
     }
+
+    void testChunks() {
+        PositionDB db(PositionDB::create(m_txn), m_txn);
+
+        QVector<PositionInfo> list;
+        for (quint64 i = 1; i <= 1000; i++) {
+            list << PositionInfo(i * 3, QVector<uint>() << i << i + 7);
+        }
+        db.put("fire", list);
+        db.put("fired", {PositionInfo(5, QVector<uint>() << 2)});
+
+        QVector<PositionInfo> res = db.get("fire");
+        QCOMPARE(res.size(), list.size());
+        QCOMPARE(res.last().positions, list.last().positions);
+
+        PostingIterator* it = db.iter("fire", list.size());
+        QVERIFY(it);
+        for (const PositionInfo& info : list) {
+            QCOMPARE(it->next(), info.docId);
+            QCOMPARE(it->positions(), info.positions);
+        }
+        QCOMPARE(it->next(), static_cast<quint64>(0));
+        delete it;
+
+        // Skipping only decodes the positions it is asked for
+        it = db.iter("fire", list.size());
+        QCOMPARE(it->skipTo(400), static_cast<quint64>(402));
+        QCOMPARE(it->positions(), QVector<uint>({134, 141}));
+        QCOMPARE(it->skipTo(2998), static_cast<quint64>(3000));
+        QCOMPARE(it->positions(), QVector<uint>({1000, 1007}));
+        QCOMPARE(it->skipTo(3001), static_cast<quint64>(0));
+        QVERIFY(it->positions().isEmpty());
+        delete it;
+
+        it = db.iter("fire", 4000);
+        QCOMPARE(it->estimatedSize(), static_cast<quint64>(4000));
+        delete it;
+
+        QMap<QByteArray, QVector<PositionInfo>> map = db.toTestMap();
+        QCOMPARE(map.size(), 2);
+        QCOMPARE(map.value("fire"), list);
+
+        db.del("fire");
+        QVERIFY(db.get("fire").isEmpty());
+        QCOMPARE(db.toTestMap().size(), 1);
+    }
 };
 
 QTEST_MAIN(PositionDBTest)
@@ -19,8 +19,13 @@
  */
 
 #include "postingdb.h"
+#include "postingcodec.h"
+#include "chunkedlist.h"
+#include "andpostingiterator.h"
 #include "singledbtest.h"
 
+#include <algorithm>
+
 using namespace Baloo;
 
 class PostingDBTest : public SingleDBTest
@@ -55,6 +60,89 @@ private Q_SLOTS:
         }
     }
 
+    void testTermIterMultipleBlocks() {
+        PostingDB db(PostingDB::create(m_txn), m_txn);
+
+        PostingList list;
+        for (quint64 i = 1; i <= 1000; i++) {
+            list << (i << 32 | 23);
+        }
+        db.put("fire", list);
+
+        PostingIterator* it = db.iter("fire");
+        QVERIFY(it);
+        QCOMPARE(it->docId(), static_cast<quint64>(0));
+
+        for (quint64 val : list) {
+            QCOMPARE(it->next(), val);
+            QCOMPARE(it->docId(), val);
+        }
+        QCOMPARE(it->next(), static_cast<quint64>(0));
+        QCOMPARE(it->docId(), static_cast<quint64>(0));
+        delete it;
+    }
+
+    void testTermIterNextBlock() {
+        PostingDB db(PostingDB::create(m_txn), m_txn);
+
+        PostingList list;
+        for (quint64 i = 1; i <= 5000; i++) {
+            list << i * 2;
+        }
+        db.put("fire", list);
+
+        PostingIterator* it = db.iter("fire");
+        QCOMPARE(it->next(), static_cast<quint64>(2));
+
+        // Blocks go over the decoded blocks and the chunks
+        PostingList ids = {2};
+        quint64 block[300];
+        while (int count = it->nextBlock(block, 300)) {
+            QVERIFY(count <= 300);
+            for (int i = 0; i < count; i++) {
+                ids << block[i];
+            }
+            if (ids.size() < list.size()) {
+                QCOMPARE(it->docId(), ids.last());
+            }
+        }
+        QCOMPARE(ids, list);
+        QCOMPARE(it->docId(), static_cast<quint64>(0));
+        QCOMPARE(it->next(), static_cast<quint64>(0));
+        delete it;
+
+        it = db.iter("fire");
+        QCOMPARE(it->skipTo(301), static_cast<quint64>(302));
+        QCOMPARE(it->nextBlock(block, 2), 2);
+        QCOMPARE(block[0], static_cast<quint64>(304));
+        QCOMPARE(block[1], static_cast<quint64>(306));
+        QCOMPARE(it->next(), static_cast<quint64>(308));
+        delete it;
+    }
+
+    void testTermIterSkipTo() {
+        PostingDB db(PostingDB::create(m_txn), m_txn);
+
+        PostingList list;
+        for (quint64 i = 1; i <= 1000; i++) {
+            list << i * 4;
+        }
+        db.put("fire", list);
+
+        PostingIterator* it = db.iter("fire");
+        QVERIFY(it);
+
+        QCOMPARE(it->skipTo(10), static_cast<quint64>(12));
+        QCOMPARE(it->skipTo(12), static_cast<quint64>(12));
+        QCOMPARE(it->next(), static_cast<quint64>(16));
+        QCOMPARE(it->skipTo(2001), static_cast<quint64>(2004));
+        QCOMPARE(it->docId(), static_cast<quint64>(2004));
+        QCOMPARE(it->skipTo(3997), static_cast<quint64>(4000));
+        QCOMPARE(it->next(), static_cast<quint64>(0));
+        QCOMPARE(it->skipTo(5000), static_cast<quint64>(0));
+        delete it;
+    }
+
     void testPrefixIter() {
         PostingDB db(PostingDB::create(m_txn), m_txn);
 
@@ -122,6 +210,63 @@ private Q_SLOTS:
         }
     }
 
+    void testFuzzyIter() {
+        PostingDB db(PostingDB::create(m_txn), m_txn);
+
+        db.put("Ffir", {1, 3});
+        db.put("Ffire", {2});
+        db.put("Ffiremen", {4});
+        db.put("Fhire", {5});
+        db.put("fire", {6});
+
+        PostingIterator* it = db.fuzzyIter("F", "fire", 1);
+        QVERIFY(it);
+
+        QVector<quint64> result = {1, 2, 3, 5};
+        for (quint64 val : result) {
+            QCOMPARE(it->next(), static_cast<quint64>(val));
+        }
+        QCOMPARE(it->next(), static_cast<quint64>(0));
+        delete it;
+
+        it = db.fuzzyIter("F", "water", 2);
+        QVERIFY(it == 0);
+    }
+
+    void testFuzzyIterLimit() {
+        PostingDB db(PostingDB::create(m_txn), m_txn);
+
+        // 100 terms one edit away, of which 49 are in two documents
+        quint64 id = 1;
+        for (int pos = 0; pos < 4; pos++) {
+            for (char ch = 'b'; ch <= 'z'; ch++) {
+                QByteArray term("aaaa");
+                term[pos] = ch;
+                if (pos == 3 || (pos == 0 && ch != 'z')) {
+                    db.put(term, {id, id + 1000});
+                } else {
+                    db.put(term, {id});
+                }
+                id++;
+            }
+        }
+        db.put("aaaa", {500});
+
+        // Only the exact term and the most frequent ones are used
+        PostingIterator* it = db.fuzzyIter("", "aaaa", 1);
+        QVERIFY(it);
+
+        int count = 0;
+        bool exact = false;
+        while (it->next()) {
+            exact |= it->docId() == 500;
+            count++;
+        }
+        QVERIFY(exact);
+        QCOMPARE(count, 1 + 49 * 2);
+        delete it;
+    }
+
     void testFetchTermsStartingWith() {
         PostingDB db(PostingDB::create(m_txn), m_txn);
 
@@ -134,6 +279,227 @@ private Q_SLOTS:
         QVector<QByteArray> list = {"fir", "fire", "fore"};
         QCOMPARE(db.fetchTermsStartingWith("f"), list);
     }
+
+    void testConvertFromRawFormat() {
+        PostingDB db(PostingDB::create(m_txn), m_txn);
+        MDB_dbi dbi = PostingDB::open(m_txn);
+
+        PostingList list1 = {1, 5, 6};
+        PostingList list2;
+        for (quint64 i = 1; i <= 300; i++) {
+            list2 << ((i * 7) << 32 | 2049);
+        }
+
+        auto putRaw = [&](const QByteArray& term, const PostingList& list) {
+            MDB_val key;
+            key.mv_size = term.size();
+            key.mv_data = static_cast<void*>(const_cast<char*>(term.constData()));
+
+            MDB_val val;
+            val.mv_size = list.size() * sizeof(quint64);
+            val.mv_data = static_cast<void*>(const_cast<quint64*>(list.constData()));
+
+            QCOMPARE(mdb_put(m_txn, dbi, &key, &val, 0), 0);
+        };
+        putRaw("fire", list1);
+        putRaw("water", list2);
+
+        PostingList list3;
+        for (quint64 i = 1; i <= 3000; i++) {
+            list3 << i * 3;
+        }
+        putRaw("wind", list3);
+
+        db.convertFromRawFormat();
+        QCOMPARE(db.get("fire"), list1);
+        QCOMPARE(db.get("water"), list2);
+        QCOMPARE(db.get("wind"), list3);
+        QCOMPARE(db.toTestMap().size(), 3);
+    }
+
+    void testChunks() {
+        PostingDB db(PostingDB::create(m_txn), m_txn);
+
+        PostingList list;
+        for (quint64 i = 1; i <= 5000; i++) {
+            list << i * 2;
+        }
+        db.put("fire", list);
+        db.put("fired", {3, 7});
+
+        QCOMPARE(db.get("fire"), list);
+        QCOMPARE(db.get("fired"), PostingList({3, 7}));
+
+        PostingIterator* it = db.iter("fire");
+        QVERIFY(it);
+        for (quint64 val : list) {
+            QCOMPARE(it->next(), val);
+        }
+        QCOMPARE(it->next(), static_cast<quint64>(0));
+        delete it;
+
+        QCOMPARE(db.termFrequency("fire"), static_cast<quint64>(list.size()));
+        QCOMPARE(db.termFrequency("fired"), static_cast<quint64>(2));
+        QCOMPARE(db.termFrequency("water"), static_cast<quint64>(0));
+
+        it = db.iter("fire");
+        QCOMPARE(it->estimatedSize(), static_cast<quint64>(list.size()));
+        QVERIFY(it->hasExactSize());
+        QCOMPARE(it->skipTo(3), static_cast<quint64>(4));
+        QCOMPARE(it->skipTo(4095), static_cast<quint64>(4096));
+        QCOMPARE(it->next(), static_cast<quint64>(4098));
+        QCOMPARE(it->skipTo(9001), static_cast<quint64>(9002));
+        QCOMPARE(it->skipTo(10001), static_cast<quint64>(0));
+        delete it;
+
+        it = db.prefixIter("fire");
+        QVERIFY(it);
+        QCOMPARE(it->estimatedSize(), static_cast<quint64>(list.size() + 2));
+        QVERIFY(!it->hasExactSize());
+        QCOMPARE(it->next(), static_cast<quint64>(2));
+        QCOMPARE(it->next(), static_cast<quint64>(3));
+        QCOMPARE(it->skipTo(9999), static_cast<quint64>(10000));
+        QCOMPARE(it->next(), static_cast<quint64>(0));
+        delete it;
+
+        QVector<QByteArray> terms = {"fire", "fired"};
+        QCOMPARE(db.fetchTermsStartingWith("fi"), terms);
+
+        QMap<QByteArray, PostingList> map;
+        map.insert("fire", list);
+        map.insert("fired", {3, 7});
+        QCOMPARE(db.toTestMap(), map);
+
+        db.del("fire");
+        QVERIFY(db.get("fire").isEmpty());
+        QCOMPARE(db.toTestMap().size(), 1);
+    }
+
+    void testChunkMerge() {
+        PostingDB db(PostingDB::create(m_txn), m_txn);
+        MDB_dbi dbi = PostingDB::open(m_txn);
+
+        PostingList list;
+        for (quint64 i = 1; i <= 3000; i++) {
+            list << i * 2;
+        }
+        db.put("fire", list);
+
+        MDB_cursor* cursor;
+        QCOMPARE(mdb_cursor_open(m_txn, dbi, &cursor), 0);
+        {
+            PostingChunks chunks(cursor, "fire", PostingChunkSize);
+            chunks.merge({1, 7, 2500, 7001}, {2, 8, 6000});
+            chunks.write();
+        }
+        {
+            PostingChunks chunks(cursor, "water", PostingChunkSize);
+            chunks.merge({5, 6}, {7});
+            chunks.write();
+        }
+        mdb_cursor_close(cursor);
+
+        list.removeOne(2);
+        list.removeOne(8);
+        list.removeOne(6000);
+        list << 1 << 7 << 7001;
+        std::sort(list.begin(), list.end());
+        QCOMPARE(db.get("fire"), list);
+        QCOMPARE(db.get("water"), PostingList({5, 6}));
+    }
+
+    void testBitmapAnd() {
+        PostingDB db(PostingDB::create(m_txn), m_txn);
+
+        // Dense enough to be stored as bitmaps
+        PostingList even;
+        PostingList odd;
+        PostingList result;
+        for (quint64 inode = 1; inode <= 3000; inode++) {
+            const quint64 id = inode << 32 | 2049;
+            if (inode % 2 == 0) {
+                even << id;
+            }
+            if (inode % 3 == 0 || inode == 2000) {
+                odd << id;
+            }
+            if (inode % 6 == 0 || inode == 2000) {
+                result << id;
+            }
+        }
+        db.put("Tdocument", even);
+        db.put("Mtext", odd);
+
+        AndPostingIterator it({db.iter("Tdocument"), db.iter("Mtext")});
+        QCOMPARE(it.skipTo(11ULL << 32), 12ULL << 32 | 2049);
+        QCOMPARE(it.next(), 18ULL << 32 | 2049);
+
+        PostingList list;
+        AndPostingIterator it2({db.iter("Tdocument"), db.iter("Mtext")});
+        while (it2.next()) {
+            list << it2.docId();
+        }
+        QCOMPARE(list, result);
+    }
+
+    void testChunkUpdates() {
+        PostingDB db(PostingDB::create(m_txn), m_txn);
+        MDB_dbi dbi = PostingDB::open(m_txn);
+
+        PostingList list;
+        for (quint64 i = 1; i <= 3000; i++) {
+            list << i;
+        }
+        db.put("fire", list);
+
+        // Emptying the first chunk moves the next one under the term
+        PostingChunks chunks(m_txn, dbi, "fire", PostingChunkSize);
+        QCOMPARE(chunks.chunks().size(), 2);
+        for (quint64 i = 1; i <= PostingChunkSize; i++) {
+            chunks.remove(i);
+        }
+        chunks.insert(5000);
+        chunks.write();
+
+        list = list.mid(PostingChunkSize);
+        list << 5000;
+        QCOMPARE(db.get("fire"), list);
+
+        PostingChunks updated(m_txn, dbi, "fire", PostingChunkSize);
+        QCOMPARE(updated.chunks().size(), 1);
+        QCOMPARE(updated.chunks().first().key, QByteArray("fire"));
+
+        // Growing past twice the chunk size splits the chunk again
+        for (quint64 i = 6000; i < 6000 + PostingChunkSize; i++) {
+            updated.insert(i);
+            list << i;
+        }
+        updated.write();
+        QCOMPARE(db.get("fire"), list);
+        QCOMPARE(PostingChunks(m_txn, dbi, "fire", PostingChunkSize).chunks().size(), 2);
+    }
+
+    void testMapFull() {
+        PostingDB db(PostingDB::create(m_txn), m_txn);
+        MDB_dbi dbi = PostingDB::open(m_txn);
+
+        // The list does not fit into the 10 MB LMDB maps by default
+        PostingList list;
+        quint64 id = 0;
+        for (int i = 0; i < 3000000; i++) {
+            id = id * 6364136223846793005ULL + 1442695040888963407ULL;
+            list << id;
+        }
+        std::sort(list.begin(), list.end());
+
+        PostingChunks chunks(m_txn, dbi, "fire", PostingChunkSize);
+        chunks.replace(list);
+        QVERIFY(!chunks.write());
+
+        // LMDB refuses everything else in the transaction
+        QVERIFY(db.get("fire").isEmpty());
+        QVERIFY(!PostingChunks(m_txn, dbi, "water", PostingChunkSize).write());
+    }
 };
 
 QTEST_MAIN(PostingDBTest)
@@ -40,6 +40,7 @@ private Q_SLOTS:
     void testAccentSearch();
     void testUnderscoreSplitting();
     void testAutoExpand();
+    void testFuzzy();
 };
 
 void QueryParserTest::testSinglePrefixWord()
@@ -218,6 +219,53 @@ void QueryParserTest::testAutoExpand()
     }
 }
 
+void QueryParserTest::testFuzzy()
+{
+    QueryParser parser;
+    parser.setMaxEditDistance(2);
+
+    {
+        EngineQuery query = parser.parseQuery("an old firefighter");
+
+        QVector<EngineQuery> queries;
+        queries << EngineQuery("an", EngineQuery::Equal, 1);
+        queries << EngineQuery({EngineQuery("old", EngineQuery::StartsWith, 2),
+                                EngineQuery("old", 0, 1, 2)}, EngineQuery::Or);
+        queries << EngineQuery({EngineQuery("firefighter", EngineQuery::StartsWith, 3),
+                                EngineQuery("firefighter", 0, 2, 3)}, EngineQuery::Or);
+
+        EngineQuery q(queries, EngineQuery::And);
+
+        QCOMPARE(query, q);
+    }
+
+    // The prefix is not edited
+    {
+        EngineQuery query = parser.parseQuery("fire", "F");
+        EngineQuery q({EngineQuery("Ffire", EngineQuery::StartsWith, 1),
+                       EngineQuery("Ffire", 1, 1, 1)}, EngineQuery::Or);
+
+        QCOMPARE(query, q);
+    }
+
+    // Phrases are matched exactly
+    {
+        EngineQuery query = parser.parseQuery("\"old fire\" an");
+
+        QVector<EngineQuery> phraseQueries;
+        phraseQueries << EngineQuery("old", 1);
+        phraseQueries << EngineQuery("fire", 2);
+
+        QVector<EngineQuery> queries;
+        queries << EngineQuery(phraseQueries, EngineQuery::Phrase);
+        queries << EngineQuery("an", EngineQuery::Equal, 3);
+
+        EngineQuery q(queries, EngineQuery::And);
+
+        QCOMPARE(query, q);
+    }
+}
+
 QTEST_MAIN(QueryParserTest)
 
 #include "queryparsertest.moc"
@@ -0,0 +1,204 @@
+/*
+   This file is part of the KDE Baloo project.
+ * Copyright (C) 2016  Vishesh Handa <vhanda@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "termdictionary.h"
+#include "levenshteinautomaton.h"
+#include "postingdb.h"
+#include "singledbtest.h"
+
+using namespace Baloo;
+
+class TermDictionaryTest : public SingleDBTest
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testTerms() {
+        TermDictionary dict;
+        QVector<QByteArray> terms;
+        for (int i = 0; i < 100; i++) {
+            terms << "term" + QByteArray::number(i * 7 + 1000);
+        }
+        for (const QByteArray& term : terms) {
+            dict.append(term);
+        }
+
+        QCOMPARE(dict.size(), terms.size());
+        QVERIFY(dict.contains("term1007"));
+        QVERIFY(!dict.contains("term1008"));
+        QVERIFY(!dict.contains("ter"));
+        QCOMPARE(dict.termsStartingWith("term"), terms);
+        QCOMPARE(dict.termsStartingWith("term101"), QVector<QByteArray>({"term1014"}));
+        QCOMPARE(dict.termsStartingWith("term1", "term1680", "term1700"),
+                 QVector<QByteArray>({"term1686", "term1693"}));
+        QCOMPARE(dict.termsStartingWith("fire"), QVector<QByteArray>());
+    }
+
+    void testUpdate() {
+        TermDictionary dict;
+        dict.append("abc");
+        dict.append("fir");
+        dict.append("fire");
+
+        dict.update({"fira", "foo"}, {"fir"});
+        QCOMPARE(dict.size(), 4);
+        QCOMPARE(dict.termsStartingWith("f"), QVector<QByteArray>({"fira", "fire", "foo"}));
+        QVERIFY(!dict.contains("fir"));
+
+        dict.update({"fir"}, {"fira", "abc"});
+        QCOMPARE(dict.termsStartingWith("a"), QVector<QByteArray>());
+        QCOMPARE(dict.termsStartingWith("f"), QVector<QByteArray>({"fir", "fire", "foo"}));
+    }
+
+    void testFuzzy() {
+        TermDictionary dict;
+        for (const QByteArray& term : {"Ffire", "Fhire", "abc", "caf\xc3\xa9", "fir", "fire", "fired",
+                                       "firemen", "firm", "fore", "hire", "wire", "xyz"}) {
+            dict.append(term);
+        }
+
+        LevenshteinAutomaton automaton("", "fire", 1);
+        QCOMPARE(dict.termsMatching(&automaton),
+                 QVector<QByteArray>({"Ffire", "fir", "fire", "fired", "firm", "fore", "hire", "wire"}));
+
+        LevenshteinAutomaton exact("", "fire", 0);
+        QCOMPARE(dict.termsMatching(&exact), QVector<QByteArray>({"fire"}));
+
+        LevenshteinAutomaton twoEdits("", "fyremon", 2);
+        QCOMPARE(dict.termsMatching(&twoEdits), QVector<QByteArray>({"firemen"}));
+        QCOMPARE(twoEdits.distance(), 2);
+
+        LevenshteinAutomaton prefixed("F", "fire", 1);
+        QCOMPARE(dict.termsMatching(&prefixed), QVector<QByteArray>({"Ffire", "Fhire"}));
+
+        // Characters are compared, not bytes
+        LevenshteinAutomaton accent("", "cafe", 1);
+        QCOMPARE(dict.termsMatching(&accent), QVector<QByteArray>({"caf\xc3\xa9"}));
+        QCOMPARE(accent.distance(), 1);
+    }
+
+    void testPostingDB() {
+        PostingDB db(PostingDB::create(m_txn), m_txn);
+
+        PostingList large;
+        for (quint64 i = 1; i <= 3000; i++) {
+            large << i;
+        }
+        db.put("abc", {1, 4, 5, 9, 11});
+        db.put("fir", {1, 3, 5});
+        db.put("fire", large);
+        db.put("fore", {2, 3, 5});
+
+        // The chunks of "fire" are not terms
+        TermDictionary dict = db.termDictionary();
+        QCOMPARE(dict.termsStartingWith("f"), QVector<QByteArray>({"fir", "fire", "fore"}));
+
+        db.setTermDictionary(&dict);
+        QCOMPARE(db.fetchTermsStartingWith("fi"), QVector<QByteArray>({"fir", "fire"}));
+
+        PostingIterator* it = db.prefixIter("fo");
+        QVERIFY(it);
+        QCOMPARE(it->next(), static_cast<quint64>(2));
+        QCOMPARE(it->next(), static_cast<quint64>(3));
+        QCOMPARE(it->next(), static_cast<quint64>(5));
+        QCOMPARE(it->next(), static_cast<quint64>(0));
+        delete it;
+
+        it = db.compIter("f", "ir", PostingDB::LessEqual);
+        QVERIFY(it);
+        QCOMPARE(it->next(), static_cast<quint64>(1));
+        QCOMPARE(it->next(), static_cast<quint64>(3));
+        QCOMPARE(it->next(), static_cast<quint64>(5));
+        QCOMPARE(it->next(), static_cast<quint64>(0));
+        delete it;
+
+        it = db.compIter("f", "ire", PostingDB::GreaterEqual);
+        QVERIFY(it);
+        for (quint64 id : large) {
+            QCOMPARE(it->next(), id);
+        }
+        QCOMPARE(it->next(), static_cast<quint64>(0));
+        delete it;
+    }
+
+    void testCache() {
+        const MDB_dbi dbi = PostingDB::create(m_txn);
+        PostingDB(dbi, m_txn).put("fir", {1});
+        const size_t txnId = mdb_txn_id(m_txn);
+
+        TermDictionaryCache cache;
+        QVERIFY(!cache.get(m_txn));
+        QVERIFY(cache.startBuild(m_txn));
+        QVERIFY(!cache.startBuild(m_txn));
+
+        QSharedPointer<const TermDictionary> built(new TermDictionary(PostingDB(dbi, m_txn).termDictionary()));
+        cache.finishBuild(txnId, built);
+        QCOMPARE(cache.get(m_txn), built);
+        QVERIFY(!cache.startBuild(m_txn));
+
+        mdb_txn_commit(m_txn);
+        mdb_txn_begin(m_env, NULL, 0, &m_txn);
+        PostingDB(dbi, m_txn).put("foo", {1});
+        PostingDB(dbi, m_txn).del("fir");
+        QCOMPARE(mdb_txn_id(m_txn), txnId + 1);
+        mdb_txn_commit(m_txn);
+
+        // The commit is applied to a copy, which older transactions cannot use
+        cache.update(txnId + 1, {"foo"}, {"fir"});
+        QVERIFY(built->contains("fir"));
+        QVERIFY(!built->contains("foo"));
+
+        mdb_txn_begin(m_env, NULL, MDB_RDONLY, &m_txn);
+        QSharedPointer<const TermDictionary> updated = cache.get(m_txn);
+        QVERIFY(updated);
+        QVERIFY(updated->contains("foo"));
+        QVERIFY(!updated->contains("fir"));
+
+        // A dictionary built before the commit is out of date
+        cache.finishBuild(txnId, built);
+        QCOMPARE(cache.get(m_txn), updated);
+
+        // Another process committed in between
+        cache.update(txnId + 3, {"bar"}, QSet<QByteArray>());
+        QVERIFY(!cache.get(m_txn));
+        QVERIFY(cache.startBuild(m_txn));
+    }
+
+    void testNeedsRebuild() {
+        TermDictionary dict;
+        for (int i = 0; i < 100; i++) {
+            dict.append("term" + QByteArray::number(i + 1000));
+        }
+        dict.update({"word"}, {"term1000"});
+        QVERIFY(!dict.needsRebuild());
+
+        QSet<QByteArray> added;
+        for (int i = 0; i < 5000; i++) {
+            added << "word" + QByteArray::number(i);
+        }
+        dict.update(added, QSet<QByteArray>());
+        QVERIFY(dict.needsRebuild());
+        QCOMPARE(dict.size(), 5100);
+        QVERIFY(dict.contains("word42"));
+    }
+};
+
+QTEST_MAIN(TermDictionaryTest)
+
+#include "termdictionarytest.moc"
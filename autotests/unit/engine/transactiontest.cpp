@@ -21,9 +21,13 @@
 #include "transaction.h"
 #include "database.h"
 #include "idutils.h"
+#include "databasesize.h"
+#include "enginequery.h"
+#include "postingiterator.h"
 
 #include <QTest>
 #include <QTemporaryDir>
+#include <QDir>
 
 using namespace Baloo;
 
@@ -43,6 +47,15 @@ private Q_SLOTS:
     }
 
     void testTimeInfo();
+    void testMemoryBudget();
+    void testReserve();
+    void testSuspend();
+    void testClear();
+    void testFileNameSubstring();
+    void testBuildFileNameIndexes();
+    void testUrlCache();
+    void testNewestDocuments();
+    void testQueryResultCache();
 private:
     QTemporaryDir* dir;
     Database* db;
@@ -87,6 +100,372 @@ void TransactionTest::testTimeInfo()
     QCOMPARE(tr2.documentTimeInfo(id), timeInfo);
 }
 
+void TransactionTest::testMemoryBudget()
+{
+    Transaction tr(db, Transaction::ReadWrite);
+    tr.setMemoryBudget(1);
+
+    const QByteArray url(dir->path().toUtf8() + "/file");
+    touchFile(url);
+    quint64 id = filePathToId(url);
+
+    Document doc;
+    doc.setId(id);
+    doc.setUrl(url);
+    doc.addTerm("a");
+    doc.addPositionTerm("abc", 3);
+    doc.setMTime(1);
+    doc.setCTime(2);
+
+    // Every operation is merged straight away
+    tr.addDocument(doc);
+    QVERIFY(tr.hasChanges());
+    QCOMPARE(tr.fetchTermsStartingWith("a"), QVector<QByteArray>({"a", "abc"}));
+    tr.commit();
+
+    Transaction tr2(db, Transaction::ReadOnly);
+    QCOMPARE(tr2.fetchTermsStartingWith("a"), QVector<QByteArray>({"a", "abc"}));
+}
+
+void TransactionTest::testReserve()
+{
+    const quint64 size = Q_UINT64_C(768) * 1024 * 1024;
+    db->reserve(size);
+
+    Transaction tr(db, Transaction::ReadOnly);
+    DatabaseSize dbSize = tr.dbSize();
+    QVERIFY(dbSize.mapSize >= size);
+    QVERIFY(dbSize.headroom >= size);
+}
+
+void TransactionTest::testSuspend()
+{
+    const QByteArray url(dir->path().toUtf8() + "/file");
+    const quint64 id = touchFile(url);
+
+    {
+        Transaction tr(db, Transaction::ReadWrite);
+
+        Document doc;
+        doc.setId(id);
+        doc.setUrl(url);
+        doc.addTerm("fire");
+        doc.setMTime(1);
+        doc.setCTime(2);
+        tr.addDocument(doc);
+        QVERIFY(tr.commit());
+    }
+
+    Transaction tr(db, Transaction::ReadOnly);
+    tr.suspend();
+
+    // The thread can use other transactions meanwhile
+    {
+        Transaction tr2(db, Transaction::ReadWrite);
+        QVERIFY(tr2.hasDocument(id));
+        tr2.abort();
+    }
+
+    QVERIFY(tr.resume());
+    QCOMPARE(tr.documentUrl(id), url);
+    tr.suspend();
+
+    // The database can grow, which ends the transaction
+    db->reserve(Q_UINT64_C(768) * 1024 * 1024);
+
+    QVERIFY(!tr.resume());
+    QCOMPARE(tr.documentUrl(id), url);
+
+    // It is closed while suspended
+    tr.suspend();
+}
+
+void TransactionTest::testClear()
+{
+    const QByteArray url(dir->path().toUtf8() + "/file");
+    const quint64 id = touchFile(url);
+
+    {
+        Transaction tr(db, Transaction::ReadWrite);
+
+        Document doc;
+        doc.setId(id);
+        doc.setUrl(url);
+        doc.addTerm("fire");
+        doc.setMTime(1);
+        doc.setCTime(2);
+        tr.addDocument(doc);
+        tr.setPhaseOne(id);
+        QVERIFY(tr.commit());
+    }
+
+    {
+        Transaction tr(db, Transaction::ReadWrite);
+        tr.clear();
+        QVERIFY(tr.commit());
+    }
+
+    Transaction tr(db, Transaction::ReadOnly);
+    QCOMPARE(tr.size(), static_cast<uint>(0));
+    QVERIFY(!tr.hasDocument(id));
+    QCOMPARE(tr.phaseOneSize(), static_cast<uint>(0));
+    QVERIFY(tr.fetchTermsStartingWith("f").isEmpty());
+    QVERIFY(tr.documentUrl(id).isEmpty());
+}
+
+static QVector<quint64> substringMatches(Transaction& tr, const QByteArray& text)
+{
+    QVector<quint64> ids;
+    PostingIterator* it = tr.postingIterator(EngineQuery(text, EngineQuery::Substring));
+    if (!it) {
+        return ids;
+    }
+    while (it->next()) {
+        ids << it->docId();
+    }
+    delete it;
+    return ids;
+}
+
+void TransactionTest::testFileNameSubstring()
+{
+    const QString reportPath = dir->path() + QStringLiteral("/quarterly-report.odt");
+    const QString notesPath = dir->path() + QStringLiteral("/notes.txt");
+    const quint64 reportId = touchFile(reportPath);
+    const quint64 notesId = touchFile(notesPath);
+
+    {
+        Transaction tr(db, Transaction::ReadWrite);
+        for (const QString& path : {reportPath, notesPath}) {
+            Document doc;
+            doc.setId(filePathToId(QFile::encodeName(path)));
+            doc.setUrl(QFile::encodeName(path));
+            doc.addTerm("a");
+            doc.setMTime(1);
+            doc.setCTime(2);
+            tr.addDocument(doc);
+        }
+        tr.commit();
+    }
+
+    {
+        Transaction tr(db, Transaction::ReadOnly);
+        QCOMPARE(substringMatches(tr, "report"), QVector<quint64>({reportId}));
+        QCOMPARE(substringMatches(tr, "otes"), QVector<quint64>({notesId}));
+    }
+
+    // Renaming keeps the inode, so the id stays the same
+    const QString renamedPath = dir->path() + QStringLiteral("/minutes.txt");
+    QVERIFY(QFile::rename(reportPath, renamedPath));
+    {
+        Transaction tr(db, Transaction::ReadWrite);
+        Document doc;
+        doc.setId(reportId);
+        doc.setUrl(QFile::encodeName(renamedPath));
+        tr.replaceDocument(doc, DocumentUrl);
+
+        tr.removeDocument(notesId);
+        tr.commit();
+    }
+
+    Transaction tr(db, Transaction::ReadOnly);
+    QCOMPARE(substringMatches(tr, "report"), QVector<quint64>());
+    QCOMPARE(substringMatches(tr, "otes"), QVector<quint64>());
+    QCOMPARE(substringMatches(tr, "nutes"), QVector<quint64>({reportId}));
+
+    QCOMPARE(tr.documentId(QFile::encodeName(renamedPath)), reportId);
+    QCOMPARE(tr.documentId(QFile::encodeName(reportPath)), static_cast<quint64>(0));
+}
+
+static Document folderDocument(const QString& path)
+{
+    Document doc;
+    doc.setId(filePathToId(QFile::encodeName(path)));
+    doc.setUrl(QFile::encodeName(path));
+    doc.addTerm("a");
+    doc.setMTime(1);
+    doc.setCTime(2);
+    return doc;
+}
+
+void TransactionTest::testBuildFileNameIndexes()
+{
+    const QString reportPath = dir->path() + QStringLiteral("/quarterly-report.odt");
+    const quint64 reportId = touchFile(reportPath);
+    {
+        Transaction tr(db, Transaction::ReadWrite);
+        Document doc;
+        doc.setId(reportId);
+        doc.setUrl(QFile::encodeName(reportPath));
+        doc.addTerm("a");
+        doc.setMTime(1);
+        doc.setCTime(2);
+        tr.addDocument(doc);
+        tr.commit();
+    }
+    delete db;
+
+    // Drop the indexes, as in a database created before they existed
+    MDB_env* env;
+    mdb_env_create(&env);
+    mdb_env_set_maxdbs(env, 15);
+    const QByteArray indexPath = QFile::encodeName(dir->path() + QStringLiteral("/index"));
+    QCOMPARE(mdb_env_open(env, indexPath.constData(), MDB_NOSUBDIR, 0664), 0);
+
+    MDB_txn* txn;
+    mdb_txn_begin(env, NULL, 0, &txn);
+    for (const char* name : {"filenameid", "filenametrigramdb"}) {
+        MDB_dbi dbi;
+        QCOMPARE(mdb_dbi_open(txn, name, 0, &dbi), 0);
+        QCOMPARE(mdb_drop(txn, dbi, 1), 0);
+    }
+    QCOMPARE(mdb_txn_commit(txn), 0);
+    mdb_env_close(env);
+
+    // Opening the database does not build them
+    db = new Database(dir->path());
+    QVERIFY(db->open(Database::CreateDatabase));
+    {
+        Transaction tr(db, Transaction::ReadOnly);
+        QCOMPARE(substringMatches(tr, "report"), QVector<quint64>());
+        QCOMPARE(tr.documentId(QFile::encodeName(reportPath)), reportId);
+    }
+
+    QVERIFY(db->buildFileNameIndexes());
+    {
+        Transaction tr(db, Transaction::ReadOnly);
+        QCOMPARE(substringMatches(tr, "report"), QVector<quint64>({reportId}));
+        QCOMPARE(tr.documentId(QFile::encodeName(reportPath)), reportId);
+        QVERIFY(tr.dbSize().fileNameId > 0);
+        QVERIFY(tr.dbSize().fileNameTrigrams > 0);
+    }
+
+    // Nothing is left to build
+    QVERIFY(db->buildFileNameIndexes());
+}
+
+void TransactionTest::testUrlCache()
+{
+    const QString folderPath = dir->path() + QStringLiteral("/folder");
+    QVERIFY(QDir().mkpath(folderPath));
+    const QString filePath = folderPath + QStringLiteral("/file");
+    const quint64 fileId = touchFile(filePath);
+
+    {
+        Transaction tr(db, Transaction::ReadWrite);
+        tr.addDocument(folderDocument(folderPath));
+        tr.addDocument(folderDocument(filePath));
+        tr.commit();
+    }
+
+    {
+        Transaction tr(db, Transaction::ReadOnly);
+        QCOMPARE(tr.documentUrl(fileId), QFile::encodeName(filePath));
+
+        // Served from the cached folder path
+        QCOMPARE(tr.documentUrl(fileId), QFile::encodeName(filePath));
+    }
+
+    // Moving the folder changes the url of the file inside it
+    const QString movedPath = dir->path() + QStringLiteral("/moved");
+    QVERIFY(QFile::rename(folderPath, movedPath));
+    {
+        Transaction tr(db, Transaction::ReadWrite);
+        tr.replaceDocument(folderDocument(movedPath), DocumentUrl);
+        tr.commit();
+    }
+
+    Transaction tr(db, Transaction::ReadOnly);
+    QCOMPARE(tr.documentUrl(fileId), QFile::encodeName(movedPath + QStringLiteral("/file")));
+}
+
+void TransactionTest::testNewestDocuments()
+{
+    QVector<quint64> ids;
+    QMap<quint64, quint32> mtimes;
+    {
+        Transaction tr(db, Transaction::ReadWrite);
+        for (int i = 0; i < 20; i++) {
+            const QString path = dir->path() + QStringLiteral("/file") + QString::number(i);
+            const quint64 id = touchFile(path);
+
+            Document doc;
+            doc.setId(id);
+            doc.setUrl(QFile::encodeName(path));
+            doc.addTerm("a");
+            doc.setMTime(100 + (i * 7) % 20);
+            doc.setCTime(1);
+            tr.addDocument(doc);
+
+            ids << id;
+            mtimes.insert(id, 100 + (i * 7) % 20);
+        }
+        tr.commit();
+    }
+    std::sort(ids.begin(), ids.end());
+
+    auto newest = [&](QVector<quint64> candidates, int count) {
+        std::sort(candidates.begin(), candidates.end(), [&](quint64 lhs, quint64 rhs) {
+            return mtimes.value(lhs) > mtimes.value(rhs);
+        });
+        return candidates.mid(0, count < 0 ? candidates.size() : count);
+    };
+
+    Transaction tr(db, Transaction::ReadOnly);
+
+    // Most of the documents, which are found through the MTimeDB
+    QCOMPARE(tr.newestDocuments(ids, 3), newest(ids, 3));
+
+    // Only a few of them, which are looked up one by one
+    const QVector<quint64> few = {ids[2], ids[5], ids[11], ids[17]};
+    QCOMPARE(tr.newestDocuments(few, 2), newest(few, 2));
+
+    QCOMPARE(tr.newestDocuments(ids, -1), newest(ids, -1));
+    QCOMPARE(tr.newestDocuments(few, 10), newest(few, 10));
+    QCOMPARE(tr.newestDocuments(few, 0), QVector<quint64>());
+}
+
+void TransactionTest::testQueryResultCache()
+{
+    const QVector<quint64> ids = {1, 5, 9};
+    QVector<quint64> results;
+    {
+        Transaction tr(db, Transaction::ReadOnly);
+        QVERIFY(!tr.cachedQueryResults("query", &results));
+        tr.cacheQueryResults("query", ids);
+        QVERIFY(tr.cachedQueryResults("query", &results));
+        QCOMPARE(results, ids);
+    }
+
+    {
+        Transaction tr(db, Transaction::ReadOnly);
+        QVERIFY(tr.cachedQueryResults("query", &results));
+        QCOMPARE(results, ids);
+        QVERIFY(!tr.cachedQueryResults("other query", &results));
+    }
+
+    // Write transactions neither use nor fill the cache
+    {
+        Transaction tr(db, Transaction::ReadWrite);
+        QVERIFY(!tr.cachedQueryResults("query", &results));
+        tr.cacheQueryResults("other query", ids);
+
+        const QString path = dir->path() + QStringLiteral("/file");
+        Document doc;
+        doc.setId(touchFile(path));
+        doc.setUrl(QFile::encodeName(path));
+        doc.addTerm("a");
+        doc.setMTime(1);
+        doc.setCTime(1);
+        tr.addDocument(doc);
+        tr.commit();
+    }
+
+    // Anything cached before the commit is gone
+    Transaction tr(db, Transaction::ReadOnly);
+    QVERIFY(!tr.cachedQueryResults("query", &results));
+    QVERIFY(!tr.cachedQueryResults("other query", &results));
+}
 
 QTEST_MAIN(TransactionTest)
 
@@ -0,0 +1,159 @@
+/*
+ * This file is part of the KDE Baloo Project
+ * Copyright (C) 2015  Vishesh Handa <vhanda@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "searchstore.h"
+#include "query.h"
+#include "term.h"
+#include "database.h"
+#include "transaction.h"
+#include "document.h"
+#include "idutils.h"
+#include "global.h"
+
+#include <QTest>
+#include <QTemporaryDir>
+#include <QFile>
+
+using namespace Baloo;
+
+class SearchStoreTest : public QObject
+{
+    Q_OBJECT
+
+    QTemporaryDir dir;
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void testCount();
+    void testCountFallback();
+    void testQueryCount();
+    void testQueryExists();
+};
+
+/*
+ * Indexes 10 files which are all tagged "red", and every other one
+ * also "blue"
+ */
+void SearchStoreTest::initTestCase()
+{
+    setenv("BALOO_DB_PATH", dir.path().toStdString().c_str(), 1);
+
+    Database db(fileIndexDbPath());
+    QVERIFY(db.open(Database::CreateDatabase));
+
+    Transaction tr(db, Transaction::ReadWrite);
+    for (int i = 0; i < 10; i++) {
+        const QString path = dir.path() + QStringLiteral("/file") + QString::number(i);
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.close();
+
+        Document doc;
+        doc.setUrl(QFile::encodeName(path));
+        doc.setId(filePathToId(doc.url()));
+        doc.addTerm("TAred");
+        if (i % 2 == 0) {
+            doc.addTerm("TAblue");
+        }
+        doc.setMTime(1);
+        doc.setCTime(1);
+        tr.addDocument(doc);
+    }
+    QVERIFY(tr.commit());
+}
+
+void SearchStoreTest::testCount()
+{
+    SearchStore store;
+    const Term red(QStringLiteral("tag"), QStringLiteral("red"), Term::Equal);
+
+    QCOMPARE(store.count(red, 0, -1), 10u);
+    QCOMPARE(store.count(red, 0, 4), 4u);
+    QCOMPARE(store.count(red, 8, 5), 2u);
+    QCOMPARE(store.count(red, 10, 5), 0u);
+    QCOMPARE(store.count(red, 3, 0), 0u);
+
+    const Term green(QStringLiteral("tag"), QStringLiteral("green"), Term::Equal);
+    QCOMPARE(store.count(green, 0, -1), 0u);
+}
+
+void SearchStoreTest::testCountFallback()
+{
+    SearchStore store;
+    const Term red(QStringLiteral("tag"), QStringLiteral("red"), Term::Equal);
+    const Term blue(QStringLiteral("tag"), QStringLiteral("blue"), Term::Equal);
+
+    // A single posting list knows its size, the same list twice is counted
+    // by reading the documents
+    const Term redTwice(red, Term::And, red);
+    const QVector<QPair<uint, int>> ranges = {{0, -1}, {0, 4}, {8, 5}, {10, 5}, {3, 0}};
+    for (const auto& range : ranges) {
+        QCOMPARE(store.count(redTwice, range.first, range.second), store.count(red, range.first, range.second));
+    }
+
+    const Term redAndBlue(red, Term::And, blue);
+    QCOMPARE(store.count(redAndBlue, 0, -1), 5u);
+    QCOMPARE(store.count(redAndBlue, 2, -1), 3u);
+    QCOMPARE(store.count(redAndBlue, 1, 2), 2u);
+    QCOMPARE(store.count(Term(red, Term::Or, blue), 0, -1), 10u);
+}
+
+void SearchStoreTest::testQueryCount()
+{
+    Query query;
+    query.setSearchString(QStringLiteral("tag=red"));
+    QCOMPARE(query.count(), 10u);
+
+    query.setLimit(4);
+    QCOMPARE(query.count(), 4u);
+
+    query.setOffset(8);
+    QCOMPARE(query.count(), 2u);
+
+    query.setOffset(12);
+    QCOMPARE(query.count(), 0u);
+
+    query.setSearchString(QStringLiteral("tag=green"));
+    query.setOffset(0);
+    QCOMPARE(query.count(), 0u);
+}
+
+void SearchStoreTest::testQueryExists()
+{
+    Query query;
+    query.setSearchString(QStringLiteral("tag=blue"));
+    QVERIFY(query.exists());
+
+    query.setOffset(4);
+    QVERIFY(query.exists());
+
+    // Past the last result
+    query.setOffset(5);
+    QVERIFY(!query.exists());
+
+    query.setSearchString(QStringLiteral("tag=green"));
+    query.setOffset(0);
+    QVERIFY(!query.exists());
+}
+
+QTEST_MAIN(SearchStoreTest)
+
+#include "searchstoretest.moc"
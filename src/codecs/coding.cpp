@@ -165,6 +165,25 @@ char* getDifferentialVarInt32(char* p, char* limit, QVector<quint32>* values)
     return p;
 }
 
+const char* skipDifferentialVarInt32(const char* p, const char* limit)
+{
+    quint32 size;
+    p = getVarint32Ptr(p, limit, &size);
+    if (!p) {
+        return limit;
+    }
+
+    // The last byte of every varint has the high bit cleared
+    while (p < limit && size) {
+        if (!(*reinterpret_cast<const unsigned char*>(p) & 128)) {
+            size--;
+        }
+        p++;
+    }
+
+    return p;
+}
+
 int varintLength(quint64 v)
 {
     int len = 1;
@@ -193,6 +212,11 @@ char* getVarint32PtrFallback(char* p, char* limit, quint32* value)
     return NULL;
 }
 
+const char* getVarint32Ptr(const char* p, const char* limit, quint32* value)
+{
+    return getVarint32Ptr(const_cast<char*>(p), const_cast<char*>(limit), value);
+}
+
 bool getVarint32(QByteArray* input, quint32* value)
 {
     char* p = input->data();
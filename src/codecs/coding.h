@@ -65,6 +65,10 @@ void putVarint64(QByteArray* dst, quint64 value);
 void putDifferentialVarInt32(QByteArray* dst, const QVector<quint32>& values);
 char* getDifferentialVarInt32(char* input, char* limit, QVector<quint32>* values);
 
+// Returns a pointer just past the values written by putDifferentialVarInt32,
+// without decoding them
+const char* skipDifferentialVarInt32(const char* input, const char* limit);
+
 // Standard Get... routines parse a value from the beginning of a Slice
 // and advance the slice past the parsed value.
 bool getFixed32(QByteArray* input, quint32* value);
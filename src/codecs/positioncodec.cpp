@@ -41,6 +41,38 @@ QByteArray PositionCodec::encode(const QVector<PositionInfo>& list)
     return data;
 }
 
+PositionDecoder::PositionDecoder(const char* data, uint size)
+    : m_ptr(data)
+    , m_end(data + size)
+    , m_positions(0)
+    , m_docId(0)
+{
+}
+
+quint64 PositionDecoder::next()
+{
+    if (m_ptr + sizeof(quint64) > m_end) {
+        m_ptr = m_end;
+        m_positions = 0;
+        m_docId = 0;
+        return 0;
+    }
+
+    m_docId = decodeFixed64(m_ptr);
+    m_positions = m_ptr + sizeof(quint64);
+    m_ptr = skipDifferentialVarInt32(m_positions, m_end);
+    return m_docId;
+}
+
+QVector<uint> PositionDecoder::positions() const
+{
+    QVector<uint> positions;
+    if (m_positions) {
+        getDifferentialVarInt32(const_cast<char*>(m_positions), const_cast<char*>(m_end), &positions);
+    }
+    return positions;
+}
+
 QVector<PositionInfo> PositionCodec::decode(const QByteArray& arr)
 {
     char* data = const_cast<char*>(arr.data());
@@ -36,6 +36,36 @@ public:
     QByteArray encode(const QVector<PositionInfo>& list);
     QVector<PositionInfo> decode(const QByteArray& arr);
 };
+
+/**
+ * Reads the documents written by the PositionCodec one at a time, straight
+ * from \p data without copying it. The positions of a document are only
+ * decoded when asked for. The data needs to stay valid for as long as the
+ * decoder is used.
+ */
+class PositionDecoder
+{
+public:
+    PositionDecoder(const char* data, uint size);
+
+    /**
+     * Moves to the next document and returns its id, or 0 once all of
+     * them have been read. The positions are skipped over.
+     */
+    quint64 next();
+    quint64 docId() const { return m_docId; }
+
+    /**
+     * Decodes the positions of the current document
+     */
+    QVector<uint> positions() const;
+
+private:
+    const char* m_ptr;
+    const char* m_end;
+    const char* m_positions;
+    quint64 m_docId;
+};
 }
 
 #endif // BALOO_POSITIONCODEC_H
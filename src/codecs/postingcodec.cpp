@@ -19,26 +19,482 @@
  */
 
 #include "postingcodec.h"
+#include "coding.h"
+
+#include <QtAlgorithms>
+#include <QtEndian>
 
 using namespace Baloo;
 
+// Lists with a single block are written without the skip directory
+static const char s_version = 1;
+static const char s_skipListVersion = 2;
+static const char s_bitmapVersion = 3;
+static const int s_blockSize = PostingDecoder::MaxBlockSize;
+
+// Per block: the last id (fixed64) and the offset of the block (fixed32)
+static const int s_skipEntrySize = 12;
+
+// Lists are stored as a bitmap once they hold at least one in this many
+// of the inodes they span
+static const int s_bitmapDensity = 8;
+static const int s_minBitmapSize = 64;
+
+namespace {
+
+int bitWidth(quint64 value)
+{
+    int width = 0;
+    while (value) {
+        value >>= 1;
+        width++;
+    }
+    return width;
+}
+
+int trailingZeros(quint64 value)
+{
+    return value ? countTrailingZeros(value) : 64;
+}
+
+inline quint64 lowBits(int width)
+{
+    return width >= 64 ? ~quint64(0) : (quint64(1) << width) - 1;
+}
+
+void packBits(QByteArray* dst, const quint64* values, int count, int width)
+{
+    const int offset = dst->size();
+    dst->append(QByteArray((count * width + 7) / 8, 0));
+    uchar* out = reinterpret_cast<uchar*>(dst->data() + offset);
+
+    quint64 bitPos = 0;
+    for (int i = 0; i < count; i++) {
+        quint64 value = values[i];
+        int remaining = width;
+        while (remaining > 0) {
+            const int shift = bitPos & 7;
+            const int chunk = qMin(8 - shift, remaining);
+            out[bitPos >> 3] |= uchar((value & lowBits(chunk)) << shift);
+            value = chunk >= 64 ? 0 : value >> chunk;
+            remaining -= chunk;
+            bitPos += chunk;
+        }
+    }
+}
+
+/*
+ * Reads \p count values of \p width bits. Whenever 8 bytes can be read without
+ * going past \p end a single unaligned load is used, otherwise the bytes are
+ * collected one at a time.
+ */
+void unpackBits(const uchar* data, const uchar* end, quint64* values, int count, int width)
+{
+    const quint64 mask = lowBits(width);
+    quint64 bitPos = 0;
+    for (int i = 0; i < count; i++) {
+        const uchar* p = data + (bitPos >> 3);
+        const int shift = bitPos & 7;
+        if (width + shift <= 64 && p + 8 <= end) {
+            values[i] = (qFromLittleEndian<quint64>(p) >> shift) & mask;
+        } else {
+            quint64 value = 0;
+            int read = 0;
+            int skip = shift;
+            while (read < width) {
+                const int chunk = qMin(8 - skip, width - read);
+                value |= quint64((*p >> skip) & lowBits(chunk)) << read;
+                read += chunk;
+                skip = 0;
+                p++;
+            }
+            values[i] = value;
+        }
+        bitPos += width;
+    }
+}
+
+bool isDense(const QVector<quint64>& list)
+{
+    if (list.size() < s_minBitmapSize) {
+        return false;
+    }
+
+    const quint32 deviceId = static_cast<quint32>(list.first());
+    for (quint64 id : list) {
+        if (static_cast<quint32>(id) != deviceId) {
+            return false;
+        }
+    }
+
+    const quint64 span = (list.last() >> 32) - (list.first() >> 32) + 1;
+    return span <= static_cast<quint64>(list.size()) * s_bitmapDensity;
+}
+
+QByteArray encodeBitmap(const QVector<quint64>& list)
+{
+    const quint32 firstInode = list.first() >> 32;
+    const quint32 bits = (list.last() >> 32) - firstInode + 1;
+
+    QByteArray arr;
+    arr.append(s_bitmapVersion);
+    putVarint32(&arr, list.size());
+    putVarint32(&arr, static_cast<quint32>(list.first()));
+    putVarint32(&arr, firstInode);
+    putVarint32(&arr, bits);
+
+    const int offset = arr.size();
+    arr.append(QByteArray((bits + 7) / 8, 0));
+    uchar* data = reinterpret_cast<uchar*>(arr.data() + offset);
+    for (quint64 id : list) {
+        const quint32 bit = (id >> 32) - firstInode;
+        data[bit >> 3] |= 1 << (bit & 7);
+    }
+
+    return arr;
+}
+
+}
+
+int Baloo::countTrailingZeros(quint64 value)
+{
+    Q_ASSERT(value);
+    return qPopulationCount((value & (~value + 1)) - 1);
+}
+
 PostingCodec::PostingCodec()
 {
 }
 
 QByteArray PostingCodec::encode(const QVector<quint64>& list)
 {
-    uint size = list.size() * sizeof(quint64);
-    char* ptr = reinterpret_cast<char*>(const_cast<quint64*>(list.constData()));
+    if (isDense(list)) {
+        return encodeBitmap(list);
+    }
 
-    return QByteArray(ptr, size);
+    const int blocks = (list.size() + s_blockSize - 1) / s_blockSize;
+
+    QByteArray arr;
+    arr.reserve(8 + list.size() * 3);
+    arr.append(blocks > 1 ? s_skipListVersion : s_version);
+    putVarint32(&arr, list.size());
+
+    const int directory = arr.size();
+    if (blocks > 1) {
+        arr.append(QByteArray(blocks * s_skipEntrySize, 0));
+    }
+    const int dataStart = arr.size();
+
+    quint64 deltas[s_blockSize];
+    for (int start = 0; start < list.size(); start += s_blockSize) {
+        const int count = qMin(s_blockSize, list.size() - start);
+        const quint64* ids = list.constData() + start;
+
+        if (blocks > 1) {
+            char* entry = arr.data() + directory + (start / s_blockSize) * s_skipEntrySize;
+            encodeFixed64(entry, ids[count - 1]);
+            encodeFixed32(entry + 8, arr.size() - dataStart);
+        }
+
+        // Split the first id so that the device and the inode are each
+        // stored as a small varint
+        putVarint32(&arr, static_cast<quint32>(ids[0]));
+        putVarint32(&arr, static_cast<quint32>(ids[0] >> 32));
+        if (count == 1) {
+            continue;
+        }
+
+        quint64 all = 0;
+        for (int i = 1; i < count; i++) {
+            Q_ASSERT(ids[i] >= ids[i - 1]);
+            deltas[i - 1] = ids[i] - ids[i - 1];
+            all |= deltas[i - 1];
+        }
+
+        const int shift = all ? trailingZeros(all) : 0;
+        quint64 max = 0;
+        for (int i = 0; i < count - 1; i++) {
+            deltas[i] >>= shift;
+            max = qMax(max, deltas[i]);
+        }
+        const int width = bitWidth(max);
+
+        arr.append(static_cast<char>(shift));
+        arr.append(static_cast<char>(width));
+        packBits(&arr, deltas, count - 1, width);
+    }
+
+    return arr;
 }
 
 QVector<quint64> PostingCodec::decode(const QByteArray& arr)
+{
+    PostingDecoder decoder(arr.constData(), arr.size());
+
+    QVector<quint64> vec;
+    vec.resize(decoder.size());
+
+    int pos = 0;
+    while (pos < vec.size()) {
+        const int count = decoder.nextBlock(vec.data() + pos);
+        if (!count) {
+            return QVector<quint64>();
+        }
+        pos += count;
+    }
+
+    return vec;
+}
+
+QVector<quint64> PostingCodec::decodeRaw(const QByteArray& arr)
 {
     QVector<quint64> vec;
     vec.resize(arr.size() / sizeof(quint64));
 
-    memcpy(vec.data(), arr.data(), arr.size());
+    memcpy(vec.data(), arr.data(), vec.size() * sizeof(quint64));
     return vec;
 }
+
+PostingDecoder::PostingDecoder(const char* data, uint size)
+    : m_ptr(data)
+    , m_end(data + size)
+    , m_directory(0)
+    , m_blockData(0)
+    , m_size(0)
+    , m_remaining(0)
+{
+    if (!size || (data[0] != s_version && data[0] != s_skipListVersion && data[0] != s_bitmapVersion)) {
+        return;
+    }
+
+    quint32 count = 0;
+    m_ptr = getVarint32Ptr(m_ptr + 1, m_end, &count);
+    if (!m_ptr) {
+        return;
+    }
+
+    if (data[0] == s_bitmapVersion) {
+        quint32 deviceId = 0;
+        quint32 firstInode = 0;
+        quint32 bits = 0;
+        m_ptr = getVarint32Ptr(m_ptr, m_end, &deviceId);
+        m_ptr = m_ptr ? getVarint32Ptr(m_ptr, m_end, &firstInode) : 0;
+        m_ptr = m_ptr ? getVarint32Ptr(m_ptr, m_end, &bits) : 0;
+        if (!m_ptr || static_cast<quint64>(m_end - m_ptr) < (static_cast<quint64>(bits) + 7) / 8) {
+            return;
+        }
+
+        m_bitmap = PostingBitmap(reinterpret_cast<const uchar*>(m_ptr), deviceId, firstInode, bits);
+        m_inode = firstInode;
+        m_size = count;
+        m_remaining = count;
+        return;
+    }
+
+    if (data[0] == s_skipListVersion) {
+        const uint blocks = (count + s_blockSize - 1) / s_blockSize;
+        if (static_cast<quint64>(m_end - m_ptr) < static_cast<quint64>(blocks) * s_skipEntrySize) {
+            return;
+        }
+        m_directory = m_ptr;
+        m_ptr += blocks * s_skipEntrySize;
+        m_blockData = m_ptr;
+    }
+
+    m_size = count;
+    m_remaining = count;
+}
+
+int PostingDecoder::skipToBlock(quint64 docId, quint64* ids)
+{
+    if (!m_bitmap.isNull()) {
+        // Documents on the same inode are ordered by their device id
+        quint64 inode = docId >> 32;
+        if (static_cast<quint32>(docId) > m_bitmap.deviceId()) {
+            inode++;
+        }
+        m_inode = qMax(m_inode, inode);
+        return nextBitmapBlock(ids);
+    }
+
+    if (m_directory && m_remaining) {
+        const uint blocks = (m_size + s_blockSize - 1) / s_blockSize;
+        uint first = (m_size - m_remaining) / s_blockSize;
+
+        // Find the first remaining block whose last id is >= docId
+        uint count = blocks - first;
+        while (count > 0) {
+            const uint step = count / 2;
+            const uint mid = first + step;
+            if (decodeFixed64(m_directory + mid * s_skipEntrySize) < docId) {
+                first = mid + 1;
+                count -= step + 1;
+            } else {
+                count = step;
+            }
+        }
+
+        if (first == blocks) {
+            m_remaining = 0;
+            return 0;
+        }
+
+        const quint32 offset = decodeFixed32(m_directory + first * s_skipEntrySize + 8);
+        if (offset > static_cast<quint64>(m_end - m_blockData)) {
+            m_remaining = 0;
+            return 0;
+        }
+        m_ptr = m_blockData + offset;
+        m_remaining = m_size - first * s_blockSize;
+        return nextBlock(ids);
+    }
+
+    while (int count = nextBlock(ids)) {
+        if (ids[count - 1] >= docId) {
+            return count;
+        }
+    }
+    return 0;
+}
+
+int PostingDecoder::nextBlock(quint64* ids)
+{
+    if (!m_remaining) {
+        return 0;
+    }
+    if (!m_bitmap.isNull()) {
+        return nextBitmapBlock(ids);
+    }
+    const int count = qMin<uint>(s_blockSize, m_remaining);
+
+    quint32 low = 0;
+    quint32 high = 0;
+    const char* ptr = getVarint32Ptr(m_ptr, m_end, &low);
+    ptr = ptr ? getVarint32Ptr(ptr, m_end, &high) : 0;
+    if (!ptr) {
+        m_remaining = 0;
+        return 0;
+    }
+    ids[0] = (static_cast<quint64>(high) << 32) | low;
+
+    if (count > 1) {
+        if (m_end - ptr < 2) {
+            m_remaining = 0;
+            return 0;
+        }
+
+        const int shift = static_cast<uchar>(*ptr++);
+        const int width = static_cast<uchar>(*ptr++);
+        const int bytes = ((count - 1) * width + 7) / 8;
+        if (shift > 63 || width > 64 || m_end - ptr < bytes) {
+            m_remaining = 0;
+            return 0;
+        }
+
+        unpackBits(reinterpret_cast<const uchar*>(ptr), reinterpret_cast<const uchar*>(m_end),
+                   ids + 1, count - 1, width);
+        for (int i = 1; i < count; i++) {
+            ids[i] = ids[i - 1] + (ids[i] << shift);
+        }
+        ptr += bytes;
+    }
+
+    m_ptr = ptr;
+    m_remaining -= count;
+    return count;
+}
+
+int PostingDecoder::nextBitmapBlock(quint64* ids)
+{
+    if (!m_remaining) {
+        return 0;
+    }
+
+    const quint64 deviceId = m_bitmap.deviceId();
+    const quint64 end = m_bitmap.endInode();
+
+    int count = 0;
+    while (count < s_blockSize) {
+        m_inode = m_bitmap.nextInode(m_inode);
+        if (m_inode >= end) {
+            break;
+        }
+        ids[count++] = (m_inode << 32) | deviceId;
+        m_inode++;
+    }
+
+    if (!count) {
+        m_remaining = 0;
+    }
+    return count;
+}
+
+//
+// PostingBitmap
+//
+PostingBitmap::PostingBitmap()
+    : m_data(0)
+    , m_deviceId(0)
+    , m_firstInode(0)
+    , m_bits(0)
+{
+}
+
+PostingBitmap::PostingBitmap(const uchar* data, quint32 deviceId, quint32 firstInode, quint32 bits)
+    : m_data(data)
+    , m_deviceId(deviceId)
+    , m_firstInode(firstInode)
+    , m_bits(bits)
+{
+}
+
+quint64 PostingBitmap::word(quint64 inode) const
+{
+    if (inode >= endInode() || inode + 64 <= m_firstInode) {
+        return 0;
+    }
+
+    if (inode < m_firstInode) {
+        return word(m_firstInode) << (m_firstInode - inode);
+    }
+
+    const quint64 bit = inode - m_firstInode;
+    const quint64 bytes = (static_cast<quint64>(m_bits) + 7) / 8;
+    const uchar* p = m_data + (bit >> 3);
+    const int shift = bit & 7;
+
+    quint64 value;
+    if ((bit >> 3) + 9 <= bytes) {
+        value = qFromLittleEndian<quint64>(p) >> shift;
+        if (shift) {
+            value |= static_cast<quint64>(p[8]) << (64 - shift);
+        }
+    } else {
+        value = 0;
+        for (quint64 i = 0; (bit >> 3) + i < bytes && 8 * i < 64 + static_cast<quint64>(shift); i++) {
+            const quint64 byte = p[i];
+            value |= i ? byte << (8 * i - shift) : byte >> shift;
+        }
+    }
+
+    const quint64 remaining = endInode() - inode;
+    if (remaining < 64) {
+        value &= lowBits(remaining);
+    }
+    return value;
+}
+
+quint64 PostingBitmap::nextInode(quint64 inode) const
+{
+    inode = qMax<quint64>(inode, m_firstInode);
+
+    const quint64 end = endInode();
+    while (inode < end) {
+        const quint64 bits = word(inode);
+        if (bits) {
+            return inode + countTrailingZeros(bits);
+        }
+        inode += 64;
+    }
+    return end;
+}
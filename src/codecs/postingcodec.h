@@ -26,6 +26,23 @@
 
 namespace Baloo {
 
+/**
+ * Encodes a sorted list of document ids.
+ *
+ * The ids are stored as a version byte, followed by the number of ids and
+ * blocks of up to 128 ids. Each block stores its first id and the delta of
+ * the remaining ones, bit-packed with a common width. Since the device id
+ * lives in the lower 32 bits of a document id, the common trailing zero bits
+ * of the deltas are shifted out before packing.
+ *
+ * Lists with more than one block start with a skip directory holding the
+ * last id and the offset of every block, so that a reader can jump to the
+ * block containing a given id.
+ *
+ * Dense lists, where all the ids share a device and cover a good part of
+ * the inodes between the first and the last one, are stored as a bitmap
+ * of the inodes instead.
+ */
 class PostingCodec
 {
 public:
@@ -33,6 +50,109 @@ public:
 
     QByteArray encode(const QVector<quint64>& list);
     QVector<quint64> decode(const QByteArray& arr);
+
+    /**
+     * Decodes the raw 8 bytes per id format which was used before the
+     * posting lists were compressed. Only used while migrating.
+     */
+    QVector<quint64> decodeRaw(const QByteArray& arr);
+};
+
+/**
+ * A view of a posting list stored as a bitmap. All the documents share the
+ * same device id, and bit i is set if the document with the inode
+ * firstInode() + i is part of the list. The data is not copied.
+ */
+class PostingBitmap
+{
+public:
+    PostingBitmap();
+    PostingBitmap(const uchar* data, quint32 deviceId, quint32 firstInode, quint32 bits);
+
+    bool isNull() const { return !m_data; }
+
+    quint32 deviceId() const { return m_deviceId; }
+    quint32 firstInode() const { return m_firstInode; }
+
+    /**
+     * One past the last inode covered by the bitmap
+     */
+    quint64 endInode() const { return static_cast<quint64>(m_firstInode) + m_bits; }
+
+    /**
+     * Returns the bits of the inodes [inode, inode + 64). Bit 0 corresponds
+     * to \p inode, and inodes outside the bitmap are never set.
+     */
+    quint64 word(quint64 inode) const;
+
+    /**
+     * Returns the first inode >= \p inode which is set, or endInode()
+     */
+    quint64 nextInode(quint64 inode) const;
+
+private:
+    const uchar* m_data;
+    quint32 m_deviceId;
+    quint32 m_firstInode;
+    quint32 m_bits;
+};
+
+/**
+ * Returns the number of trailing zero bits of \p value, which may not be 0
+ */
+int countTrailingZeros(quint64 value);
+
+/**
+ * Reads a posting list written by the PostingCodec one block at a time,
+ * straight from \p data without copying it. The data needs to stay valid
+ * for as long as the decoder is used.
+ */
+class PostingDecoder
+{
+public:
+    PostingDecoder(const char* data, uint size);
+
+    enum {
+        MaxBlockSize = 128
+    };
+
+    /**
+     * The total number of ids in the list
+     */
+    uint size() const { return m_size; }
+
+    /**
+     * Decodes the next block into \p ids, which needs to have space
+     * for MaxBlockSize ids. Returns the number of ids decoded, or 0
+     * once the list has been exhausted.
+     */
+    int nextBlock(quint64* ids);
+
+    /**
+     * Skips forward to the first block containing an id >= \p docId and
+     * decodes it like nextBlock(). The skip directory is binary searched
+     * so the blocks in between are never decoded.
+     */
+    int skipToBlock(quint64 docId, quint64* ids);
+
+    /**
+     * The bitmap the list is stored in, or a null bitmap if the list is
+     * stored as packed deltas
+     */
+    const PostingBitmap& bitmap() const { return m_bitmap; }
+
+private:
+    int nextBitmapBlock(quint64* ids);
+
+    PostingBitmap m_bitmap;
+    quint64 m_inode;
+
+    const char* m_ptr;
+    const char* m_end;
+    const char* m_directory;
+    const char* m_blockData;
+    uint m_size;
+    uint m_remaining;
 };
 
 }
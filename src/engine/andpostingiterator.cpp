@@ -19,6 +19,12 @@
  */
 
 #include "andpostingiterator.h"
+#include "postingcodec.h"
+
+#include <QPair>
+#include <QVarLengthArray>
+
+#include <algorithm>
 
 using namespace Baloo;
 
@@ -29,12 +35,38 @@ AndPostingIterator::AndPostingIterator(const QVector<PostingIterator*>& iterator
     if (m_iterators.contains(0)) {
         qDeleteAll(m_iterators);
         m_iterators.clear();
+        return;
+    }
+
+    // Filters are only checked against the candidates of the others, but
+    // one of them has to list the documents when there are no others
+    for (int i = m_iterators.size() - 1; i >= 0 && m_iterators.size() > 1; i--) {
+        if (m_iterators[i]->isFilter()) {
+            m_filters << m_iterators.takeAt(i);
+        }
+    }
+
+    // The first iterator proposes the candidates, so the shortest list is
+    // put there and the intersection is bounded by it. The estimates can
+    // take some work, so each one is only asked for once.
+    QVector<QPair<quint64, PostingIterator*>> sizes;
+    sizes.reserve(m_iterators.size());
+    for (PostingIterator* iter : m_iterators) {
+        sizes << qMakePair(iter->estimatedSize(), iter);
+    }
+    std::stable_sort(sizes.begin(), sizes.end(), [](const QPair<quint64, PostingIterator*>& lhs, const QPair<quint64, PostingIterator*>& rhs) {
+        return lhs.first < rhs.first;
+    });
+
+    for (int i = 0; i < sizes.size(); i++) {
+        m_iterators[i] = sizes[i].second;
     }
 }
 
 AndPostingIterator::~AndPostingIterator()
 {
     qDeleteAll(m_iterators);
+    qDeleteAll(m_filters);
 }
 
 quint64 AndPostingIterator::docId() const
@@ -42,6 +74,15 @@ quint64 AndPostingIterator::docId() const
     return m_docId;
 }
 
+quint64 AndPostingIterator::estimatedSize() const
+{
+    quint64 size = m_iterators.isEmpty() ? 0 : ~quint64(0);
+    for (PostingIterator* iter : m_iterators) {
+        size = qMin(size, iter->estimatedSize());
+    }
+    return size;
+}
+
 quint64 AndPostingIterator::next()
 {
     if (m_iterators.isEmpty()) {
@@ -49,26 +90,176 @@ quint64 AndPostingIterator::next()
         return 0;
     }
 
-    if (m_iterators[0]->next() == 0) {
+    return findMatch(m_iterators[0]->next());
+}
+
+quint64 AndPostingIterator::skipTo(quint64 docId)
+{
+    if (m_iterators.isEmpty()) {
         m_docId = 0;
         return 0;
     }
+    if (m_docId && m_docId >= docId) {
+        return m_docId;
+    }
 
-    m_docId = m_iterators[0]->docId();
+    return findMatch(m_iterators[0]->skipTo(docId));
+}
 
+/*
+ * Takes a block of candidates from the first iterator, which has the
+ * shortest list, and only keeps the ones all the others have
+ */
+int AndPostingIterator::nextBlock(quint64* ids, int size)
+{
+    if (m_iterators.isEmpty()) {
+        m_docId = 0;
+        return 0;
+    }
+
+    int count = 0;
+    while (!count) {
+        const int candidates = m_iterators[0]->nextBlock(ids, size);
+        if (!candidates) {
+            break;
+        }
+
+        for (int i = 0; i < candidates; i++) {
+            if (accepts(ids[i])) {
+                ids[count++] = ids[i];
+            }
+        }
+    }
+
+    m_docId = count ? ids[count - 1] : 0;
+    return count;
+}
+
+bool AndPostingIterator::accepts(quint64 candidate)
+{
     for (int i = 1; i < m_iterators.size(); i++) {
         PostingIterator* iter = m_iterators[i];
-        if (iter->docId() == 0 && iter->next() == 0) {
-            m_docId = 0;
-            return 0;
+        const quint64 id = iter->docId() < candidate ? iter->skipTo(candidate) : iter->docId();
+        if (id != candidate) {
+            return false;
         }
+    }
 
-        iter->skipTo(m_docId);
+    for (PostingIterator* filter : m_filters) {
+        if (!filter->contains(candidate)) {
+            return false;
+        }
+    }
+    return true;
+}
 
-        if (m_docId != iter->docId()) {
-            return next();
+/*
+ * Moves to the first document from \p candidate on which all the iterators
+ * agree on and the filters accept
+ */
+quint64 AndPostingIterator::findMatch(quint64 candidate)
+{
+    while (1) {
+        candidate = intersect(candidate);
+        if (!candidate) {
+            break;
         }
+
+        bool accepted = true;
+        for (PostingIterator* filter : m_filters) {
+            if (!filter->contains(candidate)) {
+                accepted = false;
+                break;
+            }
+        }
+        if (accepted) {
+            break;
+        }
+        candidate = m_iterators[0]->next();
     }
 
+    m_docId = candidate;
     return m_docId;
 }
+
+/*
+ * The first iterator is positioned on \p candidate. Every other iterator is
+ * skipped to the current candidate in turn, and whenever one of them lands
+ * past it that id becomes the new candidate, until all of them agree.
+ */
+quint64 AndPostingIterator::intersect(quint64 candidate)
+{
+    const int size = m_iterators.size();
+    int matched = 1;
+    int i = 1 % size;
+
+    while (candidate && matched < size) {
+        if (matched == 1) {
+            const quint64 id = bitmapMatch(candidate);
+            if (id != candidate) {
+                candidate = m_iterators[0]->skipTo(id);
+                i = 1 % size;
+                continue;
+            }
+        }
+
+        PostingIterator* iter = m_iterators[i];
+        const quint64 id = iter->docId() < candidate ? iter->skipTo(candidate) : iter->docId();
+        if (id == candidate) {
+            matched++;
+        } else {
+            candidate = id;
+            matched = 1;
+        }
+        i = (i + 1) % size;
+    }
+
+    return candidate;
+}
+
+/*
+ * When every iterator reads the candidate's device from a bitmap, the
+ * bitmaps are ANDed a word at a time. Returns the first id >= \p candidate
+ * which is set in all of them, or the first id past the shortest bitmap.
+ * Returns \p candidate if the iterators are not all bitmap based.
+ */
+quint64 AndPostingIterator::bitmapMatch(quint64 candidate) const
+{
+    const int size = m_iterators.size();
+    if (size < 2) {
+        return candidate;
+    }
+
+    QVarLengthArray<const PostingBitmap*, 8> bitmaps(size);
+    const quint32 deviceId = static_cast<quint32>(candidate);
+    quint64 end = ~quint64(0);
+    for (int i = 0; i < size; i++) {
+        bitmaps[i] = m_iterators[i]->bitmap();
+        if (!bitmaps[i] || bitmaps[i]->deviceId() != deviceId) {
+            return candidate;
+        }
+        end = qMin(end, bitmaps[i]->endInode());
+    }
+
+    // The bitmap of an iterator which has not caught up yet may end early
+    if (end <= (candidate >> 32)) {
+        return candidate;
+    }
+
+    for (quint64 inode = candidate >> 32; inode < end; inode += 64) {
+        quint64 bits = ~quint64(0);
+        for (int i = 0; i < size && bits; i++) {
+            bits &= bitmaps[i]->word(inode);
+        }
+        if (bits) {
+            const quint64 match = inode + countTrailingZeros(bits);
+            if (match < end) {
+                return (match << 32) | deviceId;
+            }
+            break;
+        }
+    }
+
+    // Nothing up to the last id of the shortest bitmap
+    return (((end - 1) << 32) | deviceId) + 1;
+}
@@ -34,9 +34,18 @@ public:
 
     quint64 next() Q_DECL_OVERRIDE;
     quint64 docId() const Q_DECL_OVERRIDE;
+    quint64 skipTo(quint64 docId) Q_DECL_OVERRIDE;
+    int nextBlock(quint64* ids, int size) Q_DECL_OVERRIDE;
+    quint64 estimatedSize() const Q_DECL_OVERRIDE;
 
 private:
+    quint64 findMatch(quint64 candidate);
+    quint64 intersect(quint64 candidate);
+    quint64 bitmapMatch(quint64 candidate) const;
+    bool accepts(quint64 candidate);
+
     QVector<PostingIterator*> m_iterators;
+    QVector<PostingIterator*> m_filters;
     quint64 m_docId;
 };
 
@@ -0,0 +1,477 @@
+/*
+   This file is part of the KDE Baloo project.
+ * Copyright (C) 2016  Vishesh Handa <vhanda@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "bulkloader.h"
+#include "chunkedlist.h"
+#include "coding.h"
+#include "mapfull.h"
+#include "positioncodec.h"
+#include "positioninfo.h"
+#include "postingcodec.h"
+
+#include <QFile>
+#include <QDebug>
+
+#include <algorithm>
+#include <queue>
+
+using namespace Baloo;
+
+// Size of the buffers used for reading and writing the runs
+static const int s_ioBufferSize = 256 * 1024;
+
+namespace {
+
+bool entryLessThan(const BulkLoader::Entry& lhs, const BulkLoader::Entry& rhs)
+{
+    if (lhs.term != rhs.term) {
+        return lhs.term < rhs.term;
+    }
+    return lhs.id < rhs.id;
+}
+
+qint64 entrySize(const BulkLoader::Entry& entry)
+{
+    // Rough allocation overhead of the term and the positions
+    return sizeof(BulkLoader::Entry) + 64 + entry.term.size() + entry.positions.size() * sizeof(uint);
+}
+
+/**
+ * Reads back the entries of a run written by BulkLoader::flush()
+ */
+class RunReader
+{
+public:
+    RunReader(const QString& path, int index)
+        : m_file(path)
+        , m_pos(0)
+        , m_index(index)
+        , m_failed(false)
+    {
+        if (!m_file.open(QIODevice::ReadOnly)) {
+            qWarning() << "Could not open" << path;
+            m_failed = true;
+        }
+    }
+
+    int index() const { return m_index; }
+    const BulkLoader::Entry& entry() const { return m_entry; }
+
+    /**
+     * Whether the run could not be read, or ended in the middle of an entry
+     */
+    bool hasFailed() const { return m_failed; }
+
+    bool next() {
+        while (!parse()) {
+            m_buffer.remove(0, m_pos);
+            m_pos = 0;
+
+            const QByteArray data = m_failed ? QByteArray() : m_file.read(s_ioBufferSize);
+            if (data.isEmpty()) {
+                if (!m_buffer.isEmpty() || m_file.error() != QFileDevice::NoError) {
+                    qWarning() << "Could not read" << m_file.fileName() << m_file.errorString();
+                    m_failed = true;
+                }
+                return false;
+            }
+            m_buffer.append(data);
+        }
+        return true;
+    }
+
+private:
+    bool parse() {
+        const char* begin = m_buffer.constData() + m_pos;
+        const char* end = m_buffer.constData() + m_buffer.size();
+
+        quint32 termSize = 0;
+        const char* p = getVarint32Ptr(begin, end, &termSize);
+        if (!p || static_cast<quint32>(end - p) < termSize) {
+            return false;
+        }
+        const char* term = p;
+        p += termSize;
+
+        quint64 id = 0;
+        quint32 count = 0;
+        p = getVarint64Ptr(p, end, &id);
+        p = p ? getVarint32Ptr(p, end, &count) : 0;
+        if (!p) {
+            return false;
+        }
+
+        QVector<uint> positions(count);
+        for (quint32 i = 0; i < count; i++) {
+            quint32 pos = 0;
+            p = getVarint32Ptr(p, end, &pos);
+            if (!p) {
+                return false;
+            }
+            positions[i] = pos;
+        }
+
+        m_entry.term = QByteArray(term, termSize);
+        m_entry.id = id;
+        m_entry.positions = positions;
+        m_pos = p - m_buffer.constData();
+        return true;
+    }
+
+    QFile m_file;
+    QByteArray m_buffer;
+    int m_pos;
+    int m_index;
+    bool m_failed;
+    BulkLoader::Entry m_entry;
+};
+
+struct RunGreaterThan {
+    bool operator()(const RunReader* lhs, const RunReader* rhs) const {
+        if (entryLessThan(rhs->entry(), lhs->entry())) {
+            return true;
+        }
+        if (entryLessThan(lhs->entry(), rhs->entry())) {
+            return false;
+        }
+        return lhs->index() > rhs->index();
+    }
+};
+
+/**
+ * Collects the sorted list of one term after another. Once the list holds
+ * two chunks worth of values the first chunk is written out, which splits
+ * the list exactly the way ChunkedList::write() does.
+ */
+template <typename T, typename Codec>
+class ChunkAppender
+{
+public:
+    ChunkAppender(MDB_txn* txn, MDB_dbi dbi, int chunkSize, bool append)
+        : m_txn(txn)
+        , m_dbi(dbi)
+        , m_chunkSize(chunkSize)
+        , m_append(append)
+        , m_chunks(0)
+        , m_mapFull(false)
+    {
+    }
+
+    void setTerm(const QByteArray& term) {
+        finish();
+        m_term = term;
+    }
+
+    void add(const T& value) {
+        m_list << value;
+        if (m_append && m_list.size() >= 2 * m_chunkSize) {
+            put(m_list.mid(0, m_chunkSize));
+            m_list.remove(0, m_chunkSize);
+        }
+    }
+
+    void finish() {
+        if (m_list.isEmpty()) {
+            return;
+        }
+
+        if (m_append) {
+            put(m_list);
+        } else {
+            ChunkedList<T, Codec> chunks(m_txn, m_dbi, m_term, m_chunkSize);
+            chunks.merge(m_list, QVector<quint64>());
+            m_mapFull |= !chunks.write();
+        }
+
+        m_list.clear();
+        m_chunks = 0;
+    }
+
+    /**
+     * Whether the memory map ran full, see isMapFull()
+     */
+    bool mapFull() const {
+        return m_mapFull;
+    }
+
+private:
+    void put(const QVector<T>& list) {
+        const QByteArray key = chunkKey(m_term, m_chunks ? chunkItemId(list.first()) : 0);
+        m_chunks++;
+
+        MDB_val k;
+        k.mv_size = key.size();
+        k.mv_data = static_cast<void*>(const_cast<char*>(key.constData()));
+
+        Codec codec;
+        QByteArray data = codec.encode(list);
+
+        MDB_val val;
+        val.mv_size = data.size();
+        val.mv_data = static_cast<void*>(data.data());
+
+        int rc = mdb_put(m_txn, m_dbi, &k, &val, MDB_APPEND);
+        Q_ASSERT_X(rc == 0 || isMapFull(rc), "BulkLoader::write", mdb_strerror(rc));
+        m_mapFull |= rc != 0;
+    }
+
+    MDB_txn* m_txn;
+    MDB_dbi m_dbi;
+    int m_chunkSize;
+    bool m_append;
+
+    QByteArray m_term;
+    QVector<T> m_list;
+    int m_chunks;
+    bool m_mapFull;
+};
+
+bool isEmpty(MDB_txn* txn, MDB_dbi dbi)
+{
+    MDB_stat stat;
+    int rc = mdb_stat(txn, dbi, &stat);
+    Q_ASSERT_X(rc == 0, "BulkLoader::write", mdb_strerror(rc));
+
+    return stat.ms_entries == 0;
+}
+
+}
+
+BulkLoader::BulkLoader(const QString& runDirectory, qint64 memoryBudget)
+    : m_runDirectory(runDirectory)
+    , m_memoryBudget(memoryBudget)
+    , m_memoryUsed(0)
+    , m_runSize(0)
+    , m_checkpointRuns(0)
+    , m_checkpointRunSize(0)
+    , m_failed(false)
+{
+}
+
+BulkLoader::~BulkLoader()
+{
+    for (const QString& run : m_runs) {
+        QFile::remove(run);
+    }
+}
+
+bool BulkLoader::add(const QByteArray& term, quint64 id, const QVector<uint>& positions)
+{
+    if (m_failed) {
+        return false;
+    }
+
+    Entry entry;
+    entry.term = term;
+    entry.id = id;
+    entry.positions = positions;
+
+    m_memoryUsed += entrySize(entry);
+    m_entries << entry;
+
+    if (m_memoryUsed >= m_memoryBudget) {
+        return flush();
+    }
+    return true;
+}
+
+bool BulkLoader::flush()
+{
+    if (m_failed) {
+        return false;
+    }
+    if (m_entries.isEmpty()) {
+        return true;
+    }
+
+    // A stable sort keeps the entries of the same document in the order they were added
+    std::stable_sort(m_entries.begin(), m_entries.end(), entryLessThan);
+
+    const QString path = m_runDirectory + QStringLiteral("/run") + QString::number(m_runs.size());
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Could not write the sorted run" << path << file.errorString();
+        fail();
+        return false;
+    }
+    m_runs << path;
+
+    QByteArray buffer;
+    buffer.reserve(s_ioBufferSize + 1024);
+    bool written = true;
+    for (const Entry& entry : m_entries) {
+        putVarint32(&buffer, entry.term.size());
+        buffer.append(entry.term);
+        putVarint64(&buffer, entry.id);
+        putVarint32(&buffer, entry.positions.size());
+        for (uint pos : entry.positions) {
+            putVarint32(&buffer, pos);
+        }
+
+        if (buffer.size() >= s_ioBufferSize) {
+            written = file.write(buffer) == buffer.size();
+            if (!written) {
+                break;
+            }
+            buffer.clear();
+        }
+    }
+    if (!written || file.write(buffer) != buffer.size() || !file.flush()) {
+        qWarning() << "Could not write the sorted run" << path << file.errorString();
+        fail();
+        return false;
+    }
+    m_runSize += file.pos();
+    file.close();
+
+    m_entries.clear();
+    m_entries.squeeze();
+    m_memoryUsed = 0;
+    return true;
+}
+
+/*
+ * The entries in memory are written out, so that the runs after the
+ * checkpoint only hold what is added later
+ */
+bool BulkLoader::checkpoint()
+{
+    if (!flush()) {
+        return false;
+    }
+    m_checkpointRuns = m_runs.size();
+    m_checkpointRunSize = m_runSize;
+    return true;
+}
+
+void BulkLoader::rollback()
+{
+    m_entries.clear();
+    m_entries.squeeze();
+    m_memoryUsed = 0;
+
+    while (m_runs.size() > m_checkpointRuns) {
+        QFile::remove(m_runs.takeLast());
+    }
+    m_runSize = m_checkpointRunSize;
+}
+
+/*
+ * Once an entry is lost the index would silently miss terms, so nothing
+ * more is kept and the caller has to start over
+ */
+void BulkLoader::fail()
+{
+    m_failed = true;
+
+    m_entries.clear();
+    m_entries.squeeze();
+    m_memoryUsed = 0;
+
+    for (const QString& run : m_runs) {
+        QFile::remove(run);
+    }
+    m_runs.clear();
+    m_runSize = 0;
+    m_checkpointRuns = 0;
+    m_checkpointRunSize = 0;
+}
+
+bool BulkLoader::write(MDB_txn* txn, MDB_dbi postingDbi, MDB_dbi positionDbi)
+{
+    if (!flush()) {
+        return false;
+    }
+
+    std::priority_queue<RunReader*, std::vector<RunReader*>, RunGreaterThan> queue;
+    QVector<RunReader*> readers;
+    for (int i = 0; i < m_runs.size(); i++) {
+        RunReader* reader = new RunReader(m_runs[i], i);
+        readers << reader;
+        if (reader->next()) {
+            queue.push(reader);
+        }
+    }
+
+    ChunkAppender<quint64, PostingCodec> postings(txn, postingDbi, PostingChunkSize, isEmpty(txn, postingDbi));
+    ChunkAppender<PositionInfo, PositionCodec> positions(txn, positionDbi, PositionChunkSize, isEmpty(txn, positionDbi));
+
+    QByteArray term;
+    quint64 lastId = 0;
+    bool hasPositions = false;
+    while (!queue.empty()) {
+        RunReader* reader = queue.top();
+        queue.pop();
+
+        const Entry& entry = reader->entry();
+        if (entry.term != term) {
+            term = entry.term;
+            postings.setTerm(term);
+            positions.setTerm(term);
+            lastId = 0;
+        }
+
+        // The same term can be added more than once for a document, in which
+        // case the first positions are kept
+        if (entry.id != lastId) {
+            lastId = entry.id;
+            hasPositions = false;
+            postings.add(entry.id);
+        }
+        if (!hasPositions && !entry.positions.isEmpty()) {
+            hasPositions = true;
+            positions.add(PositionInfo(entry.id, entry.positions));
+        }
+
+        if (reader->next()) {
+            queue.push(reader);
+        }
+        if (postings.mapFull() || positions.mapFull()) {
+            break;
+        }
+    }
+    postings.finish();
+    positions.finish();
+
+    bool failed = false;
+    for (const RunReader* reader : readers) {
+        failed |= reader->hasFailed();
+    }
+    qDeleteAll(readers);
+
+    if (failed) {
+        fail();
+        return false;
+    }
+
+    // The runs are kept, so they can be written again once the database grew
+    if (postings.mapFull() || positions.mapFull()) {
+        return false;
+    }
+
+    for (const QString& run : m_runs) {
+        QFile::remove(run);
+    }
+    m_runs.clear();
+    m_runSize = 0;
+    m_checkpointRuns = 0;
+    m_checkpointRunSize = 0;
+    return true;
+}
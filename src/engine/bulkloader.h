@@ -0,0 +1,131 @@
+/*
+   This file is part of the KDE Baloo project.
+ * Copyright (C) 2016  Vishesh Handa <vhanda@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef BALOO_BULKLOADER_H
+#define BALOO_BULKLOADER_H
+
+#include "engine_export.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <lmdb.h>
+
+namespace Baloo {
+
+/**
+ * Builds the PostingDB and PositionDB of an empty database in one go.
+ *
+ * The (term, document, positions) entries are buffered in memory, and
+ * written as a sorted run to disk whenever the buffer grows past the
+ * memory budget. write() then merges all the runs and appends the lists
+ * in key order, so LMDB only ever fills new pages at the end of the tree.
+ */
+class BALOO_ENGINE_EXPORT BulkLoader
+{
+public:
+    /**
+     * The sorted runs are stored as files in \p runDirectory, which needs
+     * to exist for as long as the loader is used.
+     */
+    BulkLoader(const QString& runDirectory, qint64 memoryBudget);
+    ~BulkLoader();
+
+    /**
+     * Returns false if a sorted run could not be written. The entries
+     * are dropped from then on, and hasFailed() returns true.
+     */
+    bool add(const QByteArray& term, quint64 id, const QVector<uint>& positions);
+
+    /**
+     * Merges everything which has been added and writes it to the
+     * \p postingDbi and \p positionDbi. The lists are appended if the
+     * databases are empty, and merged into the existing ones otherwise.
+     *
+     * Returns false if some of the entries were lost, in which case the
+     * transaction should be aborted and hasFailed() returns true.
+     *
+     * It also returns false if the memory map ran full. The runs are then
+     * kept, and write() can be called again in a new transaction once
+     * Transaction::commit() grew the database.
+     */
+    bool write(MDB_txn* txn, MDB_dbi postingDbi, MDB_dbi positionDbi);
+
+    /**
+     * Marks everything which has been added so far, so that rollback()
+     * only drops what is added after it. Returns false if the entries
+     * could not be written.
+     */
+    bool checkpoint();
+
+    /**
+     * Drops everything which has been added since the last checkpoint()
+     */
+    void rollback();
+
+    /**
+     * Whether a sorted run could not be written or read back
+     */
+    bool hasFailed() const { return m_failed; }
+
+    /**
+     * The number of runs which have been written to disk so far
+     */
+    int runCount() const { return m_runs.size(); }
+
+    /**
+     * The number of bytes taken by everything which has been added. The
+     * lists written by write() are usually a lot smaller.
+     */
+    qint64 size() const { return m_runSize + m_memoryUsed; }
+
+    struct Entry {
+        QByteArray term;
+        quint64 id;
+        QVector<uint> positions;
+    };
+
+private:
+    BulkLoader(const BulkLoader&) = delete;
+    BulkLoader& operator=(const BulkLoader&) = delete;
+
+    bool flush();
+    void fail();
+
+    QString m_runDirectory;
+    qint64 m_memoryBudget;
+
+    QVector<Entry> m_entries;
+    qint64 m_memoryUsed;
+
+    QStringList m_runs;
+    qint64 m_runSize;
+
+    int m_checkpointRuns;
+    qint64 m_checkpointRunSize;
+
+    bool m_failed;
+};
+
+}
+
+#endif // BALOO_BULKLOADER_H
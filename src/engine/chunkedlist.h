@@ -0,0 +1,486 @@
+/*
+   This file is part of the KDE Baloo project.
+ * Copyright (C) 2016  Vishesh Handa <vhanda@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef BALOO_CHUNKEDLIST_H
+#define BALOO_CHUNKEDLIST_H
+
+#include "positioninfo.h"
+#include "mapfull.h"
+
+#include <QByteArray>
+#include <QPair>
+#include <QVector>
+#include <QtEndian>
+
+#include <algorithm>
+#include <lmdb.h>
+
+namespace Baloo {
+
+class PostingCodec;
+class PositionCodec;
+
+/*
+ * The lists of the PostingDB and PositionDB are split into chunks, so that
+ * adding or removing a document only rewrites the chunk it falls into.
+ *
+ * The first chunk of a term is stored under the term itself. Every further
+ * chunk is stored under the term, a 0 byte and the big endian id from which
+ * on documents belong to that chunk. WriteTransaction does not store terms
+ * with a 0 byte, see isValidTerm(), so the chunks of a term directly follow
+ * it in the database and cannot be mistaken for another term.
+ */
+
+/**
+ * Returns false if \p term contains a 0 byte, which would make its key
+ * ambiguous with the chunk keys of a shorter term
+ */
+inline bool isValidTerm(const QByteArray& term)
+{
+    return !term.contains('\0');
+}
+
+inline QByteArray chunkKey(const QByteArray& term, quint64 lowerBound)
+{
+    if (!lowerBound) {
+        return term;
+    }
+
+    QByteArray key(term.size() + 1 + sizeof(quint64), 0);
+    memcpy(key.data(), term.constData(), term.size());
+    qToBigEndian(lowerBound, reinterpret_cast<uchar*>(key.data() + term.size() + 1));
+    return key;
+}
+
+/**
+ * Returns the length of the term part of \p key
+ */
+inline int chunkTermLength(const MDB_val& key)
+{
+    const char* data = static_cast<const char*>(key.mv_data);
+    const char* end = static_cast<const char*>(memchr(data, 0, key.mv_size));
+    return end ? end - data : static_cast<int>(key.mv_size);
+}
+
+/**
+ * Returns the first id which can be stored in the chunk with key \p key
+ */
+inline quint64 chunkLowerBound(const MDB_val& key)
+{
+    const int termLength = chunkTermLength(key);
+    if (key.mv_size != termLength + 1 + sizeof(quint64)) {
+        return 0;
+    }
+    return qFromBigEndian<quint64>(static_cast<const uchar*>(key.mv_data) + termLength + 1);
+}
+
+inline quint64 chunkItemId(quint64 id)
+{
+    return id;
+}
+
+inline quint64 chunkItemId(const PositionInfo& info)
+{
+    return info.docId;
+}
+
+/**
+ * Gives access to all the chunks of one term. Chunks are only decoded once
+ * they are needed, and write() only touches the chunks which were modified.
+ *
+ * The values read from LMDB are only valid until the next write, so all the
+ * modifications need to be done before calling write().
+ */
+template <typename T, typename Codec>
+class ChunkedList
+{
+public:
+    ChunkedList(MDB_txn* txn, MDB_dbi dbi, const QByteArray& term, int chunkSize)
+        : m_cursor(0)
+        , m_ownsCursor(true)
+        , m_term(term)
+        , m_chunkSize(chunkSize)
+    {
+        int rc = mdb_cursor_open(txn, dbi, &m_cursor);
+        if (isMapFull(rc)) {
+            m_cursor = 0;
+            return;
+        }
+        Q_ASSERT_X(rc == 0, "ChunkedList", mdb_strerror(rc));
+
+        fetchChunks();
+    }
+
+    /**
+     * Reads and writes the chunks through \p cursor, which stays owned by
+     * the caller. Handling the terms in sorted order with the same cursor
+     * keeps the accesses local to the pages the cursor is on.
+     */
+    ChunkedList(MDB_cursor* cursor, const QByteArray& term, int chunkSize)
+        : m_cursor(cursor)
+        , m_ownsCursor(false)
+        , m_term(term)
+        , m_chunkSize(chunkSize)
+    {
+        fetchChunks();
+    }
+
+    ~ChunkedList() {
+        if (m_ownsCursor && m_cursor) {
+            mdb_cursor_close(m_cursor);
+        }
+    }
+
+    struct Chunk {
+        quint64 lowerBound;
+        QByteArray key;
+        MDB_val value;
+        QVector<T> list;
+        bool loaded = false;
+        bool dirty = false;
+    };
+
+    /**
+     * Returns true if none of the chunks hold a value, including the
+     * modifications which have not been written yet
+     */
+    bool isEmpty() const {
+        for (const Chunk& chunk : m_chunks) {
+            if (!chunk.loaded || !chunk.list.isEmpty()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const QVector<Chunk>& chunks() const {
+        return m_chunks;
+    }
+
+    QVector<T> toList() {
+        QVector<T> list;
+        for (int i = 0; i < m_chunks.size(); i++) {
+            list << load(i);
+        }
+        return list;
+    }
+
+    /**
+     * Inserts \p value into the chunk it belongs to, unless a value with the
+     * same id is already present
+     */
+    void insert(const T& value) {
+        QVector<T>& list = modify(findChunk(chunkItemId(value)));
+        auto it = std::lower_bound(list.begin(), list.end(), value);
+        if (it == list.end() || chunkItemId(*it) != chunkItemId(value)) {
+            list.insert(it, value);
+        }
+    }
+
+    void remove(quint64 id) {
+        if (m_chunks.isEmpty()) {
+            return;
+        }
+
+        QVector<T>& list = modify(findChunk(id));
+        auto it = std::lower_bound(list.begin(), list.end(), T(id));
+        if (it != list.end() && chunkItemId(*it) == id) {
+            list.erase(it);
+        }
+    }
+
+    /**
+     * Merges the sorted \p added values and \p removed ids into the chunks
+     * they belong to, with a single pass over each chunk which is touched.
+     * Added values replace existing ones with the same id. An id may not
+     * be both added and removed.
+     */
+    void merge(const QVector<T>& added, const QVector<quint64>& removed) {
+        if (m_chunks.isEmpty()) {
+            if (added.isEmpty()) {
+                return;
+            }
+            m_chunks << newChunk(0);
+        }
+
+        int a = 0;
+        int r = 0;
+        for (int i = 0; i < m_chunks.size(); i++) {
+            const bool last = i + 1 == m_chunks.size();
+            const quint64 bound = last ? 0 : m_chunks[i + 1].lowerBound;
+
+            int addedEnd = a;
+            while (addedEnd < added.size() && (last || chunkItemId(added[addedEnd]) < bound)) {
+                addedEnd++;
+            }
+            int removedEnd = r;
+            while (removedEnd < removed.size() && (last || removed[removedEnd] < bound)) {
+                removedEnd++;
+            }
+            if (a == addedEnd && r == removedEnd) {
+                continue;
+            }
+
+            QVector<T>& list = modify(i);
+            QVector<T> merged;
+            merged.reserve(list.size() + addedEnd - a);
+
+            int j = 0;
+            while (j < list.size() || a < addedEnd) {
+                if (a < addedEnd && (j == list.size() || chunkItemId(added[a]) <= chunkItemId(list[j]))) {
+                    if (j < list.size() && chunkItemId(list[j]) == chunkItemId(added[a])) {
+                        j++;
+                    }
+                    merged << added[a++];
+                    continue;
+                }
+
+                const quint64 id = chunkItemId(list[j]);
+                while (r < removedEnd && removed[r] < id) {
+                    r++;
+                }
+                if (r == removedEnd || removed[r] != id) {
+                    merged << list[j];
+                }
+                j++;
+            }
+
+            list = merged;
+            r = removedEnd;
+        }
+    }
+
+    /**
+     * Replaces all the chunks with \p list
+     */
+    void replace(const QVector<T>& list) {
+        for (int i = 0; i < m_chunks.size(); i++) {
+            m_chunks[i].list.clear();
+            m_chunks[i].loaded = true;
+            m_chunks[i].dirty = true;
+        }
+        if (m_chunks.isEmpty()) {
+            m_chunks << newChunk(0);
+        }
+        m_chunks[0].list = list;
+        m_chunks[0].dirty = true;
+    }
+
+    /**
+     * Encodes all the modified chunks, which are then written back by
+     * store(). Chunks which grew past twice the chunk size are split, and
+     * empty chunks are removed.
+     *
+     * Nothing is written to the database, so the chunks of different terms
+     * can be encoded in parallel as long as nobody writes in the meantime.
+     */
+    void encode() {
+        // The first remaining chunk always needs to be stored under the term
+        int first = 0;
+        while (first < m_chunks.size() && m_chunks[first].dirty && m_chunks[first].list.isEmpty()) {
+            first++;
+        }
+        if (first > 0 && first < m_chunks.size()) {
+            modify(first);
+        }
+
+        for (int i = 0; i < m_chunks.size(); i++) {
+            const Chunk& chunk = m_chunks[i];
+            if (!chunk.dirty || !chunk.value.mv_data) {
+                continue;
+            }
+            if (chunk.list.isEmpty() || (i == first && i > 0)) {
+                m_removedKeys << chunk.key;
+            }
+        }
+
+        Codec codec;
+        for (int i = first; i < m_chunks.size(); i++) {
+            const Chunk& chunk = m_chunks[i];
+            if (!chunk.dirty || chunk.list.isEmpty()) {
+                continue;
+            }
+
+            const QVector<T>& list = chunk.list;
+            const quint64 lowerBound = i == first ? 0 : chunk.lowerBound;
+            if (list.size() <= 2 * m_chunkSize) {
+                m_encodedChunks << qMakePair(chunkKey(m_term, lowerBound), codec.encode(list));
+                continue;
+            }
+
+            int start = 0;
+            while (start < list.size()) {
+                const int remaining = list.size() - start;
+                const int count = remaining < 2 * m_chunkSize ? remaining : m_chunkSize;
+
+                const quint64 bound = start ? chunkItemId(list[start]) : lowerBound;
+                m_encodedChunks << qMakePair(chunkKey(m_term, bound), codec.encode(list.mid(start, count)));
+                start += count;
+            }
+        }
+
+        m_chunks.clear();
+    }
+
+    /**
+     * Writes the chunks encoded by encode() to the database. Returns false
+     * if the memory map was full, see isMapFull().
+     */
+    bool store() {
+        bool stored = m_cursor;
+        for (const QByteArray& key : m_removedKeys) {
+            stored = stored && del(key);
+        }
+        for (const auto& chunk : m_encodedChunks) {
+            stored = stored && put(chunk.first, chunk.second);
+        }
+
+        m_removedKeys.clear();
+        m_encodedChunks.clear();
+        return stored;
+    }
+
+    /**
+     * Writes back all the modified chunks. Returns false if the memory map
+     * was full, see isMapFull().
+     */
+    bool write() {
+        encode();
+        return store();
+    }
+
+private:
+    Q_DISABLE_COPY(ChunkedList)
+
+    void fetchChunks() {
+        MDB_val key;
+        key.mv_size = m_term.size();
+        key.mv_data = static_cast<void*>(const_cast<char*>(m_term.constData()));
+
+        MDB_val val;
+        int rc = mdb_cursor_get(m_cursor, &key, &val, MDB_SET_RANGE);
+        while (rc == 0) {
+            if (chunkTermLength(key) != m_term.size() || memcmp(key.mv_data, m_term.constData(), m_term.size()) != 0) {
+                break;
+            }
+
+            Chunk chunk;
+            chunk.lowerBound = chunkLowerBound(key);
+            chunk.key = QByteArray(static_cast<char*>(key.mv_data), key.mv_size);
+            chunk.value = val;
+            m_chunks << chunk;
+
+            rc = mdb_cursor_get(m_cursor, &key, &val, MDB_NEXT);
+        }
+        if (rc != MDB_NOTFOUND) {
+            Q_ASSERT_X(rc == 0 || isMapFull(rc), "ChunkedList", mdb_strerror(rc));
+        }
+    }
+
+    Chunk newChunk(quint64 lowerBound) {
+        Chunk chunk;
+        chunk.lowerBound = lowerBound;
+        chunk.key = chunkKey(m_term, lowerBound);
+        chunk.value.mv_size = 0;
+        chunk.value.mv_data = 0;
+        chunk.loaded = true;
+        return chunk;
+    }
+
+    int findChunk(quint64 id) {
+        if (m_chunks.isEmpty()) {
+            m_chunks << newChunk(0);
+            return 0;
+        }
+
+        int i = m_chunks.size() - 1;
+        while (i > 0 && m_chunks[i].lowerBound > id) {
+            i--;
+        }
+        return i;
+    }
+
+    QVector<T>& load(int i) {
+        Chunk& chunk = m_chunks[i];
+        if (!chunk.loaded) {
+            Codec codec;
+            chunk.list = codec.decode(QByteArray::fromRawData(static_cast<char*>(chunk.value.mv_data), chunk.value.mv_size));
+            chunk.loaded = true;
+        }
+        return chunk.list;
+    }
+
+    QVector<T>& modify(int i) {
+        m_chunks[i].dirty = true;
+        return load(i);
+    }
+
+    bool put(const QByteArray& key, const QByteArray& data) {
+        MDB_val k;
+        k.mv_size = key.size();
+        k.mv_data = static_cast<void*>(const_cast<char*>(key.constData()));
+
+        MDB_val val;
+        val.mv_size = data.size();
+        val.mv_data = static_cast<void*>(const_cast<char*>(data.constData()));
+
+        int rc = mdb_cursor_put(m_cursor, &k, &val, 0);
+        Q_ASSERT_X(rc == 0 || isMapFull(rc), "ChunkedList::put", mdb_strerror(rc));
+        return rc == 0;
+    }
+
+    bool del(const QByteArray& key) {
+        MDB_val k;
+        k.mv_size = key.size();
+        k.mv_data = static_cast<void*>(const_cast<char*>(key.constData()));
+
+        int rc = mdb_cursor_get(m_cursor, &k, 0, MDB_SET);
+        if (rc == MDB_NOTFOUND) {
+            return true;
+        }
+        Q_ASSERT_X(rc == 0 || isMapFull(rc), "ChunkedList::del", mdb_strerror(rc));
+
+        if (rc == 0) {
+            rc = mdb_cursor_del(m_cursor, 0);
+            Q_ASSERT_X(rc == 0 || isMapFull(rc), "ChunkedList::del", mdb_strerror(rc));
+        }
+        return rc == 0;
+    }
+
+    MDB_cursor* m_cursor;
+    bool m_ownsCursor;
+    QByteArray m_term;
+    int m_chunkSize;
+    QVector<Chunk> m_chunks;
+
+    QVector<QByteArray> m_removedKeys;
+    QVector<QPair<QByteArray, QByteArray> > m_encodedChunks;
+};
+
+// Number of documents after which a list is split into another chunk
+static const int PostingChunkSize = 1024;
+static const int PositionChunkSize = 128;
+
+typedef ChunkedList<quint64, PostingCodec> PostingChunks;
+typedef ChunkedList<PositionInfo, PositionCodec> PositionChunks;
+
+}
+
+#endif // BALOO_CHUNKEDLIST_H
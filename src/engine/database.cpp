@@ -28,6 +28,10 @@
 #include "documenttimedb.h"
 #include "documentdatadb.h"
 #include "mtimedb.h"
+#include "filenametrigramdb.h"
+#include "filenameiddb.h"
+#include "databasesize.h"
+#include "metadatadb.h"
 
 #include "document.h"
 #include "enginequery.h"
@@ -43,17 +47,70 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QDir>
+#include <QRunnable>
 
 using namespace Baloo;
 
+// The memory map is resized in multiples of this
+static const quint64 s_mapSizeStep = Q_UINT64_C(64) * 1024 * 1024;
+
+// The memory map grows once less than this is left for writing
+static const quint64 s_minFreeSize = Q_UINT64_C(128) * 1024 * 1024;
+
+// The address space reserved for the memory map is limited to this
+static const quint64 s_maxMapSize = sizeof(size_t) == 4 ? Q_UINT64_C(1) << 30 : Q_UINT64_C(1) << 40;
+
+/*
+ * The amount of space left for writing after the memory map grows. It
+ * increases with the database, so that large databases rarely need to
+ * grow, while small ones do not reserve much address space.
+ */
+static quint64 headroom(quint64 usedSize)
+{
+    return qMax(Q_UINT64_C(512) * 1024 * 1024, usedSize / 2);
+}
+
+// Roughly how much larger than the IdFilenameDB the indexes built from it
+// get, which buildFileNameIndexes() makes room for
+static const int s_fileNameIdSizeFactor = 2;
+static const int s_fileNameTrigramSizeFactor = 4;
+
+static quint64 mapSizeFor(quint64 size)
+{
+    size = (size + s_mapSizeStep - 1) / s_mapSizeStep * s_mapSizeStep;
+    return qMin(size, s_maxMapSize);
+}
+
+namespace Baloo {
+
+class TermDictionaryBuilder : public QRunnable
+{
+public:
+    explicit TermDictionaryBuilder(const Database* db)
+        : m_db(db)
+    {
+    }
+
+    void run() Q_DECL_OVERRIDE {
+        m_db->buildTermDictionary();
+    }
+
+private:
+    const Database* m_db;
+};
+
+}
+
 Database::Database(const QString& path)
     : m_path(path)
     , m_env(0)
 {
+    m_termDictionaryBuilder.setMaxThreadCount(1);
 }
 
 Database::~Database()
 {
+    m_termDictionaryBuilder.waitForDone();
     mdb_env_close(m_env);
 }
 
@@ -93,12 +150,17 @@ bool Database::open(OpenMode mode)
         return false;
     }
 
-    mdb_env_set_maxdbs(m_env, 12);
-    mdb_env_set_mapsize(m_env, static_cast<size_t>(1024) * 1024 * 1024 * 5); // 5 gb
+    mdb_env_set_maxdbs(m_env, 15);
 
-    // The directory needs to be created before opening the environment
+    // The map grows along with the database, see growMapSize()
+    const quint64 fileSize = indexInfo.exists() ? indexInfo.size() : 0;
+    mdb_env_set_mapsize(m_env, mapSizeFor(fileSize + headroom(fileSize)));
+
+    // The directory needs to be created before opening the environment.
+    // Read transactions are not bound to their thread, as a suspended one
+    // stays open while its thread starts others.
     QByteArray arr = QFile::encodeName(indexInfo.absoluteFilePath());
-    rc = mdb_env_open(m_env, arr.constData(), MDB_NOSUBDIR | MDB_NOMEMINIT, 0664);
+    rc = mdb_env_open(m_env, arr.constData(), MDB_NOSUBDIR | MDB_NOMEMINIT | MDB_NOTLS, 0664);
     if (rc) {
         m_env = 0;
         return false;
@@ -134,6 +196,7 @@ bool Database::open(OpenMode mode)
 
         m_dbis.idTreeDbi = IdTreeDB::open(txn);
         m_dbis.idFilenameDbi = IdFilenameDB::open(txn);
+        m_dbis.fileNameIdDbi = FilenameIdDB::open(txn);
 
         m_dbis.docTimeDbi = DocumentTimeDB::open(txn);
         m_dbis.docDataDbi = DocumentDataDB::open(txn);
@@ -142,6 +205,8 @@ bool Database::open(OpenMode mode)
         m_dbis.failedIdDbi = DocumentIdDB::open("failediddb", txn);
 
         m_dbis.mtimeDbi = MTimeDB::open(txn);
+        m_dbis.fileNameTrigramDbi = FilenameTrigramDB::open(txn);
+        m_dbis.metadataDbi = MetadataDB::open(txn);
 
         Q_ASSERT(m_dbis.isValid());
         if (!m_dbis.isValid()) {
@@ -185,6 +250,25 @@ bool Database::open(OpenMode mode)
         m_dbis.failedIdDbi = DocumentIdDB::create("failediddb", txn);
 
         m_dbis.mtimeDbi = MTimeDB::create(txn);
+        m_dbis.metadataDbi = MetadataDB::create(txn);
+
+        // Databases created before these existed get them from
+        // buildFileNameIndexes(), as building them can take long and needs
+        // room in the memory map. Only empty ones get them right away.
+        m_dbis.fileNameIdDbi = FilenameIdDB::open(txn);
+        m_dbis.fileNameTrigramDbi = FilenameTrigramDB::open(txn);
+
+        MDB_stat stat;
+        rc = mdb_stat(txn, m_dbis.idFilenameDbi, &stat);
+        Q_ASSERT_X(rc == 0, "Database::open stat", mdb_strerror(rc));
+        if (rc == 0 && stat.ms_entries == 0) {
+            if (!m_dbis.fileNameIdDbi) {
+                m_dbis.fileNameIdDbi = FilenameIdDB::create(txn);
+            }
+            if (!m_dbis.fileNameTrigramDbi) {
+                m_dbis.fileNameTrigramDbi = FilenameTrigramDB::create(txn);
+            }
+        }
 
         Q_ASSERT(m_dbis.isValid());
         if (!m_dbis.isValid()) {
@@ -203,6 +287,7 @@ bool Database::open(OpenMode mode)
         }
     }
 
+    m_urlCache.setMetadataDbi(m_dbis.metadataDbi);
     return true;
 }
 
@@ -210,3 +295,136 @@ QString Database::path() const
 {
     return m_path;
 }
+
+void Database::reserve(quint64 bytes)
+{
+    Q_ASSERT(m_env);
+    growMapSize(bytes, true);
+}
+
+bool Database::buildFileNameIndexes()
+{
+    Q_ASSERT(m_env);
+
+    quint64 idFilenameSize;
+    {
+        Transaction tr(*this, Transaction::ReadOnly);
+        idFilenameSize = tr.dbSize().idFilename;
+    }
+
+    if (!m_dbis.fileNameIdDbi) {
+        reserve(s_fileNameIdSizeFactor * idFilenameSize);
+
+        Transaction tr(*this, Transaction::ReadWrite);
+        const MDB_dbi dbi = FilenameIdDB::create(tr.m_txn);
+        FilenameIdDB(dbi, tr.m_txn).build(m_dbis.idFilenameDbi);
+        if (!tr.commit()) {
+            return false;
+        }
+        m_dbis.fileNameIdDbi = dbi;
+    }
+
+    if (!m_dbis.fileNameTrigramDbi) {
+        reserve(s_fileNameTrigramSizeFactor * idFilenameSize);
+
+        Transaction tr(*this, Transaction::ReadWrite);
+        const MDB_dbi dbi = FilenameTrigramDB::create(tr.m_txn);
+        FilenameTrigramDB(dbi, tr.m_txn).build(m_dbis.idFilenameDbi, m_dbis.docTimeDbi);
+        if (!tr.commit()) {
+            return false;
+        }
+        m_dbis.fileNameTrigramDbi = dbi;
+    }
+
+    return true;
+}
+
+/*
+ * Grows the memory map if less than \p bytes and some spare room are left
+ * for writing. If \p wait is false nothing is done while transactions are
+ * open in this process.
+ */
+bool Database::growMapSize(quint64 bytes, bool wait) const
+{
+    if (wait) {
+        Q_ASSERT_X(!m_threadTransactions.localData(), "Database::growMapSize",
+                   "Waiting for the transactions of this thread would never end");
+        m_mapLock.lockForWrite();
+    } else if (!m_mapLock.tryLockForWrite()) {
+        return false;
+    }
+
+    MDB_envinfo info;
+    mdb_env_info(m_env, &info);
+
+    MDB_stat stat;
+    mdb_env_stat(m_env, &stat);
+
+    const quint64 usedSize = static_cast<quint64>(info.me_last_pgno + 1) * stat.ms_psize;
+    if (usedSize + bytes + s_minFreeSize <= info.me_mapsize) {
+        m_mapLock.unlock();
+        return true;
+    }
+
+    const quint64 size = mapSizeFor(usedSize + bytes + headroom(usedSize));
+    if (size <= info.me_mapsize) {
+        qWarning() << "The database cannot grow past" << info.me_mapsize << "bytes";
+        m_mapLock.unlock();
+        return false;
+    }
+
+    endSuspendedTransactions();
+    int rc = mdb_env_set_mapsize(m_env, size);
+    Q_ASSERT_X(rc == 0, "Database::growMapSize", mdb_strerror(rc));
+
+    m_mapLock.unlock();
+    return rc == 0;
+}
+
+/*
+ * Takes over the size of the memory map after another process grew it
+ */
+void Database::adoptMapSize() const
+{
+    Q_ASSERT_X(!m_threadTransactions.localData(), "Database::adoptMapSize",
+               "Waiting for the transactions of this thread would never end");
+    QWriteLocker locker(&m_mapLock);
+
+    endSuspendedTransactions();
+    int rc = mdb_env_set_mapsize(m_env, 0);
+    Q_ASSERT_X(rc == 0, "Database::adoptMapSize", mdb_strerror(rc));
+}
+
+/*
+ * Ends the suspended read transactions, as they must not be open while the
+ * memory map changes. They begin a new one once they are resumed. Needs
+ * m_mapLock to be held for writing.
+ */
+void Database::endSuspendedTransactions() const
+{
+    QMutexLocker locker(&m_suspendedLock);
+    for (Transaction* tr : m_suspendedTransactions) {
+        if (tr->m_txn) {
+            mdb_txn_abort(tr->m_txn);
+            tr->m_txn = 0;
+        }
+    }
+}
+
+void Database::startTermDictionaryBuild() const
+{
+    m_termDictionaryBuilder.start(new TermDictionaryBuilder(this));
+}
+
+/*
+ * Builds the TermDictionary from a read transaction of its own, and hands
+ * it over to m_termDictionary. Runs in m_termDictionaryBuilder.
+ */
+void Database::buildTermDictionary() const
+{
+    Transaction tr(*this, Transaction::ReadOnly);
+
+    PostingDB postingDb(m_dbis.postingDbi, tr.m_txn);
+    QSharedPointer<const TermDictionary> dictionary(new TermDictionary(postingDb.termDictionary()));
+    m_termDictionary.finishBuild(mdb_txn_id(tr.m_txn), dictionary);
+}
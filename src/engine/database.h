@@ -23,10 +23,21 @@
 
 #include "document.h"
 #include "databasedbis.h"
+#include "termdictionary.h"
+#include "documenturldb.h"
+#include "queryresultcache.h"
+
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QSet>
+#include <QThreadPool>
+#include <QThreadStorage>
 
 namespace Baloo {
 
 class DatabaseTest;
+class Transaction;
+class TermDictionaryBuilder;
 
 class BALOO_ENGINE_EXPORT Database
 {
@@ -44,13 +55,81 @@ public:
 
     bool isOpen() const { return m_env != 0; }
 
+    /**
+     * Grows the memory map of the database, when needed, so that at least
+     * \p bytes can be written on top of what is already stored. This waits
+     * for all the transactions of this process to finish, or to be
+     * suspended.
+     *
+     * The calling thread must not have a Transaction open itself, as it
+     * would wait for it forever.
+     */
+    void reserve(quint64 bytes);
+
+    /**
+     * Builds the FilenameIdDB and the FilenameTrigramDB of a database which
+     * was created before they existed, each in a write transaction of its
+     * own after growing the memory map for it. Until then paths are
+     * resolved and file names are matched without them. Returns false if
+     * one of them could not be committed, in which case calling this again
+     * continues with it.
+     *
+     * The database must have been opened with CreateDatabase, and no other
+     * thread may use it yet. The calling thread must not have a Transaction
+     * open.
+     */
+    bool buildFileNameIndexes();
+
 private:
+    bool growMapSize(quint64 bytes, bool wait) const;
+    void adoptMapSize() const;
+    void endSuspendedTransactions() const;
+
+    void startTermDictionaryBuild() const;
+    void buildTermDictionary() const;
+
     QString m_path;
 
     MDB_env* m_env;
     DatabaseDbis m_dbis;
 
+    /**
+     * The memory map can only be changed while no transaction is open in
+     * this process. Every Transaction holds this for reading, unless it has
+     * been suspended.
+     *
+     * The lock is not recursive, and a thread waiting to write blocks new
+     * readers. A thread therefore only ever holds one Transaction at a time,
+     * and must not wait for the lock to write while it holds one. Suspended
+     * transactions do not count.
+     */
+    mutable QReadWriteLock m_mapLock;
+
+    /**
+     * The number of Transactions the calling thread holds, which are counted
+     * to catch the deadlocks described above
+     */
+    mutable QThreadStorage<int> m_threadTransactions;
+
+    /**
+     * The read transactions which gave up m_mapLock while they are not used.
+     * They are ended before the memory map changes, see Transaction::suspend().
+     */
+    mutable QMutex m_suspendedLock;
+    mutable QSet<Transaction*> m_suspendedTransactions;
+
+    mutable TermDictionaryCache m_termDictionary;
+
+    /**
+     * Builds the TermDictionary away from the queries which need it
+     */
+    mutable QThreadPool m_termDictionaryBuilder;
+
+    mutable DocumentUrlCache m_urlCache;
+    mutable QueryResultCache m_resultCache;
+
     friend class Transaction;
+    friend class TermDictionaryBuilder;
     friend class DatabaseTest;
 
 };
@@ -37,6 +37,9 @@ public:
     MDB_dbi idTreeDbi;
     MDB_dbi idFilenameDbi;
 
+    // Optional, paths are resolved through the IdTreeDB without it
+    MDB_dbi fileNameIdDbi;
+
     MDB_dbi docTimeDbi;
     MDB_dbi docDataDbi;
     MDB_dbi contentIndexingDbi;
@@ -44,6 +47,12 @@ public:
     MDB_dbi mtimeDbi;
     MDB_dbi failedIdDbi;
 
+    // Optional, the substring search on file names is not possible without it
+    MDB_dbi fileNameTrigramDbi;
+
+    // Optional, the url caches are dropped on every new transaction without it
+    MDB_dbi metadataDbi;
+
     DatabaseDbis()
         : postingDbi(0)
         , positionDBi(0)
@@ -52,11 +61,14 @@ public:
         , docXattrTermsDbi(0)
         , idTreeDbi(0)
         , idFilenameDbi(0)
+        , fileNameIdDbi(0)
         , docTimeDbi(0)
         , docDataDbi(0)
         , contentIndexingDbi(0)
         , mtimeDbi(0)
         , failedIdDbi(0)
+        , fileNameTrigramDbi(0)
+        , metadataDbi(0)
     {}
 
     bool isValid() {
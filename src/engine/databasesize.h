@@ -38,6 +38,17 @@ public:
      */
     uint actualSize;
 
+    /**
+     * The size of the memory map, which is how large the database can get
+     * before it needs to grow again
+     */
+    size_t mapSize;
+
+    /**
+     * The space which is left in the memory map for writing
+     */
+    size_t headroom;
+
     uint postingDb;
     uint positionDb;
 
@@ -47,6 +58,7 @@ public:
 
     uint idTree;
     uint idFilename;
+    uint fileNameId;
 
     uint docTime;
     uint docData;
@@ -55,6 +67,9 @@ public:
     uint failedIds;
 
     uint mtimeDb;
+
+    // 0 for databases without the FilenameTrigramDB
+    uint fileNameTrigrams;
 };
 
 }
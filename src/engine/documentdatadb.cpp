@@ -18,6 +18,7 @@
  */
 
 #include "documentdatadb.h"
+#include "mapfull.h"
 
 using namespace Baloo;
 
@@ -68,7 +69,7 @@ void DocumentDataDB::put(quint64 docId, const QByteArray& url)
     val.mv_data = static_cast<void*>(const_cast<char*>(url.constData()));
 
     int rc = mdb_put(m_txn, m_dbi, &key, &val, 0);
-    Q_ASSERT_X(rc == 0, "DocumentDataDB::put", mdb_strerror(rc));
+    Q_ASSERT_X(rc == 0 || isMapFull(rc), "DocumentDataDB::put", mdb_strerror(rc));
 }
 
 QByteArray DocumentDataDB::get(quint64 docId)
@@ -81,7 +82,7 @@ QByteArray DocumentDataDB::get(quint64 docId)
 
     MDB_val val;
     int rc = mdb_get(m_txn, m_dbi, &key, &val);
-    if (rc == MDB_NOTFOUND) {
+    if (rc == MDB_NOTFOUND || isMapFull(rc)) {
         return QByteArray();
     }
     Q_ASSERT_X(rc == 0, "DocumentDataDB::get", mdb_strerror(rc));
@@ -101,7 +102,7 @@ void DocumentDataDB::del(quint64 docId)
     if (rc == MDB_NOTFOUND) {
         return;
     }
-    Q_ASSERT_X(rc == 0, "DocumentUrlDB::del", mdb_strerror(rc));
+    Q_ASSERT_X(rc == 0 || isMapFull(rc), "DocumentUrlDB::del", mdb_strerror(rc));
 }
 
 bool DocumentDataDB::contains(quint64 docId)
@@ -114,7 +115,7 @@ bool DocumentDataDB::contains(quint64 docId)
 
     MDB_val val;
     int rc = mdb_get(m_txn, m_dbi, &key, &val);
-    if (rc == MDB_NOTFOUND) {
+    if (rc == MDB_NOTFOUND || isMapFull(rc)) {
         return false;
     }
     Q_ASSERT_X(rc == 0, "DocumentDataDB::contains", mdb_strerror(rc));
@@ -19,6 +19,7 @@
  */
 
 #include "documentdb.h"
+#include "mapfull.h"
 #include "doctermscodec.h"
 
 #include <QDebug>
@@ -75,7 +76,7 @@ void DocumentDB::put(quint64 docId, const QVector<QByteArray>& list)
     val.mv_data = static_cast<void*>(arr.data());
 
     int rc = mdb_put(m_txn, m_dbi, &key, &val, 0);
-    Q_ASSERT_X(rc == 0, "DocumentDB::put", mdb_strerror(rc));
+    Q_ASSERT_X(rc == 0 || isMapFull(rc), "DocumentDB::put", mdb_strerror(rc));
 }
 
 QVector<QByteArray> DocumentDB::get(quint64 docId)
@@ -88,7 +89,7 @@ QVector<QByteArray> DocumentDB::get(quint64 docId)
 
     MDB_val val;
     int rc = mdb_get(m_txn, m_dbi, &key, &val);
-    if (rc == MDB_NOTFOUND) {
+    if (rc == MDB_NOTFOUND || isMapFull(rc)) {
         return QVector<QByteArray>();
     }
     Q_ASSERT_X(rc == 0, "DocumentDB::get", mdb_strerror(rc));
@@ -111,7 +112,7 @@ void DocumentDB::del(quint64 docId)
     if (rc == MDB_NOTFOUND) {
         return;
     }
-    Q_ASSERT_X(rc == 0, "DocumentDB::del", mdb_strerror(rc));
+    Q_ASSERT_X(rc == 0 || isMapFull(rc), "DocumentDB::del", mdb_strerror(rc));
 }
 
 bool DocumentDB::contains(quint64 docId)
@@ -124,7 +125,7 @@ bool DocumentDB::contains(quint64 docId)
 
     MDB_val val;
     int rc = mdb_get(m_txn, m_dbi, &key, &val);
-    if (rc == MDB_NOTFOUND) {
+    if (rc == MDB_NOTFOUND || isMapFull(rc)) {
         return false;
     }
     Q_ASSERT_X(rc == 0, "DocumentDB::contains", mdb_strerror(rc));
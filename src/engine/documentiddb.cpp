@@ -19,6 +19,7 @@
  */
 
 #include "documentiddb.h"
+#include "mapfull.h"
 
 #include <QDebug>
 
@@ -70,7 +71,7 @@ void DocumentIdDB::put(quint64 docId)
     val.mv_data = 0;
 
     int rc = mdb_put(m_txn, m_dbi, &key, &val, 0);
-    Q_ASSERT_X(rc == 0, "DocumentIdDB::put", mdb_strerror(rc));
+    Q_ASSERT_X(rc == 0 || isMapFull(rc), "DocumentIdDB::put", mdb_strerror(rc));
 }
 
 bool DocumentIdDB::contains(quint64 docId)
@@ -83,7 +84,7 @@ bool DocumentIdDB::contains(quint64 docId)
 
     MDB_val val;
     int rc = mdb_get(m_txn, m_dbi, &key, &val);
-    if (rc == MDB_NOTFOUND) {
+    if (rc == MDB_NOTFOUND || isMapFull(rc)) {
         return false;
     }
     Q_ASSERT_X(rc == 0, "DocumentIdDB::contains", mdb_strerror(rc));
@@ -103,7 +104,7 @@ void DocumentIdDB::del(quint64 docId)
     if (rc == MDB_NOTFOUND) {
         return;
     }
-    Q_ASSERT_X(rc == 0, "DocumentIdDB::del", mdb_strerror(rc));
+    Q_ASSERT_X(rc == 0 || isMapFull(rc), "DocumentIdDB::del", mdb_strerror(rc));
 }
 
 QVector<quint64> DocumentIdDB::fetchItems(int size)
@@ -19,6 +19,7 @@
  */
 
 #include "documenttimedb.h"
+#include "mapfull.h"
 
 using namespace Baloo;
 
@@ -70,7 +71,7 @@ void DocumentTimeDB::put(quint64 docId, const TimeInfo& info)
     val.mv_data = static_cast<void*>(const_cast<TimeInfo*>(&info));
 
     int rc = mdb_put(m_txn, m_dbi, &key, &val, 0);
-    Q_ASSERT_X(rc == 0, "DocumentTimeDB::put", mdb_strerror(rc));
+    Q_ASSERT_X(rc == 0 || isMapFull(rc), "DocumentTimeDB::put", mdb_strerror(rc));
 }
 
 DocumentTimeDB::TimeInfo DocumentTimeDB::get(quint64 docId)
@@ -83,7 +84,7 @@ DocumentTimeDB::TimeInfo DocumentTimeDB::get(quint64 docId)
 
     MDB_val val;
     int rc = mdb_get(m_txn, m_dbi, &key, &val);
-    if (rc == MDB_NOTFOUND) {
+    if (rc == MDB_NOTFOUND || isMapFull(rc)) {
         return TimeInfo();
     }
     Q_ASSERT_X(rc == 0, "DocumentTimeDB::get", mdb_strerror(rc));
@@ -103,7 +104,7 @@ void DocumentTimeDB::del(quint64 docId)
     if (rc == MDB_NOTFOUND) {
         return;
     }
-    Q_ASSERT_X(rc == 0, "DocumentTimeDB::del", mdb_strerror(rc));
+    Q_ASSERT_X(rc == 0 || isMapFull(rc), "DocumentTimeDB::del", mdb_strerror(rc));
 }
 
 bool DocumentTimeDB::contains(quint64 docId)
@@ -116,7 +117,7 @@ bool DocumentTimeDB::contains(quint64 docId)
 
     MDB_val val;
     int rc = mdb_get(m_txn, m_dbi, &key, &val);
-    if (rc == MDB_NOTFOUND) {
+    if (rc == MDB_NOTFOUND || isMapFull(rc)) {
         return false;
     }
     Q_ASSERT_X(rc == 0, "DocumentTimeDB::contains", mdb_strerror(rc));
@@ -20,18 +20,197 @@
 
 #include "documenturldb.h"
 #include "idutils.h"
+#include "metadatadb.h"
 #include "postingiterator.h"
 
-#include <algorithm>
 #include <QPair>
 #include <QDebug>
+#include <QHash>
+#include <QVarLengthArray>
 
 using namespace Baloo;
 
+// Roughly the memory the cached folder paths may take up
+static const int s_maxUrlCacheSize = 4 * 1024 * 1024;
+
+// Rough size of a cached path, besides the path itself
+static const int s_urlCacheEntrySize = 48;
+
+namespace {
+
+/*
+ * Lists the documents under a folder through the IdTreeDB, but as a filter
+ * checks a single document by walking up its parents. Whether a folder is
+ * under the folder is remembered, so its other documents stop right there.
+ */
+class SubtreePostingIterator : public PostingIterator
+{
+public:
+    SubtreePostingIterator(quint64 folderId, PostingIterator* tree, MDB_dbi idFilenameDbi, MDB_txn* txn)
+        : m_tree(tree)
+        , m_idFilenameDb(idFilenameDbi, txn)
+    {
+        m_folders.insert(folderId, true);
+        m_folders.insert(0, false);
+    }
+
+    ~SubtreePostingIterator() {
+        delete m_tree;
+    }
+
+    quint64 next() Q_DECL_OVERRIDE {
+        return m_tree->next();
+    }
+
+    quint64 docId() const Q_DECL_OVERRIDE {
+        return m_tree->docId();
+    }
+
+    quint64 skipTo(quint64 docId) Q_DECL_OVERRIDE {
+        return m_tree->skipTo(docId);
+    }
+
+    bool isFilter() const Q_DECL_OVERRIDE {
+        return true;
+    }
+
+    bool contains(quint64 docId) Q_DECL_OVERRIDE {
+        QVarLengthArray<quint64, 16> parents;
+
+        quint64 id = docId;
+        auto it = m_folders.constFind(id);
+        while (it == m_folders.constEnd()) {
+            id = m_idFilenameDb.get(id).parentId;
+            parents.append(id);
+            it = m_folders.constFind(id);
+        }
+
+        // The last one was already known
+        const bool result = it.value();
+        for (int i = 0; i < parents.size() - 1; i++) {
+            m_folders.insert(parents[i], result);
+        }
+        return result;
+    }
+
+private:
+    PostingIterator* m_tree;
+    IdFilenameDB m_idFilenameDb;
+    QHash<quint64, bool> m_folders;
+};
+
+}
+
+DocumentUrlCache::DocumentUrlCache()
+    : m_paths(s_maxUrlCacheSize)
+    , m_txnId(0)
+    , m_generation(0)
+    , m_metadataDbi(0)
+{
+}
+
+void DocumentUrlCache::setMetadataDbi(MDB_dbi dbi)
+{
+    QMutexLocker locker(&m_mutex);
+    m_metadataDbi = dbi;
+    m_paths.clear();
+    m_txnId = 0;
+}
+
+/*
+ * Must be called with the mutex held. Every transaction with the same url
+ * generation may use the paths, and newer ones with another generation
+ * start over. m_txnId is the newest transaction known to have
+ * m_generation, so that it does not need to be read again.
+ */
+bool DocumentUrlCache::isValid(MDB_txn* txn)
+{
+    const size_t txnId = mdb_txn_id(txn);
+    if (txnId == m_txnId) {
+        return true;
+    }
+
+    if (!m_metadataDbi) {
+        if (txnId < m_txnId) {
+            return false;
+        }
+        m_paths.clear();
+        m_txnId = txnId;
+        return true;
+    }
+
+    const quint64 generation = MetadataDB(m_metadataDbi, txn).get(MetadataDB::UrlGeneration);
+    if (generation != m_generation) {
+        if (txnId < m_txnId) {
+            return false;
+        }
+        m_paths.clear();
+        m_generation = generation;
+    }
+    m_txnId = qMax(m_txnId, txnId);
+    return true;
+}
+
+QByteArray DocumentUrlCache::get(MDB_txn* txn, quint64 id)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!isValid(txn)) {
+        return QByteArray();
+    }
+
+    const QByteArray* path = m_paths.object(id);
+    return path ? *path : QByteArray();
+}
+
+void DocumentUrlCache::insert(MDB_txn* txn, quint64 id, const QByteArray& path)
+{
+    QMutexLocker locker(&m_mutex);
+    if (isValid(txn)) {
+        m_paths.insert(id, new QByteArray(path), s_urlCacheEntrySize + path.size());
+    }
+}
+
+void DocumentUrlCache::update(size_t txnId, bool urlsChanged)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // The next transaction reads the new generation
+    if (m_metadataDbi) {
+        if (urlsChanged) {
+            m_paths.clear();
+            m_txnId = 0;
+        }
+        return;
+    }
+
+    // Another process wrote in between
+    if (urlsChanged || m_txnId + 1 != txnId) {
+        m_paths.clear();
+    }
+    m_txnId = txnId;
+}
+
+void DocumentUrlCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_paths.clear();
+}
+
 DocumentUrlDB::DocumentUrlDB(MDB_dbi idTreeDb, MDB_dbi idFilenameDb, MDB_txn* txn)
     : m_txn(txn)
     , m_idFilenameDbi(idFilenameDb)
     , m_idTreeDbi(idTreeDb)
+    , m_fileNameIdDbi(0)
+    , m_urlCache(0)
+{
+}
+
+DocumentUrlDB::DocumentUrlDB(MDB_dbi idTreeDb, MDB_dbi idFilenameDb, MDB_dbi fileNameIdDb, MDB_txn* txn)
+    : m_txn(txn)
+    , m_idFilenameDbi(idFilenameDb)
+    , m_idTreeDbi(idTreeDb)
+    , m_fileNameIdDbi(fileNameIdDb)
+    , m_urlCache(0)
 {
 }
 
@@ -109,23 +288,7 @@ void DocumentUrlDB::add(quint64 id, quint64 parentId, const QByteArray& name)
 
     IdFilenameDB idFilenameDb(m_idFilenameDbi, m_txn);
     IdTreeDB idTreeDb(m_idTreeDbi, m_txn);
-
-    QVector<quint64> subDocs = idTreeDb.get(parentId);
-
-    // Find if the id exists
-    if (subDocs.isEmpty()) {
-        subDocs.append(id);
-    } else {
-        auto it = std::upper_bound(subDocs.begin(), subDocs.end(), id);
-
-        // Merge the id if it does not
-        auto prev = it - 1;
-        if (*prev != id) {
-            subDocs.insert(it, id);
-        }
-    }
-
-    idTreeDb.put(parentId, subDocs);
+    idTreeDb.add(parentId, id);
 
     // Update the IdFileName
     IdFilenameDB::FilePath path;
@@ -133,6 +296,27 @@ void DocumentUrlDB::add(quint64 id, quint64 parentId, const QByteArray& name)
     path.name = name;
 
     idFilenameDb.put(id, path);
+
+    if (m_fileNameIdDbi) {
+        FilenameIdDB fileNameIdDb(m_fileNameIdDbi, m_txn);
+        fileNameIdDb.put(parentId, name, id);
+    }
+}
+
+void DocumentUrlDB::removeFileName(quint64 id, const IdFilenameDB::FilePath& path)
+{
+    IdFilenameDB idFilenameDb(m_idFilenameDbi, m_txn);
+    idFilenameDb.del(id);
+
+    if (m_fileNameIdDbi) {
+        FilenameIdDB fileNameIdDb(m_fileNameIdDbi, m_txn);
+        fileNameIdDb.del(path.parentId, path.name, id);
+    }
+}
+
+void DocumentUrlDB::setUrlCache(DocumentUrlCache* cache)
+{
+    m_urlCache = cache;
 }
 
 QByteArray DocumentUrlDB::get(quint64 docId) const
@@ -146,6 +330,10 @@ QByteArray DocumentUrlDB::get(quint64 docId) const
         return QByteArray();
     }
 
+    if (m_urlCache) {
+        return folderPath(path.parentId) + '/' + path.name;
+    }
+
     QByteArray ret = path.name;
     quint64 id = path.parentId;
     while (id) {
@@ -159,6 +347,37 @@ QByteArray DocumentUrlDB::get(quint64 docId) const
     return '/' + ret;
 }
 
+/*
+ * Returns the path of the folder \p id through the url cache. The folders
+ * up to the first cached one are looked up, and their paths are cached.
+ */
+QByteArray DocumentUrlDB::folderPath(quint64 id) const
+{
+    IdFilenameDB idFilenameDb(m_idFilenameDbi, m_txn);
+
+    QVector<QPair<quint64, QByteArray> > folders;
+    QByteArray path;
+    while (id) {
+        path = m_urlCache->get(m_txn, id);
+        if (!path.isEmpty()) {
+            break;
+        }
+
+        auto p = idFilenameDb.get(id);
+        Q_ASSERT(!p.name.isEmpty());
+
+        folders << qMakePair(id, p.name);
+        id = p.parentId;
+    }
+
+    for (int i = folders.size() - 1; i >= 0; i--) {
+        path += '/' + folders[i].second;
+        m_urlCache->insert(m_txn, folders[i].first, path);
+    }
+
+    return path;
+}
+
 QVector<quint64> DocumentUrlDB::getChildren(quint64 docId) const
 {
     IdTreeDB idTreeDb(m_idTreeDbi, m_txn);
@@ -172,6 +391,14 @@ void DocumentUrlDB::rename(quint64 docId, const QByteArray& newFileName)
     IdFilenameDB idFilenameDb(m_idFilenameDbi, m_txn);
 
     auto path = idFilenameDb.get(docId);
+    if (m_fileNameIdDbi) {
+        FilenameIdDB fileNameIdDb(m_fileNameIdDbi, m_txn);
+        if (!path.name.isEmpty()) {
+            fileNameIdDb.del(path.parentId, path.name, docId);
+        }
+        fileNameIdDb.put(path.parentId, newFileName, docId);
+    }
+
     path.name = newFileName;
     idFilenameDb.put(docId, path);
 }
@@ -180,6 +407,11 @@ quint64 DocumentUrlDB::getId(quint64 docId, const QByteArray& fileName) const
 {
     Q_ASSERT(!fileName.isEmpty());
 
+    if (m_fileNameIdDbi && FilenameIdDB::canStore(fileName)) {
+        FilenameIdDB fileNameIdDb(m_fileNameIdDbi, m_txn);
+        return fileNameIdDb.get(docId, fileName);
+    }
+
     IdFilenameDB idFilenameDb(m_idFilenameDbi, m_txn);
     IdTreeDB idTreeDb(m_idTreeDbi, m_txn);
 
@@ -194,6 +426,12 @@ quint64 DocumentUrlDB::getId(quint64 docId, const QByteArray& fileName) const
     return 0;
 }
 
+PostingIterator* DocumentUrlDB::iter(quint64 docId)
+{
+    IdTreeDB idTreeDb(m_idTreeDbi, m_txn);
+    return new SubtreePostingIterator(docId, idTreeDb.iter(docId), m_idFilenameDbi, m_txn);
+}
+
 QMap<quint64, QByteArray> DocumentUrlDB::toTestMap() const
 {
     IdTreeDB idTreeDb(m_idTreeDbi, m_txn);
@@ -23,19 +23,74 @@
 
 #include "idtreedb.h"
 #include "idfilenamedb.h"
+#include "filenameiddb.h"
 
+#include <QCache>
 #include <QDebug>
 #include <QFile>
+#include <QMutex>
 
 namespace Baloo {
 
 class UrlTest;
 class PostingIterator;
 
+/**
+ * Shares the paths of the folders of a database between its read
+ * transactions, so that building the url of a document only needs to
+ * look up its own name.
+ *
+ * The paths belong to one url generation of the MetadataDB, which every
+ * commit that moves or removes documents increases, no matter which process
+ * made it. Without the MetadataDB they belong to one LMDB transaction id,
+ * and changes made by other processes always drop them.
+ */
+class BALOO_ENGINE_EXPORT DocumentUrlCache
+{
+public:
+    DocumentUrlCache();
+
+    /**
+     * Returns the cached path of the folder \p id for the read-only
+     * transaction \p txn, or an empty array
+     */
+    QByteArray get(MDB_txn* txn, quint64 id);
+    void insert(MDB_txn* txn, quint64 id, const QByteArray& path);
+
+    /**
+     * Called after the write transaction \p txnId has been committed.
+     * \p urlsChanged tells if it moved or removed any document.
+     */
+    void update(size_t txnId, bool urlsChanged);
+
+    void clear();
+
+    /**
+     * Sets the MetadataDB to read the url generation of the transactions
+     * from, see DatabaseDbis::metadataDbi
+     */
+    void setMetadataDbi(MDB_dbi dbi);
+
+private:
+    bool isValid(MDB_txn* txn);
+
+    QMutex m_mutex;
+    QCache<quint64, QByteArray> m_paths;
+    size_t m_txnId;
+    quint64 m_generation;
+    MDB_dbi m_metadataDbi;
+};
+
 class BALOO_ENGINE_EXPORT DocumentUrlDB
 {
 public:
     explicit DocumentUrlDB(MDB_dbi idTreeDb, MDB_dbi idFileNameDb, MDB_txn* txn);
+
+    /**
+     * Also keeps \p fileNameIdDb up to date, which getId() then uses
+     * instead of going through all the children of the folder
+     */
+    DocumentUrlDB(MDB_dbi idTreeDb, MDB_dbi idFileNameDb, MDB_dbi fileNameIdDb, MDB_txn* txn);
     ~DocumentUrlDB();
 
     /**
@@ -44,6 +99,12 @@ public:
      */
     bool put(quint64 docId, const QByteArray& url);
 
+    /**
+     * Reads and stores the paths of the folders in \p cache while
+     * building urls. Only meant for read-only transactions.
+     */
+    void setUrlCache(DocumentUrlCache* cache);
+
     QByteArray get(quint64 docId) const;
     QVector<quint64> getChildren(quint64 docId) const;
 
@@ -66,19 +127,25 @@ public:
 
     quint64 getId(quint64 docId, const QByteArray& fileName) const;
 
-    PostingIterator* iter(quint64 docId) {
-        IdTreeDB db(m_idTreeDbi, m_txn);
-        return db.iter(docId);
-    }
+    /**
+     * Returns an iterator over \p docId and everything under it. When it is
+     * ANDed with other iterators, it only checks their documents by walking
+     * up their parents, instead of reading the whole tree.
+     */
+    PostingIterator* iter(quint64 docId);
 
     QMap<quint64, QByteArray> toTestMap() const;
 
 private:
     void add(quint64 id, quint64 parentId, const QByteArray& name);
+    void removeFileName(quint64 id, const IdFilenameDB::FilePath& path);
+    QByteArray folderPath(quint64 id) const;
 
     MDB_txn* m_txn;
     MDB_dbi m_idFilenameDbi;
     MDB_dbi m_idTreeDbi;
+    MDB_dbi m_fileNameIdDbi;
+    DocumentUrlCache* m_urlCache;
 
     friend class UrlTest;
 };
@@ -96,16 +163,11 @@ void DocumentUrlDB::replace(quint64 docId, const QByteArray& url, Functor should
     if (path.name.isEmpty()) {
         return;
     }
-    idFilenameDb.del(docId);
-
-    QVector<quint64> subDocs = idTreeDb.get(path.parentId);
-    subDocs.removeOne(docId);
+    removeFileName(docId, path);
 
-    if (!subDocs.isEmpty()) {
-        idTreeDb.put(path.parentId, subDocs);
-    } else {
-        idTreeDb.del(path.parentId);
+    idTreeDb.remove(path.parentId, docId);
 
+    if (idTreeDb.childCount(path.parentId) == 0) {
         //
         // Delete every parent directory which only has 1 child
         //
@@ -114,10 +176,9 @@ void DocumentUrlDB::replace(quint64 docId, const QByteArray& url, Functor should
             auto path = idFilenameDb.get(id);
             Q_ASSERT(!path.name.isEmpty());
 
-            QVector<quint64> subDocs = idTreeDb.get(path.parentId);
-            if (subDocs.size() == 1 && shouldDeleteFolder(id)) {
+            if (idTreeDb.childCount(path.parentId) == 1 && shouldDeleteFolder(id)) {
                 idTreeDb.del(path.parentId);
-                idFilenameDb.del(id);
+                removeFileName(id, path);
             } else {
                 break;
             }
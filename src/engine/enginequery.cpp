@@ -25,6 +25,8 @@ using namespace Baloo;
 EngineQuery::EngineQuery()
     : m_pos(0)
     , m_op(Equal)
+    , m_prefixSize(0)
+    , m_maxEdits(0)
 {
 }
 
@@ -32,6 +34,8 @@ EngineQuery::EngineQuery(const QByteArray& term, int pos)
     : m_term(term)
     , m_pos(pos)
     , m_op(Equal)
+    , m_prefixSize(0)
+    , m_maxEdits(0)
 {
 }
 
@@ -39,12 +43,26 @@ EngineQuery::EngineQuery(const QByteArray& term, EngineQuery::Operation op, int
     : m_term(term)
     , m_pos(pos)
     , m_op(op)
+    , m_prefixSize(0)
+    , m_maxEdits(0)
 {
 }
 
 EngineQuery::EngineQuery(const QVector<EngineQuery> subQueries, Operation op)
     : m_pos(0)
     , m_op(op)
+    , m_prefixSize(0)
+    , m_maxEdits(0)
     , m_subQueries(subQueries)
 {
 }
+
+EngineQuery::EngineQuery(const QByteArray& term, int prefixSize, int maxEdits, int pos)
+    : m_term(term)
+    , m_pos(pos)
+    , m_op(Fuzzy)
+    , m_prefixSize(prefixSize)
+    , m_maxEdits(maxEdits)
+{
+    Q_ASSERT(prefixSize >= 0 && prefixSize < term.size());
+}
@@ -37,7 +37,13 @@ public:
         StartsWith,
         And,
         Or,
-        Phrase
+        Phrase,
+        Fuzzy,
+
+        /**
+         * Matches the documents whose file name contains the term
+         */
+        Substring
     };
 
     EngineQuery();
@@ -45,6 +51,13 @@ public:
     EngineQuery(const QByteArray& term, Operation op, int pos = 0);
     EngineQuery(const QVector<EngineQuery> subQueries, Operation op);
 
+    /**
+     * Creates a Fuzzy query, which matches the terms within \p maxEdits
+     * edits of \p term. The first \p prefixSize bytes of the term are the
+     * property prefix, which is never edited.
+     */
+    EngineQuery(const QByteArray& term, int prefixSize, int maxEdits, int pos = 0);
+
     QByteArray term() const {
         return m_term;
     }
@@ -61,6 +74,14 @@ public:
         m_op = op;
     }
 
+    int prefixSize() const {
+        return m_prefixSize;
+    }
+
+    int maxEdits() const {
+        return m_maxEdits;
+    }
+
     bool leaf() const {
         return !m_term.isEmpty();
     }
@@ -74,12 +95,15 @@ public:
     }
 
     bool operator ==(const EngineQuery& q) const {
-        return m_term == q.m_term && m_pos == q.m_pos && m_op == q.m_op && m_subQueries == q.m_subQueries;
+        return m_term == q.m_term && m_pos == q.m_pos && m_op == q.m_op && m_subQueries == q.m_subQueries
+               && m_prefixSize == q.m_prefixSize && m_maxEdits == q.m_maxEdits;
     }
 private:
     QByteArray m_term;
     int m_pos;
     Operation m_op;
+    int m_prefixSize;
+    int m_maxEdits;
 
     QVector<EngineQuery> m_subQueries;
 };
@@ -93,6 +117,8 @@ inline QDebug operator << (QDebug d, const Baloo::EngineQuery& q) {
         d << "[OR " << q.subQueries() << "]";
     } else if (q.op() == Baloo::EngineQuery::Phrase) {
         d << "[PHRASE " << q.subQueries() << "]";
+    } else if (q.op() == Baloo::EngineQuery::Fuzzy) {
+        d << "(" << q.term() << q.pos() << "FUZZY" << q.maxEdits() << ")";
     } else {
         Q_ASSERT(q.subQueries().isEmpty());
         d << "(" << q.term() << q.pos() << q.op() << ")";
@@ -0,0 +1,191 @@
+/*
+   This file is part of the KDE Baloo project.
+ * Copyright (C) 2016  Vishesh Handa <vhanda@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "filenameiddb.h"
+#include "mapfull.h"
+
+using namespace Baloo;
+
+// LMDB keys are limited to 511 bytes, 8 of which hold the parent id
+static const int s_maxFileNameSize = 511 - 8;
+
+static QByteArray fileNameKey(quint64 parentId, const QByteArray& fileName)
+{
+    QByteArray key(8 + fileName.size(), Qt::Uninitialized);
+    memcpy(key.data(), &parentId, 8);
+    memcpy(key.data() + 8, fileName.constData(), fileName.size());
+    return key;
+}
+
+FilenameIdDB::FilenameIdDB(MDB_dbi dbi, MDB_txn* txn)
+    : m_txn(txn)
+    , m_dbi(dbi)
+{
+    Q_ASSERT(txn != 0);
+    Q_ASSERT(dbi != 0);
+}
+
+FilenameIdDB::~FilenameIdDB()
+{
+}
+
+MDB_dbi FilenameIdDB::create(MDB_txn* txn)
+{
+    MDB_dbi dbi;
+    int rc = mdb_dbi_open(txn, "filenameid", MDB_CREATE, &dbi);
+    Q_ASSERT_X(rc == 0, "FilenameIdDB::create", mdb_strerror(rc));
+
+    return dbi;
+}
+
+MDB_dbi FilenameIdDB::open(MDB_txn* txn)
+{
+    MDB_dbi dbi;
+    int rc = mdb_dbi_open(txn, "filenameid", 0, &dbi);
+    if (rc == MDB_NOTFOUND) {
+        return 0;
+    }
+    Q_ASSERT_X(rc == 0, "FilenameIdDB::open", mdb_strerror(rc));
+
+    return dbi;
+}
+
+bool FilenameIdDB::canStore(const QByteArray& fileName)
+{
+    return fileName.size() <= s_maxFileNameSize;
+}
+
+void FilenameIdDB::put(quint64 parentId, const QByteArray& fileName, quint64 id)
+{
+    Q_ASSERT(id > 0);
+    Q_ASSERT(!fileName.isEmpty());
+
+    if (!canStore(fileName)) {
+        return;
+    }
+
+    QByteArray arr = fileNameKey(parentId, fileName);
+
+    MDB_val key;
+    key.mv_size = arr.size();
+    key.mv_data = static_cast<void*>(arr.data());
+
+    MDB_val val;
+    val.mv_size = sizeof(quint64);
+    val.mv_data = static_cast<void*>(&id);
+
+    int rc = mdb_put(m_txn, m_dbi, &key, &val, 0);
+    Q_ASSERT_X(rc == 0 || isMapFull(rc), "FilenameIdDB::put", mdb_strerror(rc));
+}
+
+quint64 FilenameIdDB::get(quint64 parentId, const QByteArray& fileName)
+{
+    Q_ASSERT(!fileName.isEmpty());
+
+    if (!canStore(fileName)) {
+        return 0;
+    }
+
+    QByteArray arr = fileNameKey(parentId, fileName);
+
+    MDB_val key;
+    key.mv_size = arr.size();
+    key.mv_data = static_cast<void*>(arr.data());
+
+    MDB_val val;
+    int rc = mdb_get(m_txn, m_dbi, &key, &val);
+    if (rc == MDB_NOTFOUND || isMapFull(rc)) {
+        return 0;
+    }
+    Q_ASSERT_X(rc == 0, "FilenameIdDB::get", mdb_strerror(rc));
+
+    return *(static_cast<quint64*>(val.mv_data));
+}
+
+void FilenameIdDB::del(quint64 parentId, const QByteArray& fileName, quint64 id)
+{
+    Q_ASSERT(!fileName.isEmpty());
+
+    // The name might have been taken over by a new file in the meantime
+    if (get(parentId, fileName) != id) {
+        return;
+    }
+
+    QByteArray arr = fileNameKey(parentId, fileName);
+
+    MDB_val key;
+    key.mv_size = arr.size();
+    key.mv_data = static_cast<void*>(arr.data());
+
+    int rc = mdb_del(m_txn, m_dbi, &key, 0);
+    Q_ASSERT_X(rc == 0 || isMapFull(rc), "FilenameIdDB::del", mdb_strerror(rc));
+}
+
+void FilenameIdDB::build(MDB_dbi idFilenameDbi)
+{
+    MDB_cursor* cursor;
+    int rc = mdb_cursor_open(m_txn, idFilenameDbi, &cursor);
+    Q_ASSERT_X(rc == 0, "FilenameIdDB::build", mdb_strerror(rc));
+
+    MDB_val key = {0, 0};
+    MDB_val val;
+    while (1) {
+        rc = mdb_cursor_get(cursor, &key, &val, MDB_NEXT);
+        if (rc == MDB_NOTFOUND || isMapFull(rc)) {
+            break;
+        }
+        Q_ASSERT_X(rc == 0, "FilenameIdDB::build", mdb_strerror(rc));
+
+        const quint64 id = *(static_cast<quint64*>(key.mv_data));
+        const quint64 parentId = static_cast<quint64*>(val.mv_data)[0];
+        const QByteArray name(static_cast<char*>(val.mv_data) + 8, val.mv_size - 8);
+
+        put(parentId, name, id);
+    }
+
+    mdb_cursor_close(cursor);
+}
+
+QMap<QPair<quint64, QByteArray>, quint64> FilenameIdDB::toTestMap() const
+{
+    MDB_cursor* cursor;
+    mdb_cursor_open(m_txn, m_dbi, &cursor);
+
+    MDB_val key = {0, 0};
+    MDB_val val;
+
+    QMap<QPair<quint64, QByteArray>, quint64> map;
+    while (1) {
+        int rc = mdb_cursor_get(cursor, &key, &val, MDB_NEXT);
+        if (rc == MDB_NOTFOUND) {
+            break;
+        }
+        Q_ASSERT_X(rc == 0, "FilenameIdDB::toTestMap", mdb_strerror(rc));
+
+        const quint64 parentId = static_cast<quint64*>(key.mv_data)[0];
+        const QByteArray name(static_cast<char*>(key.mv_data) + 8, key.mv_size - 8);
+        const quint64 id = *(static_cast<quint64*>(val.mv_data));
+
+        map.insert(qMakePair(parentId, name), id);
+    }
+
+    mdb_cursor_close(cursor);
+    return map;
+}
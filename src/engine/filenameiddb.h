@@ -0,0 +1,73 @@
+/*
+   This file is part of the KDE Baloo project.
+ * Copyright (C) 2016  Vishesh Handa <vhanda@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef BALOO_FILENAMEIDDB_H
+#define BALOO_FILENAMEIDDB_H
+
+#include "engine_export.h"
+#include <lmdb.h>
+#include <QByteArray>
+#include <QMap>
+#include <QPair>
+
+namespace Baloo {
+
+/**
+ * The FilenameIdDB is the reverse of the IdFilenameDB. It maps
+ * <parentId> <filename> -> <id>, so that a path can be resolved one
+ * component at a time without going through all the children of a folder.
+ */
+class BALOO_ENGINE_EXPORT FilenameIdDB
+{
+public:
+    FilenameIdDB(MDB_dbi dbi, MDB_txn* txn);
+    ~FilenameIdDB();
+
+    static MDB_dbi create(MDB_txn* txn);
+    static MDB_dbi open(MDB_txn* txn);
+
+    /**
+     * Returns false if \p fileName is too long to be part of a key. Such
+     * names are never stored and need to be looked up some other way.
+     */
+    static bool canStore(const QByteArray& fileName);
+
+    void put(quint64 parentId, const QByteArray& fileName, quint64 id);
+    quint64 get(quint64 parentId, const QByteArray& fileName);
+
+    /**
+     * Removes the entry, unless it belongs to another id than \p id by now
+     */
+    void del(quint64 parentId, const QByteArray& fileName, quint64 id);
+
+    /**
+     * Fills the database from all the entries of \p idFilenameDbi
+     */
+    void build(MDB_dbi idFilenameDbi);
+
+    QMap<QPair<quint64, QByteArray>, quint64> toTestMap() const;
+private:
+    MDB_txn* m_txn;
+    MDB_dbi m_dbi;
+};
+
+}
+
+#endif // BALOO_FILENAMEIDDB_H
@@ -0,0 +1,288 @@
+/*
+   This file is part of the KDE Baloo project.
+ * Copyright (C) 2016  Vishesh Handa <vhanda@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "filenametrigramdb.h"
+#include "andpostingiterator.h"
+#include "chunkedlist.h"
+#include "mapfull.h"
+#include "idfilenamedb.h"
+#include "postingcodec.h"
+
+#include <QFile>
+#include <QString>
+
+#include <algorithm>
+
+using namespace Baloo;
+
+// The number of documents build() collects before writing their trigrams
+static const int s_buildBatchSize = 65536;
+
+namespace {
+
+/*
+ * Lower cases \p fileName and removes its accents, the same way the
+ * TermGenerator does for the words, and returns it as UTF-8
+ */
+QByteArray normalize(const QByteArray& fileName)
+{
+    const QString str = QFile::decodeName(fileName).toLower();
+    const QString denormalized = str.normalized(QString::NormalizationForm_KD);
+
+    QString cleanString;
+    cleanString.reserve(denormalized.size());
+    Q_FOREACH (const QChar& ch, denormalized) {
+        auto cat = ch.category();
+        if (cat != QChar::Mark_NonSpacing && cat != QChar::Mark_SpacingCombining && cat != QChar::Mark_Enclosing) {
+            cleanString.append(ch);
+        }
+    }
+
+    return cleanString.normalized(QString::NormalizationForm_KC).toUtf8();
+}
+
+/*
+ * Returns the trigrams of the normalized \p name. The characters are
+ * counted in UTF-8, where every character starts with a byte which is
+ * not a continuation byte.
+ */
+QVector<QByteArray> trigramsOf(const QByteArray& name)
+{
+    QVector<int> starts;
+    for (int i = 0; i < name.size(); i++) {
+        if ((static_cast<uchar>(name.at(i)) & 0xC0) != 0x80) {
+            starts << i;
+        }
+    }
+    starts << name.size();
+
+    QVector<QByteArray> trigrams;
+    for (int i = 0; i + 3 < starts.size(); i++) {
+        trigrams << name.mid(starts[i], starts[i + 3] - starts[i]);
+    }
+
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+    return trigrams;
+}
+
+/*
+ * Only returns the documents of \p candidates whose file name actually
+ * contains the needle, as its trigrams might be spread over the name
+ */
+class FilenameMatchIterator : public PostingIterator
+{
+public:
+    FilenameMatchIterator(PostingIterator* candidates, const QByteArray& needle, MDB_dbi idFilenameDbi, MDB_txn* txn)
+        : m_candidates(candidates)
+        , m_needle(needle)
+        , m_idFilenameDb(idFilenameDbi, txn)
+        , m_docId(0)
+    {
+    }
+
+    ~FilenameMatchIterator() {
+        delete m_candidates;
+    }
+
+    quint64 next() Q_DECL_OVERRIDE {
+        return findMatch(m_candidates->next());
+    }
+
+    quint64 docId() const Q_DECL_OVERRIDE {
+        return m_docId;
+    }
+
+    quint64 skipTo(quint64 docId) Q_DECL_OVERRIDE {
+        if (m_docId && m_docId >= docId) {
+            return m_docId;
+        }
+        return findMatch(m_candidates->skipTo(docId));
+    }
+
+    quint64 estimatedSize() const Q_DECL_OVERRIDE {
+        return m_candidates->estimatedSize();
+    }
+
+private:
+    quint64 findMatch(quint64 candidate) {
+        while (candidate) {
+            const QByteArray name = m_idFilenameDb.get(candidate).name;
+            if (normalize(name).contains(m_needle)) {
+                break;
+            }
+            candidate = m_candidates->next();
+        }
+
+        m_docId = candidate;
+        return m_docId;
+    }
+
+    PostingIterator* m_candidates;
+    QByteArray m_needle;
+    IdFilenameDB m_idFilenameDb;
+    quint64 m_docId;
+};
+
+}
+
+FilenameTrigramDB::FilenameTrigramDB(MDB_dbi dbi, MDB_txn* txn)
+    : m_txn(txn)
+    , m_dbi(dbi)
+{
+    Q_ASSERT(txn != 0);
+    Q_ASSERT(dbi != 0);
+}
+
+FilenameTrigramDB::~FilenameTrigramDB()
+{
+}
+
+MDB_dbi FilenameTrigramDB::create(MDB_txn* txn)
+{
+    MDB_dbi dbi;
+    int rc = mdb_dbi_open(txn, "filenametrigramdb", MDB_CREATE, &dbi);
+    Q_ASSERT_X(rc == 0, "FilenameTrigramDB::create", mdb_strerror(rc));
+
+    return dbi;
+}
+
+MDB_dbi FilenameTrigramDB::open(MDB_txn* txn)
+{
+    MDB_dbi dbi;
+    int rc = mdb_dbi_open(txn, "filenametrigramdb", 0, &dbi);
+    if (rc == MDB_NOTFOUND) {
+        return 0;
+    }
+    Q_ASSERT_X(rc == 0, "FilenameTrigramDB::open", mdb_strerror(rc));
+
+    return dbi;
+}
+
+QVector<QByteArray> FilenameTrigramDB::trigrams(const QByteArray& fileName)
+{
+    return trigramsOf(normalize(fileName));
+}
+
+void FilenameTrigramDB::put(const QByteArray& trigram, const PostingList& list)
+{
+    PostingDB(m_dbi, m_txn).put(trigram, list);
+}
+
+PostingList FilenameTrigramDB::get(const QByteArray& trigram)
+{
+    return PostingDB(m_dbi, m_txn).get(trigram);
+}
+
+void FilenameTrigramDB::build(MDB_dbi idFilenameDbi, MDB_dbi docTimeDbi)
+{
+    MDB_cursor* cursor;
+    int rc = mdb_cursor_open(m_txn, idFilenameDbi, &cursor);
+    Q_ASSERT_X(rc == 0, "FilenameTrigramDB::build", mdb_strerror(rc));
+
+    // The ids are read in increasing order, so every list stays sorted
+    QMap<QByteArray, PostingList> lists;
+    int documents = 0;
+
+    MDB_val key = {0, 0};
+    MDB_val val;
+    while (1) {
+        rc = mdb_cursor_get(cursor, &key, &val, MDB_NEXT);
+        if (rc == MDB_NOTFOUND || isMapFull(rc)) {
+            break;
+        }
+        Q_ASSERT_X(rc == 0, "FilenameTrigramDB::build", mdb_strerror(rc));
+
+        MDB_val timeVal;
+        rc = mdb_get(m_txn, docTimeDbi, &key, &timeVal);
+        if (rc == MDB_NOTFOUND) {
+            continue;
+        }
+        if (isMapFull(rc)) {
+            break;
+        }
+        Q_ASSERT_X(rc == 0, "FilenameTrigramDB::build", mdb_strerror(rc));
+
+        const quint64 id = *(static_cast<quint64*>(key.mv_data));
+        const QByteArray name(static_cast<char*>(val.mv_data) + 8, val.mv_size - 8);
+        for (const QByteArray& trigram : trigrams(name)) {
+            lists[trigram] << id;
+        }
+
+        if (++documents == s_buildBatchSize) {
+            merge(lists);
+            lists.clear();
+            documents = 0;
+        }
+    }
+
+    mdb_cursor_close(cursor);
+    merge(lists);
+}
+
+void FilenameTrigramDB::merge(const QMap<QByteArray, PostingList>& lists)
+{
+    MDB_cursor* cursor;
+    int rc = mdb_cursor_open(m_txn, m_dbi, &cursor);
+    if (isMapFull(rc)) {
+        return;
+    }
+    Q_ASSERT_X(rc == 0, "FilenameTrigramDB::merge", mdb_strerror(rc));
+
+    for (auto it = lists.constBegin(); it != lists.constEnd(); ++it) {
+        PostingChunks chunks(cursor, it.key(), PostingChunkSize);
+        chunks.merge(it.value(), PostingList());
+        if (!chunks.write()) {
+            break;
+        }
+    }
+
+    mdb_cursor_close(cursor);
+}
+
+PostingIterator* FilenameTrigramDB::iter(const QByteArray& text, MDB_dbi idFilenameDbi)
+{
+    const QByteArray needle = normalize(text);
+    const QVector<QByteArray> grams = trigramsOf(needle);
+    if (grams.isEmpty()) {
+        return 0;
+    }
+
+    PostingDB postingDb(m_dbi, m_txn);
+
+    QVector<PostingIterator*> iterators;
+    iterators.reserve(grams.size());
+    for (const QByteArray& trigram : grams) {
+        PostingIterator* it = postingDb.iter(trigram);
+        if (!it) {
+            qDeleteAll(iterators);
+            return 0;
+        }
+        iterators << it;
+    }
+
+    PostingIterator* candidates = iterators.size() == 1 ? iterators.first() : new AndPostingIterator(iterators);
+    return new FilenameMatchIterator(candidates, needle, idFilenameDbi, m_txn);
+}
+
+QMap<QByteArray, PostingList> FilenameTrigramDB::toTestMap() const
+{
+    return PostingDB(m_dbi, m_txn).toTestMap();
+}
@@ -0,0 +1,88 @@
+/*
+   This file is part of the KDE Baloo project.
+ * Copyright (C) 2016  Vishesh Handa <vhanda@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef BALOO_FILENAMETRIGRAMDB_H
+#define BALOO_FILENAMETRIGRAMDB_H
+
+#include "postingdb.h"
+
+#include <QByteArray>
+#include <QMap>
+#include <QVector>
+
+#include <lmdb.h>
+
+namespace Baloo {
+
+/**
+ * The FilenameTrigramDB maps <trigram> -> <id1> <id2> ... for every sequence
+ * of three characters in the file names of the documents. It allows finding
+ * the documents whose file name contains a string anywhere, not just at the
+ * start of a word.
+ *
+ * The file names are lower cased and their accents removed first.
+ */
+class BALOO_ENGINE_EXPORT FilenameTrigramDB
+{
+public:
+    FilenameTrigramDB(MDB_dbi dbi, MDB_txn* txn);
+    ~FilenameTrigramDB();
+
+    static MDB_dbi create(MDB_txn* txn);
+    static MDB_dbi open(MDB_txn* txn);
+
+    /**
+     * Returns the trigrams of \p fileName in sorted order, without any
+     * duplicates. Names shorter than 3 characters have none.
+     */
+    static QVector<QByteArray> trigrams(const QByteArray& fileName);
+
+    void put(const QByteArray& trigram, const PostingList& list);
+    PostingList get(const QByteArray& trigram);
+
+    /**
+     * Fills an empty database with the file names of all the documents in
+     * \p idFilenameDbi. Only the ids which have an entry in \p docTimeDbi
+     * are documents, the others are their parent folders.
+     */
+    void build(MDB_dbi idFilenameDbi, MDB_dbi docTimeDbi);
+
+    /**
+     * Returns the documents whose file name contains \p text. The posting
+     * lists of its trigrams are intersected, after which the file name of
+     * every candidate is read from \p idFilenameDbi and checked, as the
+     * trigrams could be anywhere in it.
+     *
+     * Returns 0 if \p text is shorter than 3 characters.
+     */
+    PostingIterator* iter(const QByteArray& text, MDB_dbi idFilenameDbi);
+
+    QMap<QByteArray, PostingList> toTestMap() const;
+
+private:
+    void merge(const QMap<QByteArray, PostingList>& lists);
+
+    MDB_txn* m_txn;
+    MDB_dbi m_dbi;
+};
+
+}
+
+#endif // BALOO_FILENAMETRIGRAMDB_H
@@ -19,6 +19,7 @@
  */
 
 #include "idfilenamedb.h"
+#include "mapfull.h"
 
 using namespace Baloo;
 
@@ -73,7 +74,7 @@ void IdFilenameDB::put(quint64 docId, const FilePath& path)
     val.mv_data = static_cast<void*>(data.data());
 
     int rc = mdb_put(m_txn, m_dbi, &key, &val, 0);
-    Q_ASSERT_X(rc == 0, "IdFilenameDB::put", mdb_strerror(rc));
+    Q_ASSERT_X(rc == 0 || isMapFull(rc), "IdFilenameDB::put", mdb_strerror(rc));
 }
 
 IdFilenameDB::FilePath IdFilenameDB::get(quint64 docId)
@@ -88,7 +89,7 @@ IdFilenameDB::FilePath IdFilenameDB::get(quint64 docId)
 
     MDB_val val;
     int rc = mdb_get(m_txn, m_dbi, &key, &val);
-    if (rc == MDB_NOTFOUND) {
+    if (rc == MDB_NOTFOUND || isMapFull(rc)) {
         return path;
     }
     Q_ASSERT_X(rc == 0, "IdfilenameDB::get", mdb_strerror(rc));
@@ -109,7 +110,7 @@ bool IdFilenameDB::contains(quint64 docId)
 
     MDB_val val;
     int rc = mdb_get(m_txn, m_dbi, &key, &val);
-    if (rc == MDB_NOTFOUND) {
+    if (rc == MDB_NOTFOUND || isMapFull(rc)) {
         return false;
     }
     Q_ASSERT_X(rc == 0, "IdfilenameDB::contains", mdb_strerror(rc));
@@ -125,7 +126,7 @@ void IdFilenameDB::del(quint64 docId)
     key.mv_data = static_cast<void*>(&docId);
 
     int rc = mdb_del(m_txn, m_dbi, &key, 0);
-    Q_ASSERT_X(rc == 0, "IdfilenameDB::del", mdb_strerror(rc));
+    Q_ASSERT_X(rc == 0 || isMapFull(rc), "IdfilenameDB::del", mdb_strerror(rc));
 }
 
 QMap<quint64, IdFilenameDB::FilePath> IdFilenameDB::toTestMap() const
@@ -19,13 +19,130 @@
  */
 
 #include "idtreedb.h"
+#include "mapfull.h"
 #include "postingiterator.h"
 
 #include <QDebug>
+#include <QPair>
 #include <algorithm>
 
 using namespace Baloo;
 
+static const uint s_flags = MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED | MDB_INTEGERDUP;
+
+namespace {
+
+bool isDupSort(MDB_txn* txn, MDB_dbi dbi)
+{
+    uint flags;
+    int rc = mdb_dbi_flags(txn, dbi, &flags);
+    Q_ASSERT_X(rc == 0, "IdTreeDB::isDupSort", mdb_strerror(rc));
+
+    return flags & MDB_DUPSORT;
+}
+
+/*
+ * MDB_INTEGERDUP compares the children as size_t, which only holds a whole
+ * id where it is 64 bits wide. Elsewhere this compares them instead.
+ */
+int compareIds(const MDB_val* a, const MDB_val* b)
+{
+    quint64 lhs;
+    quint64 rhs;
+    memcpy(&lhs, a->mv_data, sizeof(quint64));
+    memcpy(&rhs, b->mv_data, sizeof(quint64));
+
+    return lhs < rhs ? -1 : lhs > rhs;
+}
+
+void setDupCompare(MDB_txn* txn, MDB_dbi dbi)
+{
+    if (sizeof(size_t) < sizeof(quint64)) {
+        int rc = mdb_set_dupsort(txn, dbi, compareIds);
+        Q_ASSERT_X(rc == 0, "IdTreeDB::setDupCompare", mdb_strerror(rc));
+    }
+}
+
+/*
+ * Appends the children of \p docId to \p list. They are read a page at a
+ * time, as they all have the same size.
+ */
+void appendChildren(MDB_cursor* cursor, quint64 docId, QVector<quint64>& list)
+{
+    MDB_val key;
+    key.mv_size = sizeof(quint64);
+    key.mv_data = static_cast<void*>(&docId);
+
+    MDB_val val;
+    int rc = mdb_cursor_get(cursor, &key, &val, MDB_SET);
+    if (rc == MDB_NOTFOUND || isMapFull(rc)) {
+        return;
+    }
+    Q_ASSERT_X(rc == 0, "IdTreeDB::appendChildren", mdb_strerror(rc));
+
+    rc = mdb_cursor_get(cursor, &key, &val, MDB_GET_MULTIPLE);
+    while (rc == 0) {
+        const int size = list.size();
+        list.resize(size + val.mv_size / sizeof(quint64));
+        memcpy(list.data() + size, val.mv_data, val.mv_size);
+
+        rc = mdb_cursor_get(cursor, &key, &val, MDB_NEXT_MULTIPLE);
+    }
+    Q_ASSERT_X(rc == MDB_NOTFOUND, "IdTreeDB::appendChildren", mdb_strerror(rc));
+}
+
+/*
+ * Up to database version 3 the children of a folder were stored as a single
+ * value, which is converted to one duplicate per child.
+ */
+MDB_dbi convertFromBlobFormat(MDB_txn* txn)
+{
+    MDB_dbi dbi;
+    int rc = mdb_dbi_open(txn, "idtree", MDB_INTEGERKEY, &dbi);
+    Q_ASSERT_X(rc == 0, "IdTreeDB::convertFromBlobFormat", mdb_strerror(rc));
+
+    MDB_cursor* cursor;
+    rc = mdb_cursor_open(txn, dbi, &cursor);
+    Q_ASSERT_X(rc == 0, "IdTreeDB::convertFromBlobFormat", mdb_strerror(rc));
+
+    QVector<QPair<quint64, QVector<quint64>>> tree;
+
+    MDB_val key = {0, 0};
+    MDB_val val;
+    while (1) {
+        rc = mdb_cursor_get(cursor, &key, &val, MDB_NEXT);
+        if (rc == MDB_NOTFOUND) {
+            break;
+        }
+        Q_ASSERT_X(rc == 0, "IdTreeDB::convertFromBlobFormat", mdb_strerror(rc));
+
+        const quint64 id = *(static_cast<quint64*>(key.mv_data));
+
+        QVector<quint64> list(val.mv_size / sizeof(quint64));
+        memcpy(list.data(), val.mv_data, val.mv_size);
+
+        tree << qMakePair(id, list);
+    }
+    mdb_cursor_close(cursor);
+
+    // The flags of a database cannot be changed, so it is created again
+    rc = mdb_drop(txn, dbi, 1);
+    Q_ASSERT_X(rc == 0, "IdTreeDB::convertFromBlobFormat", mdb_strerror(rc));
+
+    rc = mdb_dbi_open(txn, "idtree", MDB_CREATE | s_flags, &dbi);
+    Q_ASSERT_X(rc == 0, "IdTreeDB::convertFromBlobFormat", mdb_strerror(rc));
+    setDupCompare(txn, dbi);
+
+    IdTreeDB idTreeDb(dbi, txn);
+    for (const auto& entry : tree) {
+        idTreeDb.put(entry.first, entry.second);
+    }
+
+    return dbi;
+}
+
+}
+
 IdTreeDB::IdTreeDB(MDB_dbi dbi, MDB_txn* txn)
     : m_txn(txn)
     , m_dbi(dbi)
@@ -37,21 +154,29 @@ IdTreeDB::IdTreeDB(MDB_dbi dbi, MDB_txn* txn)
 MDB_dbi IdTreeDB::create(MDB_txn* txn)
 {
     MDB_dbi dbi;
-    int rc = mdb_dbi_open(txn, "idtree", MDB_CREATE | MDB_INTEGERKEY, &dbi);
+    int rc = mdb_dbi_open(txn, "idtree", MDB_CREATE | s_flags, &dbi);
+    if (rc == MDB_INCOMPATIBLE || (rc == 0 && !isDupSort(txn, dbi))) {
+        return convertFromBlobFormat(txn);
+    }
     Q_ASSERT_X(rc == 0, "IdTreeDB::create", mdb_strerror(rc));
 
+    setDupCompare(txn, dbi);
     return dbi;
 }
 
 MDB_dbi IdTreeDB::open(MDB_txn* txn)
 {
     MDB_dbi dbi;
-    int rc = mdb_dbi_open(txn, "idtree", MDB_INTEGERKEY, &dbi);
-    if (rc == MDB_NOTFOUND) {
+    int rc = mdb_dbi_open(txn, "idtree", s_flags, &dbi);
+    if (rc == MDB_NOTFOUND || rc == MDB_INCOMPATIBLE) {
         return 0;
     }
     Q_ASSERT_X(rc == 0, "IdTreeDB::open", mdb_strerror(rc));
 
+    if (!isDupSort(txn, dbi)) {
+        return 0;
+    }
+    setDupCompare(txn, dbi);
     return dbi;
 }
 
@@ -64,98 +189,298 @@ void IdTreeDB::put(quint64 docId, const QVector<quint64> subDocIds)
     key.mv_size = sizeof(quint64);
     key.mv_data = static_cast<void*>(&docId);
 
-    MDB_val val;
-    val.mv_size = subDocIds.size() * sizeof(quint64);
-    val.mv_data = static_cast<void*>(const_cast<quint64*>(subDocIds.constData()));
+    int rc = mdb_del(m_txn, m_dbi, &key, 0);
+    Q_ASSERT_X(rc == 0 || rc == MDB_NOTFOUND || isMapFull(rc), "IdTreeDB::put", mdb_strerror(rc));
 
-    int rc = mdb_put(m_txn, m_dbi, &key, &val, 0);
-    Q_ASSERT_X(rc == 0, "IdTreeDB::put", mdb_strerror(rc));
+    for (quint64 id : subDocIds) {
+        MDB_val val;
+        val.mv_size = sizeof(quint64);
+        val.mv_data = static_cast<void*>(&id);
+
+        rc = mdb_put(m_txn, m_dbi, &key, &val, 0);
+        Q_ASSERT_X(rc == 0 || isMapFull(rc), "IdTreeDB::put", mdb_strerror(rc));
+    }
 }
 
 QVector<quint64> IdTreeDB::get(quint64 docId)
+{
+    MDB_cursor* cursor;
+    int rc = mdb_cursor_open(m_txn, m_dbi, &cursor);
+    if (isMapFull(rc)) {
+        return QVector<quint64>();
+    }
+    Q_ASSERT_X(rc == 0, "IdTreeDB::get", mdb_strerror(rc));
+
+    QVector<quint64> list;
+    appendChildren(cursor, docId, list);
+
+    mdb_cursor_close(cursor);
+    return list;
+}
+
+void IdTreeDB::del(quint64 docId)
 {
     MDB_val key;
     key.mv_size = sizeof(quint64);
     key.mv_data = static_cast<void*>(&docId);
 
+    int rc = mdb_del(m_txn, m_dbi, &key, 0);
+    Q_ASSERT_X(rc == 0 || isMapFull(rc), "IdTreeDB::del", mdb_strerror(rc));
+}
+
+void IdTreeDB::add(quint64 parentId, quint64 id)
+{
+    Q_ASSERT(id > 0);
+
+    MDB_val key;
+    key.mv_size = sizeof(quint64);
+    key.mv_data = static_cast<void*>(&parentId);
+
     MDB_val val;
-    int rc = mdb_get(m_txn, m_dbi, &key, &val);
-    if (rc == MDB_NOTFOUND) {
-        return QVector<quint64>();
+    val.mv_size = sizeof(quint64);
+    val.mv_data = static_cast<void*>(&id);
+
+    int rc = mdb_put(m_txn, m_dbi, &key, &val, MDB_NODUPDATA);
+    if (rc == MDB_KEYEXIST) {
+        return;
     }
-    Q_ASSERT_X(rc == 0, "IdTreeeDB::get", mdb_strerror(rc));
+    Q_ASSERT_X(rc == 0 || isMapFull(rc), "IdTreeDB::add", mdb_strerror(rc));
+}
 
-    // FIXME: This still makes a copy of the data. Perhaps we can avoid that?
-    QVector<quint64> list(val.mv_size / sizeof(quint64));
-    memcpy(list.data(), val.mv_data, val.mv_size);
+void IdTreeDB::remove(quint64 parentId, quint64 id)
+{
+    MDB_val key;
+    key.mv_size = sizeof(quint64);
+    key.mv_data = static_cast<void*>(&parentId);
 
-    return list;
+    MDB_val val;
+    val.mv_size = sizeof(quint64);
+    val.mv_data = static_cast<void*>(&id);
+
+    int rc = mdb_del(m_txn, m_dbi, &key, &val);
+    if (rc == MDB_NOTFOUND) {
+        return;
+    }
+    Q_ASSERT_X(rc == 0 || isMapFull(rc), "IdTreeDB::remove", mdb_strerror(rc));
 }
 
-void IdTreeDB::del(quint64 docId)
+uint IdTreeDB::childCount(quint64 docId)
 {
     MDB_val key;
     key.mv_size = sizeof(quint64);
     key.mv_data = static_cast<void*>(&docId);
 
-    int rc = mdb_del(m_txn, m_dbi, &key, 0);
-    Q_ASSERT_X(rc == 0, "IdTreeDB::del", mdb_strerror(rc));
+    MDB_cursor* cursor;
+    int rc = mdb_cursor_open(m_txn, m_dbi, &cursor);
+    if (isMapFull(rc)) {
+        return 0;
+    }
+    Q_ASSERT_X(rc == 0, "IdTreeDB::childCount", mdb_strerror(rc));
+
+    size_t count = 0;
+    MDB_val val;
+    rc = mdb_cursor_get(cursor, &key, &val, MDB_SET);
+    if (rc == 0) {
+        rc = mdb_cursor_count(cursor, &count);
+        Q_ASSERT_X(rc == 0, "IdTreeDB::childCount", mdb_strerror(rc));
+    } else {
+        Q_ASSERT_X(rc == MDB_NOTFOUND || isMapFull(rc), "IdTreeDB::childCount", mdb_strerror(rc));
+    }
+
+    mdb_cursor_close(cursor);
+    return count;
 }
 
 //
 // Iter
 //
+
+namespace {
+/*
+ * The children of a folder which have not been returned yet. Only the page
+ * of them which is being read is known, straight from the memory map.
+ */
+struct ChildList {
+    const quint64* pos;
+    const quint64* end;
+    quint64 folderId;
+    bool hasPages;
+};
+
+// std::push_heap builds a max-heap, so the order is reversed
+bool laterChild(const ChildList& lhs, const ChildList& rhs)
+{
+    return *lhs.pos > *rhs.pos;
+}
+}
+
+/*
+ * Returns a folder and everything below it in the order of their ids. The
+ * children of every folder are stored sorted, so the lists of all the
+ * folders of the subtree are merged through a min-heap. Only the folders
+ * are found at the start, the files are read a page at a time as they are
+ * reached.
+ */
 class IdTreePostingIterator : public PostingIterator {
 public:
-    IdTreePostingIterator(const IdTreeDB& db, const QVector<quint64> list)
-        : m_db(db), m_pos(-1), m_idList(list) {}
+    IdTreePostingIterator(MDB_dbi dbi, MDB_txn* txn, quint64 docId)
+        : m_txn(txn), m_dbi(dbi), m_rootId(docId), m_docId(0), m_started(false) {}
 
-    quint64 docId() const {
-        if (m_pos >= 0 && m_pos < m_resultList.size())
-            return m_resultList[m_pos];
-        return 0;
+    quint64 docId() const Q_DECL_OVERRIDE {
+        return m_docId;
     }
 
-    quint64 next() {
-        if (m_resultList.isEmpty() && m_idList.isEmpty()) {
-            return 0;
+    quint64 next() Q_DECL_OVERRIDE {
+        if (!m_started) {
+            start();
         }
-
-        if (m_resultList.isEmpty()) {
-            while (!m_idList.isEmpty()) {
-                quint64 id = m_idList.takeLast();
-                m_idList << m_db.get(id);
-                m_resultList << id;
+        else if (!m_heap.isEmpty()) {
+            std::pop_heap(m_heap.begin(), m_heap.end(), laterChild);
+            ChildList& list = m_heap.last();
+            const quint64 id = *list.pos;
+            list.pos++;
+            if (list.pos != list.end || seek(list, id + 1)) {
+                std::push_heap(m_heap.begin(), m_heap.end(), laterChild);
+            } else {
+                m_heap.removeLast();
             }
-            std::sort(m_resultList.begin(), m_resultList.end());
-            m_pos = 0;
         }
-        else {
-            if (m_pos < m_resultList.size())
-                m_pos++;
-            else
-                m_resultList.clear();
+
+        m_docId = m_heap.isEmpty() ? 0 : *m_heap.first().pos;
+        return m_docId;
+    }
+
+    quint64 skipTo(quint64 id) Q_DECL_OVERRIDE {
+        if (m_docId && m_docId >= id) {
+            return m_docId;
+        }
+        if (!m_started) {
+            start();
         }
 
-        if (m_pos < m_resultList.size())
-            return m_resultList[m_pos];
-        else
-            return 0;
+        while (!m_heap.isEmpty() && *m_heap.first().pos < id) {
+            std::pop_heap(m_heap.begin(), m_heap.end(), laterChild);
+            if (seek(m_heap.last(), id)) {
+                std::push_heap(m_heap.begin(), m_heap.end(), laterChild);
+            } else {
+                m_heap.removeLast();
+            }
+        }
+
+        m_docId = m_heap.isEmpty() ? 0 : *m_heap.first().pos;
+        return m_docId;
     }
 
 private:
-    IdTreeDB m_db;
-    int m_pos;
-    QVector<quint64> m_idList;
-    QVector<quint64> m_resultList;
+    /*
+     * Finds the folders of the subtree. The keys of the database are all
+     * the folders, so the children of a folder are compared with them,
+     * jumping over the children which come before the next key.
+     */
+    void start() {
+        m_started = true;
+        m_heap << ChildList{&m_rootId, &m_rootId + 1, 0, false};
+
+        // The cursor is not kept, as the transaction might end first
+        MDB_cursor* cursor;
+        int rc = mdb_cursor_open(m_txn, m_dbi, &cursor);
+        Q_ASSERT_X(rc == 0, "IdTreePostingIterator::start", mdb_strerror(rc));
+
+        MDB_cursor* keys;
+        rc = mdb_cursor_open(m_txn, m_dbi, &keys);
+        Q_ASSERT_X(rc == 0, "IdTreePostingIterator::start", mdb_strerror(rc));
+
+        QVector<quint64> folders = {m_rootId};
+        while (!folders.isEmpty()) {
+            ChildList list = {0, 0, folders.takeLast(), true};
+            if (!seek(list, 0, cursor)) {
+                continue;
+            }
+            m_heap << list;
+
+            bool more = true;
+            while (more && list.pos != list.end) {
+                MDB_val key = {sizeof(quint64), const_cast<quint64*>(list.pos)};
+                MDB_val val;
+                rc = mdb_cursor_get(keys, &key, &val, MDB_SET_RANGE);
+                if (rc) {
+                    Q_ASSERT_X(rc == MDB_NOTFOUND, "IdTreePostingIterator::start", mdb_strerror(rc));
+                    break;
+                }
+
+                quint64 folderId = *static_cast<quint64*>(key.mv_data);
+                if (folderId == *list.pos) {
+                    folders << folderId;
+                    folderId++;
+                }
+                more = seek(list, folderId, cursor);
+            }
+        }
+
+        mdb_cursor_close(keys);
+        mdb_cursor_close(cursor);
+
+        std::make_heap(m_heap.begin(), m_heap.end(), laterChild);
+    }
+
+    /*
+     * Moves \p list to its first child >= \p id, which is read from the
+     * database if it is not on the current page. Returns false if there
+     * is none.
+     */
+    bool seek(ChildList& list, quint64 id, MDB_cursor* cursor = 0) {
+        if (list.pos != list.end && id <= *(list.end - 1)) {
+            list.pos = std::lower_bound(list.pos, list.end, id);
+            return true;
+        }
+
+        list.pos = list.end;
+        if (!list.hasPages) {
+            return false;
+        }
+
+        MDB_cursor* pageCursor = cursor;
+        if (!pageCursor) {
+            int rc = mdb_cursor_open(m_txn, m_dbi, &pageCursor);
+            Q_ASSERT_X(rc == 0, "IdTreePostingIterator::seek", mdb_strerror(rc));
+        }
+
+        MDB_val key = {sizeof(quint64), &list.folderId};
+        MDB_val val = {sizeof(quint64), &id};
+        int rc = mdb_cursor_get(pageCursor, &key, &val, MDB_GET_BOTH_RANGE);
+        if (rc == 0) {
+            rc = mdb_cursor_get(pageCursor, &key, &val, MDB_GET_MULTIPLE);
+        }
+        Q_ASSERT_X(rc == 0 || rc == MDB_NOTFOUND, "IdTreePostingIterator::seek", mdb_strerror(rc));
+
+        if (!cursor) {
+            mdb_cursor_close(pageCursor);
+        }
+        if (rc) {
+            return false;
+        }
+
+        // The page can start before the child it was found through
+        list.end = static_cast<const quint64*>(val.mv_data) + val.mv_size / sizeof(quint64);
+        list.pos = std::lower_bound(static_cast<const quint64*>(val.mv_data), list.end, id);
+        return list.pos != list.end;
+    }
+
+    MDB_txn* m_txn;
+    MDB_dbi m_dbi;
+    quint64 m_rootId;
+    quint64 m_docId;
+    bool m_started;
+
+    // The lists which have not reached their end yet
+    QVector<ChildList> m_heap;
 };
 
 PostingIterator* IdTreeDB::iter(quint64 docId)
 {
     Q_ASSERT(docId > 0);
 
-    QVector<quint64> list = {docId};
-    return new IdTreePostingIterator(*this, list);
+    return new IdTreePostingIterator(m_dbi, m_txn, docId);
 }
 
 QMap<quint64, QVector<quint64>> IdTreeDB::toTestMap() const
@@ -172,14 +497,10 @@ QMap<quint64, QVector<quint64>> IdTreeDB::toTestMap() const
         if (rc == MDB_NOTFOUND) {
             break;
         }
-        Q_ASSERT_X(rc == 0, "PostingDB::toTestMap", mdb_strerror(rc));
+        Q_ASSERT_X(rc == 0, "IdTreeDB::toTestMap", mdb_strerror(rc));
 
         const quint64 id = *(static_cast<quint64*>(key.mv_data));
-
-        QVector<quint64> list(val.mv_size / sizeof(quint64));
-        memcpy(list.data(), val.mv_data, val.mv_size);
-
-        map.insert(id, list);
+        map[id] << *(static_cast<quint64*>(val.mv_data));
     }
 
     mdb_cursor_close(cursor);
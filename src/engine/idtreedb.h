@@ -30,18 +30,50 @@ namespace Baloo {
 
 class PostingIterator;
 
+/**
+ * The IdTreeDB maps <parentId> -> <id1> <id2> ... for every folder. Each child
+ * is stored as a separate duplicate of the parent's key, so adding or removing
+ * a file does not rewrite the whole list of its folder.
+ */
 class BALOO_ENGINE_EXPORT IdTreeDB
 {
 public:
     IdTreeDB(MDB_dbi dbi, MDB_txn* txn);
 
+    /**
+     * Converts an IdTreeDB created before database version 4, which stored
+     * all the children of a folder as one value.
+     */
     static MDB_dbi create(MDB_txn* txn);
+
+    /**
+     * Returns 0 if the IdTreeDB does not exist or still needs to be
+     * converted by create()
+     */
     static MDB_dbi open(MDB_txn* txn);
 
+    /**
+     * Replaces the children of \p docId with \p subDocIds
+     */
     void put(quint64 docId, const QVector<quint64> subDocIds);
     QVector<quint64> get(quint64 docId);
     void del(quint64 docId);
 
+    /**
+     * Adds \p id to the children of \p parentId, unless it already is one
+     */
+    void add(quint64 parentId, quint64 id);
+
+    /**
+     * Removes \p id from the children of \p parentId
+     */
+    void remove(quint64 parentId, quint64 id);
+
+    /**
+     * Returns the number of children of \p docId, without reading them
+     */
+    uint childCount(quint64 docId);
+
     /**
      * Returns an iterator which will return all the docIds which use \p docId
      * are the parent docID.
@@ -0,0 +1,258 @@
+/*
+   This file is part of the KDE Baloo project.
+ * Copyright (C) 2016  Vishesh Handa <vhanda@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "levenshteinautomaton.h"
+
+#include <algorithm>
+
+using namespace Baloo;
+
+// Bytes which are not valid UTF-8 are mapped to the characters after this
+static const uint s_invalidChar = 0x110000;
+
+// Stands for any character which is not in the word
+static const uint s_otherChar = 0xFFFFFFFF;
+
+namespace {
+
+/*
+ * Decodes the UTF-8 character at \p data into \p ch and returns its length.
+ * Bytes which are not valid UTF-8 are each treated as a character of their
+ * own, outside of the unicode range.
+ */
+int decodeChar(const char* data, int size, uint* ch)
+{
+    const uchar c = data[0];
+    int len = 1;
+    uint value = c;
+    if (c >= 0xF0 && c < 0xF8) {
+        len = 4;
+        value = c & 0x07;
+    } else if (c >= 0xE0 && c < 0xF0) {
+        len = 3;
+        value = c & 0x0F;
+    } else if (c >= 0xC0 && c < 0xE0) {
+        len = 2;
+        value = c & 0x1F;
+    }
+
+    if (c >= 0x80 && (len == 1 || len > size)) {
+        *ch = s_invalidChar + c;
+        return 1;
+    }
+    for (int i = 1; i < len; i++) {
+        const uchar cont = data[i];
+        if ((cont & 0xC0) != 0x80) {
+            *ch = s_invalidChar + c;
+            return 1;
+        }
+        value = (value << 6) | (cont & 0x3F);
+    }
+
+    *ch = value;
+    return len;
+}
+
+QByteArray encodeChar(uint ch)
+{
+    QByteArray arr;
+    if (ch < 0x80) {
+        arr.append(static_cast<char>(ch));
+    } else if (ch < 0x800) {
+        arr.append(static_cast<char>(0xC0 | (ch >> 6)));
+        arr.append(static_cast<char>(0x80 | (ch & 0x3F)));
+    } else if (ch < 0x10000) {
+        arr.append(static_cast<char>(0xE0 | (ch >> 12)));
+        arr.append(static_cast<char>(0x80 | ((ch >> 6) & 0x3F)));
+        arr.append(static_cast<char>(0x80 | (ch & 0x3F)));
+    } else {
+        arr.append(static_cast<char>(0xF0 | (ch >> 18)));
+        arr.append(static_cast<char>(0x80 | ((ch >> 12) & 0x3F)));
+        arr.append(static_cast<char>(0x80 | ((ch >> 6) & 0x3F)));
+        arr.append(static_cast<char>(0x80 | (ch & 0x3F)));
+    }
+    return arr;
+}
+
+/*
+ * Returns the smallest array larger than every array starting with \p arr
+ */
+QByteArray successor(QByteArray arr)
+{
+    while (!arr.isEmpty() && static_cast<uchar>(arr.at(arr.size() - 1)) == 0xFF) {
+        arr.chop(1);
+    }
+    if (!arr.isEmpty()) {
+        arr[arr.size() - 1] = arr.at(arr.size() - 1) + 1;
+    }
+    return arr;
+}
+
+}
+
+LevenshteinAutomaton::LevenshteinAutomaton(const QByteArray& prefix, const QByteArray& word, int maxEdits)
+    : m_prefix(prefix)
+    , m_maxEdits(maxEdits)
+    , m_distance(0)
+{
+    bool valid = true;
+    int pos = 0;
+    while (pos < word.size()) {
+        uint ch;
+        pos += decodeChar(word.constData() + pos, word.size() - pos, &ch);
+        m_word << ch;
+        valid = valid && ch < s_invalidChar;
+    }
+
+    if (valid) {
+        m_alphabet = m_word;
+        std::sort(m_alphabet.begin(), m_alphabet.end());
+        m_alphabet.erase(std::unique(m_alphabet.begin(), m_alphabet.end()), m_alphabet.end());
+    }
+
+    // Before any character, reaching the i-th character of the word takes
+    // i insertions
+    for (int i = 0; i <= m_word.size(); i++) {
+        m_rows << i;
+    }
+}
+
+bool LevenshteinAutomaton::dead(const int* row) const
+{
+    for (int i = 0; i <= m_word.size(); i++) {
+        if (row[i] <= m_maxEdits) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void LevenshteinAutomaton::computeRow(const int* prev, uint ch, int* row) const
+{
+    row[0] = prev[0] + 1;
+    for (int i = 1; i <= m_word.size(); i++) {
+        const int substitution = prev[i - 1] + (m_word[i - 1] == ch ? 0 : 1);
+        row[i] = qMin(substitution, qMin(prev[i], row[i - 1]) + 1);
+    }
+}
+
+/*
+ * Finds the next term which could match after the state at \p depth turned
+ * out to be dead. A character which is not in the word leads to the same
+ * state as any other such character, and never to a better one than a
+ * character of the word. So once that state is dead, only the characters of
+ * the word need to be tried, before going back to the previous character.
+ */
+QByteArray LevenshteinAutomaton::nextCandidate(int depth) const
+{
+    // The bytes following an invalid byte may form a character together
+    // with it in other terms, so nothing can be skipped
+    for (int level = 0; level < depth; level++) {
+        if (m_chars[level] >= s_invalidChar) {
+            return m_prefix + m_term + '\0';
+        }
+    }
+
+    const int width = m_word.size() + 1;
+    QVector<int> row(width);
+
+    for (int level = depth - 1; level >= 0; level--) {
+        const int* prev = m_rows.constData() + level * width;
+        const uint ch = m_chars[level];
+
+        computeRow(prev, s_otherChar, row.data());
+        if (m_alphabet.isEmpty() || !dead(row.constData())) {
+            return successor(m_prefix + m_term.left(m_ends[level]));
+        }
+
+        for (uint next : m_alphabet) {
+            if (next <= ch) {
+                continue;
+            }
+            computeRow(prev, next, row.data());
+            if (!dead(row.constData())) {
+                const int start = level ? m_ends[level - 1] : 0;
+                return m_prefix + m_term.left(start) + encodeChar(next);
+            }
+        }
+    }
+
+    return QByteArray();
+}
+
+bool LevenshteinAutomaton::match(const QByteArray& term)
+{
+    m_skipTo.clear();
+    if (!term.startsWith(m_prefix)) {
+        return false;
+    }
+
+    const int width = m_word.size() + 1;
+    const char* data = term.constData() + m_prefix.size();
+    const int size = term.size() - m_prefix.size();
+
+    // Keep the state of the characters shared with the previous term
+    const int maxShared = qMin(size, m_term.size());
+    int shared = 0;
+    while (shared < maxShared && data[shared] == m_term.at(shared)) {
+        shared++;
+    }
+
+    // An invalid byte might be the start of a character in this term
+    int depth = 0;
+    while (depth < m_ends.size() && m_ends[depth] <= shared) {
+        if (m_ends[depth] == shared && m_chars[depth] >= s_invalidChar) {
+            break;
+        }
+        depth++;
+    }
+    m_chars.resize(depth);
+    m_ends.resize(depth);
+    m_rows.resize((depth + 1) * width);
+    m_term = QByteArray(data, size);
+
+    int pos = depth ? m_ends[depth - 1] : 0;
+    while (1) {
+        // No term continuing with these characters can match
+        if (dead(m_rows.constData() + depth * width)) {
+            m_skipTo = nextCandidate(depth);
+            return false;
+        }
+        if (pos >= size) {
+            break;
+        }
+
+        uint ch;
+        pos += decodeChar(data + pos, size - pos, &ch);
+        m_rows.resize(m_rows.size() + width);
+        computeRow(m_rows.constData() + depth * width, ch, m_rows.data() + (depth + 1) * width);
+        m_chars << ch;
+        m_ends << pos;
+        depth++;
+    }
+
+    if (m_rows.last() > m_maxEdits) {
+        // Only longer terms can still match
+        m_skipTo = term + '\0';
+        return false;
+    }
+    m_distance = m_rows.last();
+    return true;
+}
@@ -0,0 +1,93 @@
+/*
+   This file is part of the KDE Baloo project.
+ * Copyright (C) 2016  Vishesh Handa <vhanda@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef BALOO_LEVENSHTEINAUTOMATON_H
+#define BALOO_LEVENSHTEINAUTOMATON_H
+
+#include <QByteArray>
+#include <QVector>
+
+namespace Baloo {
+
+/**
+ * Accepts the terms which are within a given number of edits of a word,
+ * counting the insertions, deletions and substitutions of characters.
+ *
+ * The state of the automaton after each character of a term is kept, so
+ * feeding it terms in sorted order only walks the characters which differ
+ * from the previous term. Once no term with the characters seen so far can
+ * match anymore, skipTo() tells where the next candidate can be.
+ */
+class LevenshteinAutomaton
+{
+public:
+    /**
+     * Matches the terms which start with \p prefix, followed by a word
+     * within \p maxEdits edits of \p word
+     */
+    LevenshteinAutomaton(const QByteArray& prefix, const QByteArray& word, int maxEdits);
+
+    QByteArray prefix() const {
+        return m_prefix;
+    }
+
+    bool match(const QByteArray& term);
+
+    /**
+     * The number of edits of the last matched term
+     */
+    int distance() const {
+        return m_distance;
+    }
+
+    /**
+     * After a failed match, the smallest term after it which could still
+     * match, or an empty array if no later term can match
+     */
+    QByteArray skipTo() const {
+        return m_skipTo;
+    }
+
+private:
+    bool dead(const int* row) const;
+    void computeRow(const int* prev, uint ch, int* row) const;
+    QByteArray nextCandidate(int depth) const;
+
+    QByteArray m_prefix;
+    QVector<uint> m_word;
+    int m_maxEdits;
+
+    // The distinct characters of the word in sorted order, if it is valid UTF-8
+    QVector<uint> m_alphabet;
+
+    // The previous term without the prefix, its characters, the offset at
+    // which each of them ends, and the state after each of them
+    QByteArray m_term;
+    QVector<uint> m_chars;
+    QVector<int> m_ends;
+    QVector<int> m_rows;
+
+    int m_distance;
+    QByteArray m_skipTo;
+};
+
+}
+
+#endif // BALOO_LEVENSHTEINAUTOMATON_H
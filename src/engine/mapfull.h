@@ -0,0 +1,44 @@
+/*
+ * This file is part of the KDE Baloo project.
+ * Copyright (C) 2015  Vishesh Handa <vhanda@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef BALOO_MAP_FULL_H
+#define BALOO_MAP_FULL_H
+
+#include <lmdb.h>
+
+namespace Baloo {
+
+/**
+ * Returns true if \p rc comes from a write transaction which ran out of
+ * space in the memory map. LMDB fails the write with MDB_MAP_FULL and every
+ * later call on the same transaction with MDB_BAD_TXN.
+ *
+ * This is not a bug: Transaction::commit() grows the map and returns false,
+ * and the caller then repeats its work in a new transaction. Everything in
+ * between should give up quietly instead of asserting.
+ */
+inline bool isMapFull(int rc)
+{
+    return rc == MDB_MAP_FULL || rc == MDB_BAD_TXN;
+}
+
+}
+
+#endif // BALOO_MAP_FULL_H
@@ -0,0 +1,91 @@
+/*
+ * This file is part of the KDE Baloo project.
+ * Copyright (C) 2015  Vishesh Handa <vhanda@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "metadatadb.h"
+#include "mapfull.h"
+
+using namespace Baloo;
+
+MetadataDB::MetadataDB(MDB_dbi dbi, MDB_txn* txn)
+    : m_txn(txn)
+    , m_dbi(dbi)
+{
+    Q_ASSERT(txn != 0);
+    Q_ASSERT(dbi != 0);
+}
+
+MetadataDB::~MetadataDB()
+{
+}
+
+MDB_dbi MetadataDB::create(MDB_txn* txn)
+{
+    MDB_dbi dbi;
+    int rc = mdb_dbi_open(txn, "metadatadb", MDB_CREATE | MDB_INTEGERKEY, &dbi);
+    Q_ASSERT_X(rc == 0, "MetadataDB::create", mdb_strerror(rc));
+
+    return dbi;
+}
+
+MDB_dbi MetadataDB::open(MDB_txn* txn)
+{
+    MDB_dbi dbi;
+    int rc = mdb_dbi_open(txn, "metadatadb", MDB_INTEGERKEY, &dbi);
+    if (rc == MDB_NOTFOUND) {
+        return 0;
+    }
+    Q_ASSERT_X(rc == 0, "MetadataDB::open", mdb_strerror(rc));
+
+    return dbi;
+}
+
+quint64 MetadataDB::get(Key key)
+{
+    quint64 k = key;
+
+    MDB_val mkey;
+    mkey.mv_size = sizeof(quint64);
+    mkey.mv_data = static_cast<void*>(&k);
+
+    MDB_val val;
+    int rc = mdb_get(m_txn, m_dbi, &mkey, &val);
+    if (rc == MDB_NOTFOUND || isMapFull(rc)) {
+        return 0;
+    }
+    Q_ASSERT_X(rc == 0, "MetadataDB::get", mdb_strerror(rc));
+
+    return *(static_cast<quint64*>(val.mv_data));
+}
+
+void MetadataDB::put(Key key, quint64 value)
+{
+    quint64 k = key;
+
+    MDB_val mkey;
+    mkey.mv_size = sizeof(quint64);
+    mkey.mv_data = static_cast<void*>(&k);
+
+    MDB_val val;
+    val.mv_size = sizeof(quint64);
+    val.mv_data = static_cast<void*>(&value);
+
+    int rc = mdb_put(m_txn, m_dbi, &mkey, &val, 0);
+    Q_ASSERT_X(rc == 0 || isMapFull(rc), "MetadataDB::put", mdb_strerror(rc));
+}
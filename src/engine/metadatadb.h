@@ -0,0 +1,61 @@
+/*
+ * This file is part of the KDE Baloo project.
+ * Copyright (C) 2015  Vishesh Handa <vhanda@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef BALOO_METADATADB_H
+#define BALOO_METADATADB_H
+
+#include "engine_export.h"
+#include <QtGlobal>
+#include <lmdb.h>
+
+namespace Baloo {
+
+/**
+ * Holds counters about the database as a whole, which all the processes
+ * using it can read
+ */
+class BALOO_ENGINE_EXPORT MetadataDB
+{
+public:
+    MetadataDB(MDB_dbi dbi, MDB_txn* txn);
+    ~MetadataDB();
+
+    enum Key {
+        /// Increased by every commit which moves or removes documents
+        UrlGeneration = 1
+    };
+
+    static MDB_dbi create(MDB_txn* txn);
+    static MDB_dbi open(MDB_txn* txn);
+
+    /**
+     * Returns the value of \p key, or 0 if it was never set
+     */
+    quint64 get(Key key);
+    void put(Key key, quint64 value);
+
+private:
+    MDB_txn* m_txn;
+    MDB_dbi m_dbi;
+};
+
+}
+
+#endif // BALOO_METADATADB_H
@@ -19,6 +19,7 @@
  */
 
 #include "mtimedb.h"
+#include "mapfull.h"
 #include "vectorpostingiterator.h"
 #include <algorithm>
 
@@ -71,7 +72,7 @@ void MTimeDB::put(quint32 mtime, quint64 docId)
     val.mv_data = static_cast<void*>(&docId);
 
     int rc = mdb_put(m_txn, m_dbi, &key, &val, 0);
-    Q_ASSERT_X(rc == 0, "MTimeDB::put", mdb_strerror(rc));
+    Q_ASSERT_X(rc == 0 || isMapFull(rc), "MTimeDB::put", mdb_strerror(rc));
 }
 
 QVector<quint64> MTimeDB::get(quint32 mtime)
@@ -85,11 +86,15 @@ QVector<quint64> MTimeDB::get(quint32 mtime)
     QVector<quint64> values;
 
     MDB_cursor* cursor;
-    mdb_cursor_open(m_txn, m_dbi, &cursor);
+    int rc = mdb_cursor_open(m_txn, m_dbi, &cursor);
+    if (isMapFull(rc)) {
+        return values;
+    }
+    Q_ASSERT_X(rc == 0, "MTimeDB::get", mdb_strerror(rc));
 
     MDB_val val;
-    int rc = mdb_cursor_get(cursor, &key, &val, MDB_SET_RANGE);
-    if (rc == MDB_NOTFOUND) {
+    rc = mdb_cursor_get(cursor, &key, &val, MDB_SET_RANGE);
+    if (rc == MDB_NOTFOUND || isMapFull(rc)) {
         mdb_cursor_close(cursor);
         return values;
     }
@@ -130,7 +135,7 @@ void MTimeDB::del(quint32 mtime, quint64 docId)
     if (rc == MDB_NOTFOUND) {
         return;
     }
-    Q_ASSERT_X(rc == 0, "DocumentDB::del", mdb_strerror(rc));
+    Q_ASSERT_X(rc == 0 || isMapFull(rc), "DocumentDB::del", mdb_strerror(rc));
 }
 
 //
@@ -234,6 +239,45 @@ PostingIterator* MTimeDB::iterRange(quint32 beginTime, quint32 endTime)
     return new VectorPostingIterator(results);
 }
 
+QVector<quint64> MTimeDB::newest(const QVector<quint64>& sortedIds, int count) const
+{
+    QVector<quint64> results;
+    if (count <= 0) {
+        return results;
+    }
+
+    MDB_cursor* cursor;
+    mdb_cursor_open(m_txn, m_dbi, &cursor);
+
+    MDB_val key;
+    MDB_val val;
+    int rc = mdb_cursor_get(cursor, &key, &val, MDB_LAST);
+    while (rc == 0) {
+        const quint64 id = *static_cast<quint64*>(val.mv_data);
+        if (std::binary_search(sortedIds.constBegin(), sortedIds.constEnd(), id)) {
+            results << id;
+            if (results.size() == count) {
+                break;
+            }
+        }
+
+        rc = mdb_cursor_get(cursor, &key, &val, MDB_PREV);
+    }
+    Q_ASSERT_X(rc == 0 || rc == MDB_NOTFOUND, "MTimeDB::newest", mdb_strerror(rc));
+
+    mdb_cursor_close(cursor);
+    return results;
+}
+
+uint MTimeDB::size() const
+{
+    MDB_stat stat;
+    int rc = mdb_stat(m_txn, m_dbi, &stat);
+    Q_ASSERT_X(rc == 0, "MTimeDB::size", mdb_strerror(rc));
+
+    return stat.ms_entries;
+}
+
 QMap<quint32, quint64> MTimeDB::toTestMap() const
 {
     MDB_cursor* cursor;
@@ -56,6 +56,18 @@ public:
     PostingIterator* iter(quint32 mtime, Comparator com);
     PostingIterator* iterRange(quint32 beginTime, quint32 endTime);
 
+    /**
+     * Returns up to \p count of the \p sortedIds, the most recently modified
+     * one first. The database is read backwards from the latest mtime until
+     * enough of them have been seen.
+     */
+    QVector<quint64> newest(const QVector<quint64>& sortedIds, int count) const;
+
+    /**
+     * Returns the number of documents
+     */
+    uint size() const;
+
     QMap<quint32, quint64> toTestMap() const;
 private:
     MDB_txn* m_txn;
@@ -20,12 +20,34 @@
 
 #include "orpostingiterator.h"
 
+#include <algorithm>
+#include <cstring>
+
 using namespace Baloo;
 
+// Above this many iterators their documents are read into a list at once
+static const int s_maxHeapIterators = 1024;
+
+namespace {
+// std::push_heap builds a max-heap, so the order is reversed
+bool laterDocument(const PostingIterator* lhs, const PostingIterator* rhs)
+{
+    return lhs->docId() > rhs->docId();
+}
+}
+
 OrPostingIterator::OrPostingIterator(const QVector<PostingIterator*>& iterators)
-    : m_iterators(iterators)
+    : m_pos(-1)
+    , m_started(false)
+    , m_materialized(false)
     , m_docId(0)
 {
+    m_iterators.reserve(iterators.size());
+    for (PostingIterator* iter : iterators) {
+        if (iter) {
+            m_iterators << iter;
+        }
+    }
 }
 
 OrPostingIterator::~OrPostingIterator()
@@ -38,37 +60,175 @@ quint64 OrPostingIterator::docId() const
     return m_docId;
 }
 
-quint64 OrPostingIterator::next()
+/*
+ * Moves every iterator to its first document >= \p docId, or to its first
+ * document if \p docId is 0
+ */
+void OrPostingIterator::start(quint64 docId)
 {
-    m_docId = 0;
-    if (m_iterators.isEmpty()) {
-        return 0;
+    m_started = true;
+    if (m_iterators.size() > s_maxHeapIterators) {
+        materialize(docId);
+        return;
     }
 
-    for (auto it = m_iterators.begin(), end = m_iterators.end(); it != end; it++) {
-        PostingIterator* iter = *it;
-        if (!iter) {
-            continue;
+    m_heap.reserve(m_iterators.size());
+    for (PostingIterator* iter : m_iterators) {
+        if (docId ? iter->skipTo(docId) : iter->next()) {
+            m_heap << iter;
         }
+    }
+    std::make_heap(m_heap.begin(), m_heap.end(), laterDocument);
+}
 
-        // First or last element
-        if (iter->docId() == 0 && iter->next() == 0) {
-            delete iter;
-            *it = Q_NULLPTR;
-            continue;
+/*
+ * Reads the documents of all the iterators into m_values. Every iterator
+ * gives a sorted run, and neighbouring runs are merged in pairs until one
+ * is left, which takes O(n log k) for n documents in k lists.
+ */
+void OrPostingIterator::materialize(quint64 docId)
+{
+    m_materialized = true;
+
+    // The start of every run, and the end of the last one
+    QVector<int> runs;
+    runs.reserve(m_iterators.size() + 1);
+    for (PostingIterator* iter : m_iterators) {
+        quint64 id = docId ? iter->skipTo(docId) : iter->next();
+        if (id) {
+            runs << m_values.size();
         }
+        while (id) {
+            m_values << id;
+            id = iter->next();
+        }
+    }
+    runs << m_values.size();
+    qDeleteAll(m_iterators);
+    m_iterators.clear();
+
+    QVector<quint64> merged;
+    QVector<int> mergedRuns;
+    while (runs.size() > 2) {
+        const int runCount = runs.size() - 1;
+        merged.resize(m_values.size());
+        mergedRuns.clear();
 
-        if (iter->docId() < m_docId || m_docId == 0) {
-            m_docId = iter->docId();
+        const quint64* values = m_values.constData();
+        quint64* out = merged.data();
+        for (int i = 0; i < runCount; i += 2) {
+            const int mid = runs[i + 1];
+            const int end = i + 2 <= runCount ? runs[i + 2] : mid;
+
+            mergedRuns << out - merged.constData();
+            out = std::set_union(values + runs[i], values + mid, values + mid, values + end, out);
         }
+        mergedRuns << out - merged.constData();
+
+        merged.resize(mergedRuns.last());
+        m_values.swap(merged);
+        runs.swap(mergedRuns);
     }
+    m_pos = 0;
+}
 
-    for (auto it = m_iterators.cbegin(), end = m_iterators.cend(); it != end; it++) {
-        PostingIterator* iter = *it;
-        if (iter && iter->docId() <= m_docId) {
-            iter->next();
+quint64 OrPostingIterator::heapDocId() const
+{
+    if (m_materialized) {
+        return m_pos < m_values.size() ? m_values[m_pos] : 0;
+    }
+    return m_heap.isEmpty() ? 0 : m_heap.first()->docId();
+}
+
+quint64 OrPostingIterator::next()
+{
+    if (!m_started) {
+        start(0);
+    }
+    else if (m_materialized) {
+        if (m_pos < m_values.size()) {
+            m_pos++;
+        }
+    }
+    else {
+        // Move all the iterators which are on the current document
+        while (!m_heap.isEmpty() && m_heap.first()->docId() <= m_docId) {
+            std::pop_heap(m_heap.begin(), m_heap.end(), laterDocument);
+            if (m_heap.last()->next()) {
+                std::push_heap(m_heap.begin(), m_heap.end(), laterDocument);
+            } else {
+                m_heap.removeLast();
+            }
         }
     }
 
+    m_docId = heapDocId();
     return m_docId;
 }
+
+quint64 OrPostingIterator::skipTo(quint64 docId)
+{
+    if (m_docId && m_docId >= docId) {
+        return m_docId;
+    }
+
+    if (!m_started) {
+        start(docId);
+    }
+    else if (m_materialized) {
+        m_pos = gallopingLowerBound(m_values.constBegin() + m_pos, m_values.constEnd(), docId) - m_values.constBegin();
+    }
+    else {
+        while (!m_heap.isEmpty() && m_heap.first()->docId() < docId) {
+            std::pop_heap(m_heap.begin(), m_heap.end(), laterDocument);
+            if (m_heap.last()->skipTo(docId)) {
+                std::push_heap(m_heap.begin(), m_heap.end(), laterDocument);
+            } else {
+                m_heap.removeLast();
+            }
+        }
+    }
+
+    m_docId = heapDocId();
+    return m_docId;
+}
+
+int OrPostingIterator::nextBlock(quint64* ids, int size)
+{
+    if (!m_started) {
+        start(0);
+
+        // Nothing has been returned yet
+        m_pos = -1;
+    }
+    if (!m_materialized) {
+        return PostingIterator::nextBlock(ids, size);
+    }
+
+    const int count = qMin(size, m_values.size() - m_pos - 1);
+    if (count <= 0) {
+        m_pos = m_values.size();
+        m_docId = 0;
+        return 0;
+    }
+
+    memcpy(ids, m_values.constData() + m_pos + 1, count * sizeof(quint64));
+    m_pos += count;
+    m_docId = m_values[m_pos];
+    return count;
+}
+
+quint64 OrPostingIterator::estimatedSize() const
+{
+    if (m_materialized) {
+        return m_values.size();
+    }
+
+    // The lists may overlap, so this is an upper bound
+    quint64 size = 0;
+    for (PostingIterator* iter : m_iterators) {
+        const quint64 iterSize = iter->estimatedSize();
+        size = iterSize > ~quint64(0) - size ? ~quint64(0) : size + iterSize;
+    }
+    return size;
+}
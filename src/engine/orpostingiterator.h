@@ -26,6 +26,16 @@
 
 namespace Baloo {
 
+/**
+ * Lists the documents of any of its iterators. The iterators are kept in a
+ * min-heap on their current document, so only the ones on the document
+ * being returned are moved.
+ *
+ * When there are very many iterators, as for a prefix which matches many
+ * terms, all their documents are read into a sorted list at the start. The
+ * list takes 8 bytes per document. A bitmap would not be smaller, as the
+ * ids hold the inode above the device id and are far too sparse for it.
+ */
 class BALOO_ENGINE_EXPORT OrPostingIterator : public PostingIterator
 {
 public:
@@ -34,9 +44,25 @@ public:
 
     quint64 next() Q_DECL_OVERRIDE;
     quint64 docId() const Q_DECL_OVERRIDE;
+    quint64 skipTo(quint64 docId) Q_DECL_OVERRIDE;
+    int nextBlock(quint64* ids, int size) Q_DECL_OVERRIDE;
+    quint64 estimatedSize() const Q_DECL_OVERRIDE;
 
 private:
+    void start(quint64 docId);
+    void materialize(quint64 docId);
+    quint64 heapDocId() const;
+
     QVector<PostingIterator*> m_iterators;
+
+    // The iterators which have not reached their end yet
+    QVector<PostingIterator*> m_heap;
+
+    QVector<quint64> m_values;
+    int m_pos;
+    bool m_started;
+    bool m_materialized;
+
     quint64 m_docId;
 };
 }
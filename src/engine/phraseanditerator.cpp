@@ -26,11 +26,22 @@ using namespace Baloo;
 
 PhraseAndIterator::PhraseAndIterator(const QVector<PostingIterator*>& iterators)
     : m_iterators(iterators)
+    , m_first(0)
     , m_docId(0)
 {
     if (m_iterators.contains(0)) {
         qDeleteAll(m_iterators);
         m_iterators.clear();
+        return;
+    }
+
+    quint64 smallest = ~quint64(0);
+    for (int i = 0; i < m_iterators.size(); i++) {
+        const quint64 size = m_iterators[i]->estimatedSize();
+        if (size < smallest) {
+            smallest = size;
+            m_first = i;
+        }
     }
 }
 
@@ -93,30 +104,59 @@ quint64 PhraseAndIterator::next()
         return 0;
     }
 
-    if (m_iterators[0]->next() == 0) {
+    return findMatch(m_iterators[m_first]->next());
+}
+
+quint64 PhraseAndIterator::skipTo(quint64 docId)
+{
+    if (m_iterators.isEmpty()) {
         m_docId = 0;
         return 0;
     }
+    if (m_docId && m_docId >= docId) {
+        return m_docId;
+    }
 
-    m_docId = m_iterators[0]->docId();
+    return findMatch(m_iterators[m_first]->skipTo(docId));
+}
 
-    for (int i = 1; i < m_iterators.size(); i++) {
-        PostingIterator* iter = m_iterators[i];
-        if (iter->docId() == 0 && iter->next() == 0) {
-            m_docId = 0;
-            return 0;
+quint64 PhraseAndIterator::findMatch(quint64 candidate)
+{
+    const int size = m_iterators.size();
+
+    while (candidate) {
+        // Leapfrog until all the iterators are on the same document
+        int matched = 1;
+        int i = (m_first + 1) % size;
+        while (candidate && matched < size) {
+            PostingIterator* iter = m_iterators[i];
+            const quint64 id = iter->docId() < candidate ? iter->skipTo(candidate) : iter->docId();
+            if (id == candidate) {
+                matched++;
+            } else {
+                candidate = id;
+                matched = 1;
+            }
+            i = (i + 1) % size;
         }
 
-        iter->skipTo(m_docId);
-
-        if (m_docId != iter->docId()) {
-            return next();
+        m_docId = candidate;
+        if (!candidate || checkIfPositionsMatch()) {
+            break;
         }
+
+        candidate = m_iterators[m_first]->next();
     }
 
-    if (checkIfPositionsMatch())
-        return m_docId;
-    else
-        return next();
+    m_docId = candidate;
+    return m_docId;
 }
 
+quint64 PhraseAndIterator::estimatedSize() const
+{
+    quint64 size = m_iterators.isEmpty() ? 0 : ~quint64(0);
+    for (PostingIterator* iter : m_iterators) {
+        size = qMin(size, iter->estimatedSize());
+    }
+    return size;
+}
@@ -35,12 +35,19 @@ public:
 
     quint64 next();
     quint64 docId() const;
+    quint64 skipTo(quint64 docId);
+    quint64 estimatedSize() const;
 
 private:
+    // In the order of the words, which the positions are checked in
     QVector<PostingIterator*> m_iterators;
+
+    // The iterator with the fewest documents, which proposes the candidates
+    int m_first;
     quint64 m_docId;
 
     bool checkIfPositionsMatch();
+    quint64 findMatch(quint64 candidate);
 };
 }
 
@@ -22,6 +22,7 @@
 #include "positioncodec.h"
 #include "positioninfo.h"
 #include "postingiterator.h"
+#include "chunkedlist.h"
 
 #include <QDebug>
 
@@ -65,114 +66,134 @@ void PositionDB::put(const QByteArray& term, const QVector<PositionInfo>& list)
     Q_ASSERT(!term.isEmpty());
     Q_ASSERT(!list.isEmpty());
 
-    MDB_val key;
-    key.mv_size = term.size();
-    key.mv_data = static_cast<void*>(const_cast<char*>(term.constData()));
-
-    PositionCodec codec;
-    QByteArray data = codec.encode(list);
-
-    MDB_val val;
-    val.mv_size = data.size();
-    val.mv_data = static_cast<void*>(data.data());
-
-    int rc = mdb_put(m_txn, m_dbi, &key, &val, 0);
-    Q_ASSERT_X(rc == 0, "PositionDB::put", mdb_strerror(rc));
+    PositionChunks chunks(m_txn, m_dbi, term, PositionChunkSize);
+    chunks.replace(list);
+    chunks.write();
 }
 
 QVector<PositionInfo> PositionDB::get(const QByteArray& term)
 {
     Q_ASSERT(!term.isEmpty());
 
-    MDB_val key;
-    key.mv_size = term.size();
-    key.mv_data = static_cast<void*>(const_cast<char*>(term.constData()));
-
-    MDB_val val;
-    int rc = mdb_get(m_txn, m_dbi, &key, &val);
-    if (rc == MDB_NOTFOUND) {
-        return QVector<PositionInfo>();
-    }
-    Q_ASSERT_X(rc == 0, "PositionDB::get", mdb_strerror(rc));
-
-    QByteArray data = QByteArray::fromRawData(static_cast<char*>(val.mv_data), val.mv_size);
-
-    PositionCodec codec;
-    return codec.decode(data);
+    PositionChunks chunks(m_txn, m_dbi, term, PositionChunkSize);
+    return chunks.toList();
 }
 
 void PositionDB::del(const QByteArray& term)
 {
     Q_ASSERT(!term.isEmpty());
 
-    MDB_val key;
-    key.mv_size = term.size();
-    key.mv_data = static_cast<void*>(const_cast<char*>(term.constData()));
-
-    int rc = mdb_del(m_txn, m_dbi, &key, 0);
-    if (rc == MDB_NOTFOUND) {
-        return;
-    }
-    Q_ASSERT_X(rc == 0, "PositionDB::del", mdb_strerror(rc));
+    PositionChunks chunks(m_txn, m_dbi, term, PositionChunkSize);
+    chunks.replace(QVector<PositionInfo>());
+    chunks.write();
 }
 
 //
 // Query
 //
 
+namespace {
+struct PositionChunk {
+    quint64 lowerBound;
+    MDB_val value;
+};
+}
+Q_DECLARE_TYPEINFO(PositionChunk, Q_PRIMITIVE_TYPE);
+
+/**
+ * Iterates over the documents of a term straight from the memory map. Only
+ * the document ids are read, the positions are decoded when they are asked
+ * for, which the PhraseAndIterator only does for the documents all the
+ * words of the phrase are in.
+ */
 class DBPositionIterator : public PostingIterator {
 public:
-    DBPositionIterator(char* data, uint size)
-        : m_pos(-1)
+    DBPositionIterator(const QVector<PositionChunk>& chunks, quint64 size)
+        : m_chunks(chunks)
+        , m_chunk(-1)
+        , m_decoder(0, 0)
+        , m_size(size)
     {
-        PositionCodec codec;
-        m_vec = codec.decode(QByteArray(static_cast<char*>(data), size));
     }
 
     quint64 next() Q_DECL_OVERRIDE {
-        m_pos++;
-        if (m_pos >= m_vec.size()) {
-            return 0;
+        quint64 id = m_decoder.next();
+        while (!id && openChunk(m_chunk + 1)) {
+            id = m_decoder.next();
+        }
+        return id;
+    }
+
+    quint64 skipTo(quint64 docId) Q_DECL_OVERRIDE {
+        if (m_decoder.docId() && m_decoder.docId() >= docId) {
+            return m_decoder.docId();
+        }
+
+        // The chunks before the one which contains docId are never read
+        int chunk = qMax(m_chunk, 0);
+        while (chunk + 1 < m_chunks.size() && m_chunks[chunk + 1].lowerBound <= docId) {
+            chunk++;
+        }
+        if (chunk != m_chunk) {
+            openChunk(chunk);
         }
 
-        return m_vec[m_pos].docId;
+        quint64 id = next();
+        while (id && id < docId) {
+            id = next();
+        }
+        return id;
     }
 
     quint64 docId() const Q_DECL_OVERRIDE {
-        if (m_pos < 0 || m_pos >= m_vec.size()) {
-            return 0;
-        }
-        return m_vec[m_pos].docId;
+        return m_decoder.docId();
     }
 
     QVector<uint> positions() Q_DECL_OVERRIDE {
-        if (m_pos < 0 || m_pos >= m_vec.size()) {
-            return QVector<uint>();
-        }
-        return m_vec[m_pos].positions;
+        return m_decoder.positions();
+    }
+
+    /*
+     * Comes from the posting list of the term, which can also have documents
+     * the term has no positions in
+     */
+    quint64 estimatedSize() const Q_DECL_OVERRIDE {
+        return m_size;
     }
 
 private:
-    QVector<PositionInfo> m_vec;
-    int m_pos;
+    bool openChunk(int chunk) {
+        m_chunk = chunk;
+        if (m_chunk >= m_chunks.size()) {
+            m_chunk = m_chunks.size();
+            return false;
+        }
+
+        const MDB_val& val = m_chunks[m_chunk].value;
+        m_decoder = PositionDecoder(static_cast<const char*>(val.mv_data), val.mv_size);
+        return true;
+    }
+
+    QVector<PositionChunk> m_chunks;
+    int m_chunk;
+    PositionDecoder m_decoder;
+    quint64 m_size;
 };
 
-PostingIterator* PositionDB::iter(const QByteArray& term)
+PostingIterator* PositionDB::iter(const QByteArray& term, quint64 size)
 {
     Q_ASSERT(!term.isEmpty());
 
-    MDB_val key;
-    key.mv_size = term.size();
-    key.mv_data = static_cast<void*>(const_cast<char*>(term.constData()));
-
-    MDB_val val;
-    int rc = mdb_get(m_txn, m_dbi, &key, &val);
-    if (rc == MDB_NOTFOUND) {
+    PositionChunks chunks(m_txn, m_dbi, term, PositionChunkSize);
+    if (chunks.isEmpty()) {
         return 0;
     }
-    Q_ASSERT_X(rc == 0, "PositionDB::iter", mdb_strerror(rc));
 
-    return new DBPositionIterator(static_cast<char*>(val.mv_data), val.mv_size);
+    QVector<PositionChunk> list;
+    for (const auto& chunk : chunks.chunks()) {
+        list << PositionChunk{chunk.lowerBound, chunk.value};
+    }
+    return new DBPositionIterator(list, size);
 }
 
 QMap<QByteArray, QVector<PositionInfo>> PositionDB::toTestMap() const
@@ -191,9 +212,9 @@ QMap<QByteArray, QVector<PositionInfo>> PositionDB::toTestMap() const
         }
         Q_ASSERT_X(rc == 0, "PostingDB::toTestMap", mdb_strerror(rc));
 
-        const QByteArray ba(static_cast<char*>(key.mv_data), key.mv_size);
+        const QByteArray ba(static_cast<char*>(key.mv_data), chunkTermLength(key));
         const QVector<PositionInfo> vinfo = PositionCodec().decode(QByteArray(static_cast<char*>(val.mv_data), val.mv_size));
-        map.insert(ba, vinfo);
+        map[ba] << vinfo;
     }
 
     mdb_cursor_close(cursor);
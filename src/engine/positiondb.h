@@ -46,7 +46,13 @@ public:
     QVector<PositionInfo> get(const QByteArray& term);
     void del(const QByteArray& term);
 
-    PostingIterator* iter(const QByteArray& term);
+    /**
+     * Iterates over the documents of \p term and their positions. The
+     * chunks do not store how many documents they hold, so \p size is
+     * reported as the estimated size. The document count of the term's
+     * posting list is what should be passed, see PostingDB::termFrequency().
+     */
+    PostingIterator* iter(const QByteArray& term, quint64 size);
 
     QMap<QByteArray, QVector<PositionInfo>> toTestMap() const;
 private:
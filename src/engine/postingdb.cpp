@@ -21,14 +21,25 @@
 #include "postingdb.h"
 #include "orpostingiterator.h"
 #include "postingcodec.h"
+#include "chunkedlist.h"
+#include "mapfull.h"
+#include "termdictionary.h"
+#include "levenshteinautomaton.h"
 
 #include <QDebug>
 
+#include <algorithm>
+#include <cstring>
+
 using namespace Baloo;
 
+// The number of terms a fuzzy query gets expanded to at most
+static const int s_maxFuzzyTerms = 50;
+
 PostingDB::PostingDB(MDB_dbi dbi, MDB_txn* txn)
     : m_txn(txn)
     , m_dbi(dbi)
+    , m_termDictionary(0)
 {
     Q_ASSERT(txn != 0);
     Q_ASSERT(dbi != 0);
@@ -59,64 +70,68 @@ MDB_dbi PostingDB::open(MDB_txn* txn)
     return dbi;
 }
 
-void PostingDB::put(const QByteArray& term, const PostingList& list)
+void PostingDB::setTermDictionary(const TermDictionary* dictionary)
 {
-    Q_ASSERT(!term.isEmpty());
-    Q_ASSERT(!list.isEmpty());
+    m_termDictionary = dictionary;
+}
 
-    MDB_val key;
-    key.mv_size = term.size();
-    key.mv_data = static_cast<void*>(const_cast<char*>(term.constData()));
+TermDictionary PostingDB::termDictionary()
+{
+    MDB_cursor* cursor;
+    int rc = mdb_cursor_open(m_txn, m_dbi, &cursor);
+    Q_ASSERT_X(rc == 0, "PostingDB::termDictionary", mdb_strerror(rc));
 
-    PostingCodec codec;
-    QByteArray arr = codec.encode(list);
+    TermDictionary dictionary;
+    MDB_val key = {0, 0};
+    while (1) {
+        rc = mdb_cursor_get(cursor, &key, 0, MDB_NEXT);
+        if (rc == MDB_NOTFOUND) {
+            break;
+        }
+        Q_ASSERT_X(rc == 0, "PostingDB::termDictionary", mdb_strerror(rc));
 
-    MDB_val val;
-    val.mv_size = arr.size();
-    val.mv_data = static_cast<void*>(arr.data());
+        if (chunkTermLength(key) == static_cast<int>(key.mv_size)) {
+            dictionary.append(QByteArray(static_cast<char*>(key.mv_data), key.mv_size));
+        }
+    }
 
-    int rc = mdb_put(m_txn, m_dbi, &key, &val, 0);
-    Q_ASSERT_X(rc == 0, "PostingDB::put", mdb_strerror(rc));
+    mdb_cursor_close(cursor);
+    return dictionary;
 }
 
-PostingList PostingDB::get(const QByteArray& term)
+void PostingDB::put(const QByteArray& term, const PostingList& list)
 {
     Q_ASSERT(!term.isEmpty());
+    Q_ASSERT(!list.isEmpty());
 
-    MDB_val key;
-    key.mv_size = term.size();
-    key.mv_data = static_cast<void*>(const_cast<char*>(term.constData()));
-
-    MDB_val val;
-    int rc = mdb_get(m_txn, m_dbi, &key, &val);
-    if (rc == MDB_NOTFOUND) {
-        return PostingList();
-    }
-    Q_ASSERT_X(rc == 0, "PostingDB::get", mdb_strerror(rc));
+    PostingChunks chunks(m_txn, m_dbi, term, PostingChunkSize);
+    chunks.replace(list);
+    chunks.write();
+}
 
-    QByteArray arr = QByteArray::fromRawData(static_cast<char*>(val.mv_data), val.mv_size);
+PostingList PostingDB::get(const QByteArray& term)
+{
+    Q_ASSERT(!term.isEmpty());
 
-    PostingCodec codec;
-    return codec.decode(arr);
+    PostingChunks chunks(m_txn, m_dbi, term, PostingChunkSize);
+    return chunks.toList();
 }
 
 void PostingDB::del(const QByteArray& term)
 {
     Q_ASSERT(!term.isEmpty());
 
-    MDB_val key;
-    key.mv_size = term.size();
-    key.mv_data = static_cast<void*>(const_cast<char*>(term.constData()));
-
-    int rc = mdb_del(m_txn, m_dbi, &key, 0);
-    if (rc == MDB_NOTFOUND) {
-        return;
-    }
-    Q_ASSERT_X(rc == 0, "PostingDB::del", mdb_strerror(rc));
+    PostingChunks chunks(m_txn, m_dbi, term, PostingChunkSize);
+    chunks.replace(PostingList());
+    chunks.write();
 }
 
 QVector< QByteArray > PostingDB::fetchTermsStartingWith(const QByteArray& term)
 {
+    if (m_termDictionary) {
+        return m_termDictionary->termsStartingWith(term);
+    }
+
     MDB_val key;
     key.mv_size = term.size();
     key.mv_data = static_cast<void*>(const_cast<char*>(term.constData()));
@@ -133,69 +148,199 @@ QVector< QByteArray > PostingDB::fetchTermsStartingWith(const QByteArray& term)
         if (!arr.startsWith(term)) {
             break;
         }
-        terms << arr;
+        // Skip the additional chunks of the previous term
+        if (chunkTermLength(key) == arr.size()) {
+            terms << arr;
+        }
         rc = mdb_cursor_get(cursor, &key, 0, MDB_NEXT);
     }
-    Q_ASSERT_X(rc == 0, "PostingDB::fetchTermsStartingWith", mdb_strerror(rc));
+    if (rc != MDB_NOTFOUND) {
+        Q_ASSERT_X(rc == 0, "PostingDB::fetchTermsStartingWith", mdb_strerror(rc));
+    }
 
     mdb_cursor_close(cursor);
     return terms;
 }
 
+namespace {
+struct PostingChunk {
+    quint64 lowerBound;
+    MDB_val value;
+};
+}
+Q_DECLARE_TYPEINFO(PostingChunk, Q_PRIMITIVE_TYPE);
+
+/**
+ * Iterates over a posting list stored in LMDB. The ids are decoded one
+ * block at a time straight from the memory map, which stays valid for the
+ * lifetime of the transaction.
+ */
 class DBPostingIterator : public PostingIterator {
 public:
-    DBPostingIterator(void* data, uint size);
+    explicit DBPostingIterator(const QVector<PostingChunk>& chunks);
     quint64 docId() const Q_DECL_OVERRIDE;
     quint64 next() Q_DECL_OVERRIDE;
+    quint64 skipTo(quint64 docId) Q_DECL_OVERRIDE;
+    int nextBlock(quint64* ids, int size) Q_DECL_OVERRIDE;
+    const PostingBitmap* bitmap() const Q_DECL_OVERRIDE;
+    quint64 estimatedSize() const Q_DECL_OVERRIDE;
+    bool hasExactSize() const Q_DECL_OVERRIDE;
 
 private:
-    const QVector<quint64> m_vec;
+    bool openChunk(int chunk);
+
+    QVector<PostingChunk> m_chunks;
+    int m_chunk;
+    quint64 m_size;
+
+    PostingDecoder m_decoder;
+    quint64 m_block[PostingDecoder::MaxBlockSize];
+    int m_blockSize;
     int m_pos;
 };
 
 PostingIterator* PostingDB::iter(const QByteArray& term)
 {
-    MDB_val key;
-    key.mv_size = term.size();
-    key.mv_data = static_cast<void*>(const_cast<char*>(term.constData()));
-
-    MDB_val val;
-    int rc = mdb_get(m_txn, m_dbi, &key, &val);
-    if (rc == MDB_NOTFOUND) {
+    PostingChunks chunks(m_txn, m_dbi, term, PostingChunkSize);
+    if (chunks.isEmpty()) {
         return 0;
     }
-    Q_ASSERT_X(rc == 0, "PostingDB::iter", mdb_strerror(rc));
 
-    return new DBPostingIterator(val.mv_data, val.mv_size);
+    QVector<PostingChunk> list;
+    for (const auto& chunk : chunks.chunks()) {
+        list << PostingChunk{chunk.lowerBound, chunk.value};
+    }
+    return new DBPostingIterator(list);
 }
 
 //
 // Posting Iterator
 //
-DBPostingIterator::DBPostingIterator(void* data, uint size)
-    : m_vec(PostingCodec().decode(QByteArray(static_cast<char*>(data), size)))
+DBPostingIterator::DBPostingIterator(const QVector<PostingChunk>& chunks)
+    : m_chunks(chunks)
+    , m_chunk(-1)
+    , m_size(0)
+    , m_decoder(0, 0)
+    , m_blockSize(0)
     , m_pos(-1)
 {
+    // The header of every chunk says how many ids it holds, so the size is
+    // exact without decoding any of them
+    for (const PostingChunk& chunk : m_chunks) {
+        m_size += PostingDecoder(static_cast<const char*>(chunk.value.mv_data), chunk.value.mv_size).size();
+    }
+}
+
+bool DBPostingIterator::openChunk(int chunk)
+{
+    m_chunk = chunk;
+    if (m_chunk >= m_chunks.size()) {
+        m_chunk = m_chunks.size();
+        return false;
+    }
+
+    const MDB_val& val = m_chunks[m_chunk].value;
+    m_decoder = PostingDecoder(static_cast<const char*>(val.mv_data), val.mv_size);
+    return true;
 }
 
 quint64 DBPostingIterator::docId() const
 {
-    if (m_pos < 0 || m_pos >= m_vec.size()) {
+    if (m_pos < 0 || m_pos >= m_blockSize) {
         return 0;
     }
 
-    return m_vec[m_pos];
+    return m_block[m_pos];
 }
 
 quint64 DBPostingIterator::next()
 {
-    if (m_pos >= m_vec.size() - 1) {
-        m_pos = m_vec.size();
+    if (m_pos + 1 < m_blockSize) {
+        m_pos++;
+        return m_block[m_pos];
+    }
+
+    m_pos = 0;
+    m_blockSize = m_decoder.nextBlock(m_block);
+    while (!m_blockSize && openChunk(m_chunk + 1)) {
+        m_blockSize = m_decoder.nextBlock(m_block);
+    }
+
+    return m_blockSize ? m_block[0] : 0;
+}
+
+quint64 DBPostingIterator::skipTo(quint64 docId)
+{
+    if (m_blockSize && m_block[m_pos] >= docId) {
+        return m_block[m_pos];
+    }
+
+    // Only the block which contains docId gets decoded
+    if (!m_blockSize || m_block[m_blockSize - 1] < docId) {
+        int chunk = qMax(m_chunk, 0);
+        while (chunk + 1 < m_chunks.size() && m_chunks[chunk + 1].lowerBound <= docId) {
+            chunk++;
+        }
+        if (chunk != m_chunk) {
+            openChunk(chunk);
+        }
+
+        m_pos = 0;
+        m_blockSize = m_decoder.skipToBlock(docId, m_block);
+        while (!m_blockSize && openChunk(m_chunk + 1)) {
+            m_blockSize = m_decoder.nextBlock(m_block);
+        }
+        if (!m_blockSize) {
+            return 0;
+        }
+    }
+
+    m_pos = gallopingLowerBound(m_block + m_pos, m_block + m_blockSize, docId) - m_block;
+    return m_block[m_pos];
+}
+
+int DBPostingIterator::nextBlock(quint64* ids, int size)
+{
+    int count = 0;
+    while (count < size) {
+        if (m_pos + 1 >= m_blockSize) {
+            m_pos = -1;
+            m_blockSize = m_decoder.nextBlock(m_block);
+            while (!m_blockSize && openChunk(m_chunk + 1)) {
+                m_blockSize = m_decoder.nextBlock(m_block);
+            }
+            if (!m_blockSize) {
+                break;
+            }
+        }
+
+        // The decoded ids are copied as they are
+        const int n = qMin(size - count, m_blockSize - m_pos - 1);
+        memcpy(ids + count, m_block + m_pos + 1, n * sizeof(quint64));
+        m_pos += n;
+        count += n;
+    }
+
+    return count;
+}
+
+const PostingBitmap* DBPostingIterator::bitmap() const
+{
+    if (m_pos < 0 || m_pos >= m_blockSize || m_decoder.bitmap().isNull()) {
         return 0;
     }
 
-    m_pos++;
-    return m_vec[m_pos];
+    return &m_decoder.bitmap();
+}
+
+quint64 DBPostingIterator::estimatedSize() const
+{
+    return m_size;
+}
+
+bool DBPostingIterator::hasExactSize() const
+{
+    return true;
 }
 
 template <typename Validator>
@@ -211,24 +356,70 @@ PostingIterator* PostingDB::iter(const QByteArray& prefix, Validator validate)
     mdb_cursor_open(m_txn, m_dbi, &cursor);
 
     QVector<PostingIterator*> termIterators;
+    QVector<PostingChunk> chunks;
+    bool valid = false;
 
     MDB_val val;
     int rc = mdb_cursor_get(cursor, &key, &val, MDB_SET_RANGE);
     while (rc != MDB_NOTFOUND) {
         Q_ASSERT_X(rc == 0, "PostingDB::regexpIter", mdb_strerror(rc));
 
-        const QByteArray arr(static_cast<char*>(key.mv_data), key.mv_size);
+        const QByteArray arr(static_cast<char*>(key.mv_data), chunkTermLength(key));
         if (!arr.startsWith(prefix)) {
             break;
         }
-        if (validate(arr)) {
-            termIterators << new DBPostingIterator(val.mv_data, val.mv_size);
+
+        // The additional chunks of a term follow right after it
+        if (arr.size() == static_cast<int>(key.mv_size)) {
+            if (!chunks.isEmpty()) {
+                termIterators << new DBPostingIterator(chunks);
+                chunks.clear();
+            }
+            valid = validate(arr);
+        }
+        if (valid) {
+            chunks << PostingChunk{chunkLowerBound(key), val};
         }
         rc = mdb_cursor_get(cursor, &key, &val, MDB_NEXT);
     }
     if (rc != MDB_NOTFOUND) {
         Q_ASSERT_X(rc == 0, "PostingDB::regexpIter", mdb_strerror(rc));
     }
+    if (!chunks.isEmpty()) {
+        termIterators << new DBPostingIterator(chunks);
+    }
+
+    mdb_cursor_close(cursor);
+    if (termIterators.isEmpty()) {
+        return 0;
+    }
+    return new OrPostingIterator(termIterators);
+}
+
+/*
+ * Combines the posting lists of \p terms, which are looked up with a single
+ * cursor in sorted order
+ */
+PostingIterator* PostingDB::iter(const QVector<QByteArray>& terms)
+{
+    MDB_cursor* cursor;
+    int rc = mdb_cursor_open(m_txn, m_dbi, &cursor);
+    Q_ASSERT_X(rc == 0, "PostingDB::iter", mdb_strerror(rc));
+
+    QVector<PostingIterator*> termIterators;
+    QVector<PostingChunk> list;
+    for (const QByteArray& term : terms) {
+        PostingChunks chunks(cursor, term, PostingChunkSize);
+        if (chunks.isEmpty()) {
+            continue;
+        }
+
+        list.clear();
+        for (const auto& chunk : chunks.chunks()) {
+            list << PostingChunk{chunk.lowerBound, chunk.value};
+        }
+        termIterators << new DBPostingIterator(list);
+    }
 
     mdb_cursor_close(cursor);
     if (termIterators.isEmpty()) {
@@ -239,6 +430,10 @@ PostingIterator* PostingDB::iter(const QByteArray& prefix, Validator validate)
 
 PostingIterator* PostingDB::prefixIter(const QByteArray& prefix)
 {
+    if (m_termDictionary) {
+        return iter(m_termDictionary->termsStartingWith(prefix));
+    }
+
     auto validate = [] (const QByteArray& arr) {
         Q_UNUSED(arr);
         return true;
@@ -254,12 +449,29 @@ PostingIterator* PostingDB::regexpIter(const QRegularExpression& regexp, const Q
         return regexp.match(term).hasMatch();
     };
 
+    if (m_termDictionary) {
+        QVector<QByteArray> terms = m_termDictionary->termsStartingWith(prefix);
+        terms.erase(std::remove_if(terms.begin(), terms.end(), [&validate](const QByteArray& term) {
+            return !validate(term);
+        }), terms.end());
+        return iter(terms);
+    }
     return iter(prefix, validate);
 }
 
 PostingIterator* PostingDB::compIter(const QByteArray& prefix, const QByteArray& comVal, PostingDB::Comparator com)
 {
     Q_ASSERT(!comVal.isEmpty());
+
+    // Within the prefix the terms are sorted by the compared value
+    if (m_termDictionary) {
+        const QByteArray bound = prefix + comVal;
+        if (com == LessEqual) {
+            return iter(m_termDictionary->termsStartingWith(prefix, QByteArray(), bound));
+        }
+        return iter(m_termDictionary->termsStartingWith(prefix, bound));
+    }
+
     int prefixLen = prefix.length();
     auto validate = [prefixLen, &comVal, com] (const QByteArray& arr) {
         QByteArray term(arr.constData() + prefixLen, arr.length() - prefixLen);
@@ -268,6 +480,185 @@ PostingIterator* PostingDB::compIter(const QByteArray& prefix, const QByteArray&
     return iter(prefix, validate);
 }
 
+/*
+ * Goes through the keys starting with the prefix of \p automaton, seeking
+ * past the ones it cannot accept
+ */
+QVector<QByteArray> PostingDB::fetchTermsMatching(LevenshteinAutomaton* automaton)
+{
+    const QByteArray prefix = automaton->prefix();
+
+    MDB_cursor* cursor;
+    int rc = mdb_cursor_open(m_txn, m_dbi, &cursor);
+    Q_ASSERT_X(rc == 0, "PostingDB::fetchTermsMatching", mdb_strerror(rc));
+
+    QVector<QByteArray> terms;
+    QByteArray start = prefix;
+    MDB_val key;
+    key.mv_size = start.size();
+    key.mv_data = static_cast<void*>(start.data());
+
+    rc = mdb_cursor_get(cursor, &key, 0, start.isEmpty() ? MDB_FIRST : MDB_SET_RANGE);
+    while (rc != MDB_NOTFOUND) {
+        Q_ASSERT_X(rc == 0, "PostingDB::fetchTermsMatching", mdb_strerror(rc));
+
+        const QByteArray term(static_cast<char*>(key.mv_data), chunkTermLength(key));
+        if (!term.startsWith(prefix)) {
+            break;
+        }
+
+        if (term.size() == static_cast<int>(key.mv_size)) {
+            if (automaton->match(term)) {
+                terms << term;
+            } else {
+                start = automaton->skipTo();
+                if (start.isEmpty()) {
+                    break;
+                }
+                key.mv_size = start.size();
+                key.mv_data = static_cast<void*>(start.data());
+                rc = mdb_cursor_get(cursor, &key, 0, MDB_SET_RANGE);
+                continue;
+            }
+        }
+        rc = mdb_cursor_get(cursor, &key, 0, MDB_NEXT);
+    }
+
+    mdb_cursor_close(cursor);
+    return terms;
+}
+
+quint64 PostingDB::termFrequency(const QByteArray& term)
+{
+    MDB_cursor* cursor;
+    int rc = mdb_cursor_open(m_txn, m_dbi, &cursor);
+    Q_ASSERT_X(rc == 0, "PostingDB::termFrequency", mdb_strerror(rc));
+
+    const quint64 count = termFrequency(cursor, term);
+
+    mdb_cursor_close(cursor);
+    return count;
+}
+
+/*
+ * Returns the number of documents \p term is in, from the headers of its chunks
+ */
+quint64 PostingDB::termFrequency(MDB_cursor* cursor, const QByteArray& term)
+{
+    PostingChunks chunks(cursor, term, PostingChunkSize);
+
+    quint64 count = 0;
+    for (const auto& chunk : chunks.chunks()) {
+        count += PostingDecoder(static_cast<const char*>(chunk.value.mv_data), chunk.value.mv_size).size();
+    }
+    return count;
+}
+
+PostingIterator* PostingDB::fuzzyIter(const QByteArray& prefix, const QByteArray& word, int maxEdits)
+{
+    Q_ASSERT(!word.isEmpty());
+
+    LevenshteinAutomaton automaton(prefix, word, maxEdits);
+    QVector<QByteArray> terms;
+    if (m_termDictionary) {
+        terms = m_termDictionary->termsMatching(&automaton);
+    } else {
+        terms = fetchTermsMatching(&automaton);
+    }
+
+    if (terms.size() <= s_maxFuzzyTerms) {
+        return iter(terms);
+    }
+
+    // Prefer the closest terms, and out of those the ones in most documents
+    struct Candidate {
+        int distance;
+        quint64 frequency;
+        QByteArray term;
+    };
+
+    MDB_cursor* cursor;
+    int rc = mdb_cursor_open(m_txn, m_dbi, &cursor);
+    Q_ASSERT_X(rc == 0, "PostingDB::fuzzyIter", mdb_strerror(rc));
+
+    LevenshteinAutomaton ranker(prefix, word, maxEdits);
+    QVector<Candidate> candidates;
+    candidates.reserve(terms.size());
+    for (const QByteArray& term : terms) {
+        ranker.match(term);
+        candidates << Candidate{ranker.distance(), termFrequency(cursor, term), term};
+    }
+    mdb_cursor_close(cursor);
+
+    std::partial_sort(candidates.begin(), candidates.begin() + s_maxFuzzyTerms, candidates.end(),
+                      [](const Candidate& lhs, const Candidate& rhs) {
+        if (lhs.distance != rhs.distance) {
+            return lhs.distance < rhs.distance;
+        }
+        return lhs.frequency > rhs.frequency;
+    });
+
+    terms.clear();
+    for (int i = 0; i < s_maxFuzzyTerms; i++) {
+        terms << candidates[i].term;
+    }
+    std::sort(terms.begin(), terms.end());
+    return iter(terms);
+}
+
+void PostingDB::convertFromRawFormat()
+{
+    MDB_cursor* cursor;
+    int rc = mdb_cursor_open(m_txn, m_dbi, &cursor);
+    Q_ASSERT_X(rc == 0, "PostingDB::convertFromRawFormat", mdb_strerror(rc));
+
+    PostingCodec codec;
+    MDB_val key = {0, 0};
+    MDB_val val;
+
+    while (1) {
+        rc = mdb_cursor_get(cursor, &key, &val, MDB_NEXT);
+        if (rc == MDB_NOTFOUND || isMapFull(rc)) {
+            break;
+        }
+        Q_ASSERT_X(rc == 0, "PostingDB::convertFromRawFormat", mdb_strerror(rc));
+
+        // Chunks written by this conversion follow their term
+        if (chunkTermLength(key) != static_cast<int>(key.mv_size)) {
+            continue;
+        }
+
+        const QByteArray term(static_cast<char*>(key.mv_data), key.mv_size);
+        const PostingList list = codec.decodeRaw(QByteArray::fromRawData(static_cast<char*>(val.mv_data), val.mv_size));
+        if (list.size() <= 2 * PostingChunkSize) {
+            QByteArray arr = codec.encode(list);
+            val.mv_size = arr.size();
+            val.mv_data = static_cast<void*>(arr.data());
+
+            rc = mdb_cursor_put(cursor, &key, &val, MDB_CURRENT);
+            if (isMapFull(rc)) {
+                break;
+            }
+            Q_ASSERT_X(rc == 0, "PostingDB::convertFromRawFormat", mdb_strerror(rc));
+            continue;
+        }
+
+        PostingChunks chunks(m_txn, m_dbi, term, PostingChunkSize);
+        chunks.replace(list);
+        if (!chunks.write()) {
+            break;
+        }
+
+        // Writing might have moved the cursor
+        key.mv_size = term.size();
+        key.mv_data = static_cast<void*>(const_cast<char*>(term.constData()));
+        rc = mdb_cursor_get(cursor, &key, &val, MDB_SET);
+        Q_ASSERT_X(rc == 0, "PostingDB::convertFromRawFormat", mdb_strerror(rc));
+    }
+
+    mdb_cursor_close(cursor);
+}
+
 QMap<QByteArray, PostingList> PostingDB::toTestMap() const
 {
     MDB_cursor* cursor;
@@ -284,9 +675,9 @@ QMap<QByteArray, PostingList> PostingDB::toTestMap() const
         }
         Q_ASSERT_X(rc == 0, "PostingDB::toTestMap", mdb_strerror(rc));
 
-        const QByteArray ba(static_cast<char*>(key.mv_data), key.mv_size);
+        const QByteArray ba(static_cast<char*>(key.mv_data), chunkTermLength(key));
         const PostingList plist = PostingCodec().decode(QByteArray(static_cast<char*>(val.mv_data), val.mv_size));
-        map.insert(ba, plist);
+        map[ba] << plist;
     }
 
     mdb_cursor_close(cursor);
@@ -33,6 +33,9 @@ namespace Baloo {
 
 typedef QVector<quint64> PostingList;
 
+class TermDictionary;
+class LevenshteinAutomaton;
+
 /**
  * The PostingDB is the main database that maps <term> -> <id1> <id2> <id2> ...
  * This is used to do to lookup ids when searching for a <term>.
@@ -46,11 +49,30 @@ public:
     static MDB_dbi create(MDB_txn* txn);
     static MDB_dbi open(MDB_txn* txn);
 
+    /**
+     * Looks up the terms for prefix, regexp and range queries in
+     * \p dictionary instead of going through all the keys. The terms
+     * which were changed since it was built are missed.
+     */
+    void setTermDictionary(const TermDictionary* dictionary);
+
+    /**
+     * Reads all the terms into a TermDictionary
+     */
+    TermDictionary termDictionary();
+
     void put(const QByteArray& term, const PostingList& list);
     PostingList get(const QByteArray& term);
     void del(const QByteArray& term);
 
     PostingIterator* iter(const QByteArray& term);
+
+    /**
+     * Returns the number of documents \p term is in. Only the headers of
+     * its chunks are read.
+     */
+    quint64 termFrequency(const QByteArray& term);
+
     PostingIterator* prefixIter(const QByteArray& term);
     PostingIterator* regexpIter(const QRegularExpression& regexp, const QByteArray& prefix);
 
@@ -60,15 +82,32 @@ public:
     };
     PostingIterator* compIter(const QByteArray& prefix, const QByteArray& val, Comparator com);
 
+    /**
+     * Combines the posting lists of the terms which start with \p prefix,
+     * followed by a word within \p maxEdits edits of \p word. Only the
+     * closest and most frequent terms are used if there are too many.
+     */
+    PostingIterator* fuzzyIter(const QByteArray& prefix, const QByteArray& word, int maxEdits);
+
     QVector<QByteArray> fetchTermsStartingWith(const QByteArray& term);
 
+    /**
+     * Rewrites every posting list stored in the uncompressed format
+     * used before database version 3 with the current PostingCodec
+     */
+    void convertFromRawFormat();
+
     QMap<QByteArray, PostingList> toTestMap() const;
 private:
     template <typename Validator>
     PostingIterator* iter(const QByteArray& prefix, Validator validate);
+    PostingIterator* iter(const QVector<QByteArray>& terms);
+    QVector<QByteArray> fetchTermsMatching(LevenshteinAutomaton* automaton);
+    quint64 termFrequency(MDB_cursor* cursor, const QByteArray& term);
 
     MDB_txn* m_txn;
     MDB_dbi m_dbi;
+    const TermDictionary* m_termDictionary;
 };
 
 
@@ -28,13 +28,53 @@ PostingIterator::~PostingIterator()
 
 quint64 PostingIterator::skipTo(quint64 id)
 {
-    while (docId() && docId() < id) {
-        next();
+    while (docId() < id) {
+        if (!next()) {
+            return 0;
+        }
     }
     return docId();
 }
 
+int PostingIterator::nextBlock(quint64* ids, int size)
+{
+    int count = 0;
+    while (count < size) {
+        const quint64 id = next();
+        if (!id) {
+            break;
+        }
+        ids[count++] = id;
+    }
+    return count;
+}
+
 QVector<uint> PostingIterator::positions()
 {
     return QVector<uint>();
 }
+
+const PostingBitmap* PostingIterator::bitmap() const
+{
+    return 0;
+}
+
+bool PostingIterator::isFilter() const
+{
+    return false;
+}
+
+bool PostingIterator::contains(quint64 docId)
+{
+    return skipTo(docId) == docId;
+}
+
+quint64 PostingIterator::estimatedSize() const
+{
+    return ~quint64(0);
+}
+
+bool PostingIterator::hasExactSize() const
+{
+    return false;
+}
@@ -24,8 +24,12 @@
 #include <QVector>
 #include "engine_export.h"
 
+#include <algorithm>
+
 namespace Baloo {
 
+class PostingBitmap;
+
 /**
  * A PostingIterator is an abstract base class which can be used to iterate
  * over all the "postings" or "documents" which are particular term appears.
@@ -35,14 +39,103 @@ namespace Baloo {
 class BALOO_ENGINE_EXPORT PostingIterator
 {
 public:
+    enum {
+        // The number of ids worth asking nextBlock() for at once
+        BlockSize = 128
+    };
+
     virtual ~PostingIterator();
 
     virtual quint64 next() = 0;
     virtual quint64 docId() const = 0;
+
+    /**
+     * Advances the iterator to the first document id which is >= \p docId
+     * and returns it, or 0 if there is none. The iterator never moves
+     * backwards, and an iterator which has not been started yet is started.
+     *
+     * The default implementation calls next() in a loop.
+     */
     virtual quint64 skipTo(quint64 docId);
 
+    /**
+     * Moves over up to \p size of the next documents, writes them to \p ids
+     * and returns how many were written, or 0 if there are no more. A block
+     * may be shorter than \p size before the end has been reached.
+     *
+     * Afterwards docId() returns the last of them, or 0 if the end of the
+     * iterator was reached while reading them.
+     *
+     * The default implementation calls next() in a loop.
+     */
+    virtual int nextBlock(quint64* ids, int size);
+
     virtual QVector<uint> positions();
+
+    /**
+     * Returns the bitmap the current document was read from, if any. All
+     * the documents of the iterator which lie within the bitmap are set in
+     * it, which lets the AndPostingIterator intersect a word at a time.
+     *
+     * The default implementation returns 0.
+     */
+    virtual const PostingBitmap* bitmap() const;
+
+    /**
+     * Returns true if checking a single document with contains() is much
+     * cheaper than listing all the documents of the iterator. The
+     * AndPostingIterator then only uses it to check the documents which
+     * the other iterators agree on.
+     *
+     * The default implementation returns false.
+     */
+    virtual bool isFilter() const;
+
+    /**
+     * Returns true if \p docId is one of the documents of the iterator.
+     * It is called with increasing ids.
+     *
+     * The default implementation calls skipTo().
+     */
+    virtual bool contains(quint64 docId);
+
+    /**
+     * Returns roughly how many documents the iterator lists, without
+     * reading them. The AndPostingIterator drives the intersection from
+     * the iterator with the smallest estimate.
+     *
+     * The default implementation returns the largest possible value, so
+     * that iterators which cannot tell go last.
+     */
+    virtual quint64 estimatedSize() const;
+
+    /**
+     * Returns true if estimatedSize() is exactly the number of documents,
+     * as long as the iterator has not been moved.
+     *
+     * The default implementation returns false.
+     */
+    virtual bool hasExactSize() const;
 };
+
+/**
+ * Returns the first element in [begin, end) which is not less than \p value.
+ * It gallops forward from \p begin before binary searching, so short skips
+ * only look at a few elements while long ones stay logarithmic.
+ */
+template <typename Iterator, typename T>
+Iterator gallopingLowerBound(Iterator begin, Iterator end, const T& value)
+{
+    Iterator low = begin;
+    int step = 1;
+    while (end - low > step && *(low + step) < value) {
+        low += step;
+        step *= 2;
+    }
+
+    Iterator high = end - low > step ? low + step + 1 : end;
+    return std::lower_bound(low, high, value);
+}
 }
 
 #endif // BALOO_POSTINGITERATOR_H
@@ -32,6 +32,7 @@ using namespace Baloo;
 
 QueryParser::QueryParser()
     : m_autoExpandSize(3)
+    , m_maxEditDistance(0)
 {
 }
 
@@ -44,6 +45,16 @@ namespace {
 
         return false;
     }
+
+    /*
+     * The number of edits allowed in a word of \p length characters
+     */
+    int editDistance(int length, int maxEditDistance) {
+        if (length < 3) {
+            return 0;
+        }
+        return qMin(maxEditDistance, length < 6 ? 1 : 2);
+    }
 }
 
 EngineQuery QueryParser::parseQuery(const QString& text_, const QString& prefix)
@@ -164,6 +175,22 @@ EngineQuery QueryParser::parseQuery(const QString& text_, const QString& prefix)
         queries << phraseQueries;
         phraseQueries.clear();
     }
+
+    if (m_maxEditDistance) {
+        const int prefixSize = prefix.toUtf8().size();
+        for (EngineQuery& q : queries) {
+            if (!q.leaf()) {
+                continue;
+            }
+
+            const QByteArray word = q.term().mid(prefixSize);
+            const int edits = editDistance(QString::fromUtf8(word).size(), m_maxEditDistance);
+            if (edits) {
+                const EngineQuery fuzzy(q.term(), prefixSize, edits, q.pos());
+                q = EngineQuery({q, fuzzy}, EngineQuery::Or);
+            }
+        }
+    }
     //detect text contains CJKV or not.
     //if contain CJKV, every CJKV character should be a term.
     //according to http://stackoverflow.com/questions/1366068/whats-the-complete-range-for-chinese-characters-in-unicode
@@ -209,3 +236,8 @@ void QueryParser::setAutoExapandSize(int size)
 {
     m_autoExpandSize = size;
 }
+
+void QueryParser::setMaxEditDistance(int edits)
+{
+    m_maxEditDistance = qBound(0, edits, 2);
+}
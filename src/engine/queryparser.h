@@ -44,8 +44,19 @@ public:
      */
     void setAutoExapandSize(int size);
 
+    /**
+     * Set the number of typos, up to 2, a word outside of a phrase may
+     * contain. Every term within that many edits of the word is then matched
+     * as well. Shorter words allow fewer edits, as they would otherwise match
+     * far too many terms.
+     *
+     * By default this value is 0, which disables fuzzy matching.
+     */
+    void setMaxEditDistance(int edits);
+
 private:
     int m_autoExpandSize;
+    int m_maxEditDistance;
 };
 
 }
@@ -0,0 +1,80 @@
+/*
+   This file is part of the KDE Baloo project.
+ * Copyright (C) 2016  Vishesh Handa <vhanda@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "queryresultcache.h"
+
+using namespace Baloo;
+
+// Roughly the memory the cached results may take up
+static const int s_maxResultCacheSize = 8 * 1024 * 1024;
+
+// Rough size of a cached result, besides the ids and the key
+static const int s_resultCacheEntrySize = 64;
+
+QueryResultCache::QueryResultCache()
+    : m_results(s_maxResultCacheSize)
+    , m_txnId(0)
+{
+}
+
+/*
+ * Must be called with the mutex held. Only the transaction the results
+ * belong to may use them, and newer ones start over.
+ */
+bool QueryResultCache::isValid(MDB_txn* txn)
+{
+    const size_t txnId = mdb_txn_id(txn);
+    if (txnId > m_txnId) {
+        m_results.clear();
+        m_txnId = txnId;
+    }
+    return txnId == m_txnId;
+}
+
+bool QueryResultCache::get(MDB_txn* txn, const QByteArray& key, QVector<quint64>* ids)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!isValid(txn)) {
+        return false;
+    }
+
+    const QVector<quint64>* results = m_results.object(key);
+    if (!results) {
+        return false;
+    }
+
+    *ids = *results;
+    return true;
+}
+
+void QueryResultCache::insert(MDB_txn* txn, const QByteArray& key, const QVector<quint64>& ids)
+{
+    QMutexLocker locker(&m_mutex);
+    if (isValid(txn)) {
+        const int cost = s_resultCacheEntrySize + key.size() + ids.size() * static_cast<int>(sizeof(quint64));
+        m_results.insert(key, new QVector<quint64>(ids), cost);
+    }
+}
+
+void QueryResultCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_results.clear();
+}
@@ -0,0 +1,67 @@
+/*
+   This file is part of the KDE Baloo project.
+ * Copyright (C) 2016  Vishesh Handa <vhanda@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef BALOO_QUERYRESULTCACHE_H
+#define BALOO_QUERYRESULTCACHE_H
+
+#include "engine_export.h"
+
+#include <QByteArray>
+#include <QCache>
+#include <QMutex>
+#include <QVector>
+
+#include <lmdb.h>
+
+namespace Baloo {
+
+/**
+ * Shares the results of queries between the read transactions of a
+ * database, so that running the same query again does not need to go
+ * through the posting lists.
+ *
+ * The results belong to one LMDB transaction id, and are dropped as soon
+ * as a transaction sees a newer one, no matter which process committed it.
+ */
+class BALOO_ENGINE_EXPORT QueryResultCache
+{
+public:
+    QueryResultCache();
+
+    /**
+     * Sets \p ids to the results of the query \p key if they were cached
+     * for the read-only transaction \p txn. Returns false otherwise.
+     */
+    bool get(MDB_txn* txn, const QByteArray& key, QVector<quint64>* ids);
+    void insert(MDB_txn* txn, const QByteArray& key, const QVector<quint64>& ids);
+
+    void clear();
+
+private:
+    bool isValid(MDB_txn* txn);
+
+    QMutex m_mutex;
+    QCache<QByteArray, QVector<quint64>> m_results;
+    size_t m_txnId;
+};
+
+}
+
+#endif // BALOO_QUERYRESULTCACHE_H
@@ -0,0 +1,407 @@
+/*
+   This file is part of the KDE Baloo project.
+ * Copyright (C) 2016  Vishesh Handa <vhanda@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "termdictionary.h"
+#include "postingdb.h"
+#include "coding.h"
+#include "levenshteinautomaton.h"
+
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <iterator>
+
+using namespace Baloo;
+
+// Number of terms in each front coded block
+static const int s_blockSize = 16;
+
+// The dictionary is rebuilt once its overlay holds more terms than this,
+// and more than a sixteenth of the dictionary
+static const int s_maxOverlaySize = 4096;
+
+// The dictionary is rebuilt at most this often (msecs)
+static const int s_minRebuildInterval = 60 * 1000;
+
+namespace {
+
+/*
+ * Decodes the terms one after another, starting from the beginning of a block
+ */
+class TermReader
+{
+public:
+    TermReader(const QByteArray& data, int offset)
+        : m_ptr(data.constData() + offset)
+        , m_end(data.constData() + data.size())
+    {
+    }
+
+    bool next() {
+        if (m_ptr >= m_end) {
+            return false;
+        }
+
+        quint32 shared = 0;
+        quint32 length = 0;
+        m_ptr = getVarint32Ptr(m_ptr, m_end, &shared);
+        m_ptr = m_ptr ? getVarint32Ptr(m_ptr, m_end, &length) : 0;
+        if (!m_ptr || static_cast<quint32>(m_end - m_ptr) < length) {
+            m_ptr = m_end;
+            return false;
+        }
+
+        m_term.resize(shared);
+        m_term.append(m_ptr, length);
+        m_ptr += length;
+        return true;
+    }
+
+    const QByteArray& term() const { return m_term; }
+
+private:
+    const char* m_ptr;
+    const char* m_end;
+    QByteArray m_term;
+};
+
+int commonPrefixLength(const QByteArray& lhs, const QByteArray& rhs)
+{
+    const int size = qMin(lhs.size(), rhs.size());
+    int i = 0;
+    while (i < size && lhs[i] == rhs[i]) {
+        i++;
+    }
+    return i;
+}
+
+bool sortedContains(const QVector<QByteArray>& vec, const QByteArray& term)
+{
+    return std::binary_search(vec.constBegin(), vec.constEnd(), term);
+}
+
+/*
+ * Returns (\p vec without \p removed) with \p added, all of them sorted
+ */
+QVector<QByteArray> sortedUpdate(const QVector<QByteArray>& vec, const QVector<QByteArray>& removed,
+                                 const QVector<QByteArray>& added)
+{
+    QVector<QByteArray> remaining;
+    std::set_difference(vec.constBegin(), vec.constEnd(), removed.constBegin(), removed.constEnd(),
+                        std::back_inserter(remaining));
+
+    QVector<QByteArray> result;
+    result.reserve(remaining.size() + added.size());
+    std::set_union(remaining.constBegin(), remaining.constEnd(), added.constBegin(), added.constEnd(),
+                   std::back_inserter(result));
+    return result;
+}
+
+}
+
+TermDictionary::TermDictionary()
+    : m_count(0)
+{
+}
+
+void TermDictionary::append(const QByteArray& term)
+{
+    Q_ASSERT(m_added.isEmpty() && m_removed.isEmpty());
+    Q_ASSERT(m_count == 0 || m_lastTerm < term);
+
+    int shared = 0;
+    if (m_count % s_blockSize == 0) {
+        m_blocks << m_data.size();
+    } else {
+        shared = commonPrefixLength(m_lastTerm, term);
+    }
+
+    putVarint32(&m_data, shared);
+    putVarint32(&m_data, term.size() - shared);
+    m_data.append(term.constData() + shared, term.size() - shared);
+
+    m_lastTerm = term;
+    m_count++;
+}
+
+int TermDictionary::size() const
+{
+    return m_count + m_added.size() - m_removed.size();
+}
+
+QByteArray TermDictionary::blockTerm(int block) const
+{
+    TermReader reader(m_data, m_blocks[block]);
+    reader.next();
+    return reader.term();
+}
+
+/*
+ * Returns the last block whose first term is not larger than \p term,
+ * or -1 if there is none
+ */
+int TermDictionary::findBlock(const QByteArray& term) const
+{
+    int low = 0;
+    int high = m_blocks.size();
+    while (low < high) {
+        const int mid = (low + high) / 2;
+        if (blockTerm(mid) <= term) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low - 1;
+}
+
+bool TermDictionary::baseContains(const QByteArray& term) const
+{
+    const int block = findBlock(term);
+    if (block < 0) {
+        return false;
+    }
+
+    TermReader reader(m_data, m_blocks[block]);
+    for (int i = 0; i < s_blockSize && reader.next(); i++) {
+        if (reader.term() == term) {
+            return true;
+        }
+        if (reader.term() > term) {
+            return false;
+        }
+    }
+    return false;
+}
+
+bool TermDictionary::contains(const QByteArray& term) const
+{
+    if (sortedContains(m_added, term)) {
+        return true;
+    }
+    if (sortedContains(m_removed, term)) {
+        return false;
+    }
+    return baseContains(term);
+}
+
+/*
+ * Calls \p func with every term starting from \p start, in sorted order,
+ * until it returns false
+ */
+template <typename Functor>
+void TermDictionary::forEachTerm(const QByteArray& start, Functor func) const
+{
+    const int block = qMax(findBlock(start), 0);
+    TermReader reader(m_data, m_blocks.isEmpty() ? m_data.size() : m_blocks[block]);
+
+    bool hasBase = reader.next();
+    while (hasBase && reader.term() < start) {
+        hasBase = reader.next();
+    }
+
+    auto added = std::lower_bound(m_added.constBegin(), m_added.constEnd(), start);
+    while (hasBase || added != m_added.constEnd()) {
+        if (hasBase && (added == m_added.constEnd() || reader.term() < *added)) {
+            if (!sortedContains(m_removed, reader.term()) && !func(reader.term())) {
+                return;
+            }
+            hasBase = reader.next();
+        } else {
+            if (!func(*added)) {
+                return;
+            }
+            ++added;
+        }
+    }
+}
+
+QVector<QByteArray> TermDictionary::termsStartingWith(const QByteArray& prefix, const QByteArray& from,
+                                                      const QByteArray& to) const
+{
+    QVector<QByteArray> terms;
+    forEachTerm(from > prefix ? from : prefix, [&](const QByteArray& term) {
+        if (!term.startsWith(prefix) || (!to.isEmpty() && term > to)) {
+            return false;
+        }
+        terms << term;
+        return true;
+    });
+    return terms;
+}
+
+QVector<QByteArray> TermDictionary::termsMatching(LevenshteinAutomaton* automaton) const
+{
+    const QByteArray prefix = automaton->prefix();
+
+    QVector<QByteArray> terms;
+    QByteArray start = prefix;
+    bool seek = true;
+    while (seek) {
+        seek = false;
+
+        // Terms before the next candidate are skipped over, unless there
+        // are so many of them that looking the candidate up is faster
+        QByteArray skipTo;
+        int skipped = 0;
+        forEachTerm(start, [&](const QByteArray& term) {
+            if (!term.startsWith(prefix)) {
+                return false;
+            }
+            if (!skipTo.isEmpty() && term < skipTo) {
+                if (++skipped < s_blockSize) {
+                    return true;
+                }
+                start = skipTo;
+                seek = true;
+                return false;
+            }
+
+            if (automaton->match(term)) {
+                terms << term;
+                skipTo.clear();
+                return true;
+            }
+            skipTo = automaton->skipTo();
+            skipped = 0;
+            return !skipTo.isEmpty();
+        });
+    }
+    return terms;
+}
+
+void TermDictionary::update(const QSet<QByteArray>& added, const QSet<QByteArray>& removed)
+{
+    QVector<QByteArray> newAdded;
+    QVector<QByteArray> newRemoved;
+    QVector<QByteArray> readded;
+    QVector<QByteArray> unadded;
+
+    for (const QByteArray& term : removed) {
+        if (sortedContains(m_added, term)) {
+            unadded << term;
+        } else if (baseContains(term)) {
+            newRemoved << term;
+        }
+    }
+    for (const QByteArray& term : added) {
+        if (sortedContains(m_removed, term)) {
+            readded << term;
+        } else if (!baseContains(term)) {
+            newAdded << term;
+        }
+    }
+
+    std::sort(newAdded.begin(), newAdded.end());
+    std::sort(newRemoved.begin(), newRemoved.end());
+    std::sort(readded.begin(), readded.end());
+    std::sort(unadded.begin(), unadded.end());
+
+    m_added = sortedUpdate(m_added, unadded, newAdded);
+    m_removed = sortedUpdate(m_removed, readded, newRemoved);
+}
+
+bool TermDictionary::needsRebuild() const
+{
+    return m_added.size() + m_removed.size() > qMax(s_maxOverlaySize, m_count / 16);
+}
+
+//
+// Cache
+//
+TermDictionaryCache::TermDictionaryCache()
+    : m_txnId(0)
+    , m_building(false)
+{
+}
+
+QSharedPointer<const TermDictionary> TermDictionaryCache::get(MDB_txn* txn)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // Older transactions cannot use the dictionary
+    if (mdb_txn_id(txn) < m_txnId) {
+        return QSharedPointer<const TermDictionary>();
+    }
+    return m_dictionary;
+}
+
+bool TermDictionaryCache::startBuild(MDB_txn* txn)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_building) {
+        return false;
+    }
+
+    // A database which is being indexed by another process is not scanned
+    // for every one of its commits
+    if (m_dictionary) {
+        const size_t txnId = mdb_txn_id(txn);
+        if (txnId < m_txnId || (txnId == m_txnId && !m_dictionary->needsRebuild())) {
+            return false;
+        }
+        if (m_buildTimer.isValid() && m_buildTimer.elapsed() < s_minRebuildInterval) {
+            return false;
+        }
+    }
+
+    m_building = true;
+    m_buildTimer.start();
+    return true;
+}
+
+void TermDictionaryCache::finishBuild(size_t txnId, const QSharedPointer<const TermDictionary>& dictionary)
+{
+    QMutexLocker locker(&m_mutex);
+    m_building = false;
+
+    if (!m_dictionary || txnId >= m_txnId) {
+        m_dictionary = dictionary;
+        m_txnId = txnId;
+    }
+}
+
+void TermDictionaryCache::update(size_t txnId, const QSet<QByteArray>& added, const QSet<QByteArray>& removed)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_dictionary) {
+        return;
+    }
+
+    // Another process wrote in between
+    if (m_txnId + 1 != txnId) {
+        m_dictionary.clear();
+        return;
+    }
+
+    // Only the overlay is copied, the blocks are shared
+    if (!added.isEmpty() || !removed.isEmpty()) {
+        TermDictionary* dict = new TermDictionary(*m_dictionary);
+        dict->update(added, removed);
+        m_dictionary = QSharedPointer<const TermDictionary>(dict);
+    }
+    m_txnId = txnId;
+}
+
+void TermDictionaryCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_dictionary.clear();
+}
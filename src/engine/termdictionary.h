@@ -0,0 +1,163 @@
+/*
+   This file is part of the KDE Baloo project.
+ * Copyright (C) 2016  Vishesh Handa <vhanda@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef BALOO_TERMDICTIONARY_H
+#define BALOO_TERMDICTIONARY_H
+
+#include "engine_export.h"
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QSet>
+#include <QSharedPointer>
+#include <QVector>
+
+#include <lmdb.h>
+
+namespace Baloo {
+
+class LevenshteinAutomaton;
+
+/**
+ * A compact, sorted list of all the terms of the PostingDB.
+ *
+ * The terms are front coded in blocks, so that looking up all the terms
+ * in a range only needs a binary search over the blocks, without touching
+ * the posting lists. Changes are kept in a sorted overlay, until the
+ * dictionary is built again.
+ *
+ * The blocks are implicitly shared, so updating a copy of a dictionary
+ * only copies its overlay.
+ */
+class BALOO_ENGINE_EXPORT TermDictionary
+{
+public:
+    TermDictionary();
+
+    /**
+     * Adds \p term to the end of the dictionary. The terms need to be
+     * appended in sorted order.
+     */
+    void append(const QByteArray& term);
+
+    int size() const;
+    bool contains(const QByteArray& term) const;
+
+    /**
+     * Returns all the terms starting with \p prefix in sorted order. Terms
+     * before \p from or after \p to are skipped, if those are not empty.
+     */
+    QVector<QByteArray> termsStartingWith(const QByteArray& prefix,
+                                          const QByteArray& from = QByteArray(),
+                                          const QByteArray& to = QByteArray()) const;
+
+    /**
+     * Returns all the terms accepted by \p automaton in sorted order. Only the
+     * terms which can still be accepted are visited.
+     */
+    QVector<QByteArray> termsMatching(LevenshteinAutomaton* automaton) const;
+
+    /**
+     * Adds the \p added terms and removes the \p removed ones
+     */
+    void update(const QSet<QByteArray>& added, const QSet<QByteArray>& removed);
+
+    /**
+     * Returns true once the overlay has grown large enough to slow down
+     * the lookups, and the dictionary should be built again
+     */
+    bool needsRebuild() const;
+
+private:
+    template <typename Functor>
+    void forEachTerm(const QByteArray& start, Functor func) const;
+
+    int findBlock(const QByteArray& term) const;
+    QByteArray blockTerm(int block) const;
+    bool baseContains(const QByteArray& term) const;
+
+    QByteArray m_data;
+    QVector<int> m_blocks;
+    int m_count;
+    QByteArray m_lastTerm;
+
+    QVector<QByteArray> m_added;
+    QVector<QByteArray> m_removed;
+};
+
+/**
+ * Shares the TermDictionary of a database between its read transactions.
+ *
+ * The dictionary belongs to one LMDB transaction id. Commits of this
+ * process update it. It is built again in the background, at most once
+ * every so often, when other processes changed the database or when it
+ * has gathered too many changes. Queries use the old one meanwhile.
+ */
+class BALOO_ENGINE_EXPORT TermDictionaryCache
+{
+public:
+    TermDictionaryCache();
+
+    /**
+     * Returns the dictionary for the read-only transaction \p txn, or null
+     * if none is available right now. The PostingDB needs to be used then.
+     *
+     * A newer transaction gets the dictionary of an older one until the new
+     * dictionary has been built, see startBuild(). It lacks the terms which
+     * other processes changed in between.
+     */
+    QSharedPointer<const TermDictionary> get(MDB_txn* txn);
+
+    /**
+     * Returns true if a new dictionary should be built from the read-only
+     * transaction \p txn, and then expects finishBuild() to be called. Only
+     * one is built at a time.
+     */
+    bool startBuild(MDB_txn* txn);
+
+    /**
+     * Takes over \p dictionary, which was built from the transaction
+     * \p txnId, unless the current one has been updated past it
+     */
+    void finishBuild(size_t txnId, const QSharedPointer<const TermDictionary>& dictionary);
+
+    /**
+     * Applies the term changes of the write transaction \p txnId, which
+     * has just been committed
+     */
+    void update(size_t txnId, const QSet<QByteArray>& added, const QSet<QByteArray>& removed);
+
+    /**
+     * Drops the dictionary after terms were changed without being tracked
+     */
+    void clear();
+
+private:
+    QMutex m_mutex;
+    QSharedPointer<const TermDictionary> m_dictionary;
+    size_t m_txnId;
+    bool m_building;
+    QElapsedTimer m_buildTimer;
+};
+
+}
+
+#endif // BALOO_TERMDICTIONARY_H
@@ -26,6 +26,7 @@
 #include "positiondb.h"
 #include "documentdatadb.h"
 #include "mtimedb.h"
+#include "filenametrigramdb.h"
 
 #include "document.h"
 #include "enginequery.h"
@@ -35,23 +36,39 @@
 #include "phraseanditerator.h"
 
 #include "writetransaction.h"
+#include "bulkloader.h"
 #include "idutils.h"
 #include "database.h"
 #include "databasesize.h"
+#include "mapfull.h"
+#include "termdictionary.h"
 
 #include <QFile>
 #include <QFileInfo>
+#include <QMutexLocker>
+#include <QPair>
+
+#include <algorithm>
 
 using namespace Baloo;
 
 Transaction::Transaction(const Database& db, Transaction::TransactionType type)
-    : m_dbis(db.m_dbis)
+    : m_db(db)
+    , m_dbis(db.m_dbis)
     , m_env(db.m_env)
     , m_writeTrans(0)
+    , m_suspended(false)
 {
-    uint flags = type == ReadOnly ? MDB_RDONLY : 0;
-    int rc = mdb_txn_begin(db.m_env, NULL, flags, &m_txn);
-    Q_ASSERT_X(rc == 0, "Transaction", mdb_strerror(rc));
+    // The memory map can only grow while no transaction is open
+    if (type == ReadWrite) {
+        db.growMapSize(0, false);
+    }
+
+    Q_ASSERT_X(!db.m_threadTransactions.localData(), "Transaction",
+               "A thread can only hold one transaction, see Database::m_mapLock");
+    db.m_mapLock.lockForRead();
+    begin(type == ReadOnly ? MDB_RDONLY : 0);
+    db.m_threadTransactions.localData()++;
 
     if (type == ReadWrite) {
         m_writeTrans = new WriteTransaction(m_dbis, m_txn);
@@ -68,11 +85,36 @@ Transaction::~Transaction()
     if (m_writeTrans)
         qWarning() << "Closing an active WriteTransaction without calling abort/commit";
 
-    if (m_txn) {
+    if (m_suspended) {
+        // The transaction might have been ended by a growing database
+        QMutexLocker locker(&m_db.m_suspendedLock);
+        m_db.m_suspendedTransactions.remove(this);
+        if (m_txn) {
+            mdb_txn_abort(m_txn);
+        }
+    }
+    else if (m_txn) {
         abort();
     }
 }
 
+/*
+ * Begins the LMDB transaction, with m_mapLock held for reading
+ */
+void Transaction::begin(uint flags)
+{
+    int rc = mdb_txn_begin(m_env, NULL, flags, &m_txn);
+    if (rc == MDB_MAP_RESIZED) {
+        // Another process has grown the database past our memory map
+        m_db.m_mapLock.unlock();
+        m_db.adoptMapSize();
+        m_db.m_mapLock.lockForRead();
+
+        rc = mdb_txn_begin(m_env, NULL, flags, &m_txn);
+    }
+    Q_ASSERT_X(rc == 0, "Transaction", mdb_strerror(rc));
+}
+
 bool Transaction::hasDocument(quint64 id) const
 {
     Q_ASSERT(id > 0);
@@ -100,7 +142,12 @@ QByteArray Transaction::documentUrl(quint64 id) const
     Q_ASSERT(m_txn);
     Q_ASSERT(id > 0);
 
-    DocumentUrlDB docUrlDb(m_dbis.idTreeDbi, m_dbis.idFilenameDbi, m_txn);
+    DocumentUrlDB docUrlDb(m_dbis.idTreeDbi, m_dbis.idFilenameDbi, m_dbis.fileNameIdDbi, m_txn);
+
+    // The cache does not know about the changes of a write transaction
+    if (!m_writeTrans) {
+        docUrlDb.setUrlCache(&m_db.m_urlCache);
+    }
     return docUrlDb.get(id);
 }
 
@@ -109,7 +156,7 @@ quint64 Transaction::documentId(const QByteArray& path) const
     Q_ASSERT(m_txn);
     Q_ASSERT(!path.isEmpty());
 
-    DocumentUrlDB docUrlDb(m_dbis.idTreeDbi, m_dbis.idFilenameDbi, m_txn);
+    DocumentUrlDB docUrlDb(m_dbis.idTreeDbi, m_dbis.idFilenameDbi, m_dbis.fileNameIdDbi, m_txn);
     QList<QByteArray> li = path.split('/');
 
     quint64 parentId = 0;
@@ -135,6 +182,62 @@ DocumentTimeDB::TimeInfo Transaction::documentTimeInfo(quint64 id) const
     return docTimeDb.get(id);
 }
 
+QVector<quint64> Transaction::newestDocuments(const QVector<quint64>& ids, int count) const
+{
+    Q_ASSERT(m_txn);
+
+    if (count < 0 || count > ids.size()) {
+        count = ids.size();
+    }
+    if (count == 0) {
+        return QVector<quint64>();
+    }
+
+    // Going backwards through the MTimeDB finds them after reading about
+    // count * size / ids.size() documents, as opposed to looking up the
+    // mtime of every one of the ids
+    MTimeDB mtimeDb(m_dbis.mtimeDbi, m_txn);
+    const quint64 expectedReads = static_cast<quint64>(count) * mtimeDb.size() / ids.size();
+    if (expectedReads < static_cast<quint64>(ids.size())) {
+        QVector<quint64> results = mtimeDb.newest(ids, count);
+
+        // Documents without an mtime are not in the MTimeDB
+        if (results.size() == count) {
+            return results;
+        }
+    }
+
+    // Keep the newest ones seen so far in a heap, with the oldest on top
+    typedef QPair<quint32, quint64> Entry;
+    auto newer = [](const Entry& lhs, const Entry& rhs) {
+        return lhs > rhs;
+    };
+
+    DocumentTimeDB docTimeDb(m_dbis.docTimeDbi, m_txn);
+    QVector<Entry> heap;
+    heap.reserve(count);
+
+    for (quint64 id : ids) {
+        const Entry entry(docTimeDb.get(id).mTime, id);
+        if (heap.size() < count) {
+            heap << entry;
+            std::push_heap(heap.begin(), heap.end(), newer);
+        } else if (newer(entry, heap.first())) {
+            std::pop_heap(heap.begin(), heap.end(), newer);
+            heap.last() = entry;
+            std::push_heap(heap.begin(), heap.end(), newer);
+        }
+    }
+    std::sort_heap(heap.begin(), heap.end(), newer);
+
+    QVector<quint64> results;
+    results.reserve(heap.size());
+    for (const Entry& entry : heap) {
+        results << entry.second;
+    }
+    return results;
+}
+
 QByteArray Transaction::documentData(quint64 id) const
 {
     Q_ASSERT(m_txn);
@@ -144,6 +247,13 @@ QByteArray Transaction::documentData(quint64 id) const
     return docDataDb.get(id);
 }
 
+bool Transaction::isFull() const
+{
+    Q_ASSERT(m_txn);
+    Q_ASSERT(m_writeTrans);
+    return m_writeTrans->isFull();
+}
+
 bool Transaction::hasChanges() const
 {
     Q_ASSERT(m_txn);
@@ -151,6 +261,14 @@ bool Transaction::hasChanges() const
     return m_writeTrans->hasChanges();
 }
 
+void Transaction::setMemoryBudget(qint64 bytes)
+{
+    Q_ASSERT(m_txn);
+    Q_ASSERT(m_writeTrans);
+
+    m_writeTrans->setMemoryBudget(bytes);
+}
+
 QVector<quint64> Transaction::fetchPhaseOneIds(int size) const
 {
     Q_ASSERT(m_txn);
@@ -164,10 +282,26 @@ QVector<QByteArray> Transaction::fetchTermsStartingWith(const QByteArray& term)
 {
     Q_ASSERT(term.size() > 0);
 
+    const QSharedPointer<const TermDictionary> dictionary = termDictionary();
+
     PostingDB postingDb(m_dbis.postingDbi, m_txn);
+    postingDb.setTermDictionary(dictionary.data());
     return postingDb.fetchTermsStartingWith(term);
 }
 
+QSharedPointer<const TermDictionary> Transaction::termDictionary() const
+{
+    // The dictionary does not know about the changes of a write transaction
+    if (m_writeTrans) {
+        return QSharedPointer<const TermDictionary>();
+    }
+
+    if (m_db.m_termDictionary.startBuild(m_txn)) {
+        m_db.startTermDictionaryBuild();
+    }
+    return m_db.m_termDictionary.get(m_txn);
+}
+
 uint Transaction::phaseOneSize() const
 {
     Q_ASSERT(m_txn);
@@ -217,6 +351,39 @@ void Transaction::addFailed(quint64 id)
     failedIdDb.put(id);
 }
 
+void Transaction::clear()
+{
+    Q_ASSERT(m_txn);
+    Q_ASSERT(m_writeTrans);
+
+    m_writeTrans->clear();
+}
+
+void Transaction::upgradePostingDb()
+{
+    Q_ASSERT(m_txn);
+    Q_ASSERT(m_writeTrans);
+
+    PostingDB postingDb(m_dbis.postingDbi, m_txn);
+    postingDb.convertFromRawFormat();
+}
+
+void Transaction::setBulkLoader(BulkLoader* loader)
+{
+    Q_ASSERT(m_txn);
+    Q_ASSERT(m_writeTrans);
+
+    m_writeTrans->setBulkLoader(loader);
+}
+
+bool Transaction::writeBulkLoad(BulkLoader* loader)
+{
+    Q_ASSERT(m_txn);
+    Q_ASSERT(m_writeTrans);
+
+    return m_writeTrans->writeBulkLoad(loader);
+}
+
 void Transaction::addDocument(const Document& doc)
 {
     Q_ASSERT(m_txn);
@@ -249,37 +416,106 @@ void Transaction::replaceDocument(const Document& doc, DocumentOperations operat
     Q_ASSERT(m_txn);
     Q_ASSERT(doc.id() > 0);
     Q_ASSERT(m_writeTrans);
-    Q_ASSERT_X(hasDocument(doc.id()), "Transaction::replaceDocument", "Document does not exist");
+    Q_ASSERT_X(isFull() || hasDocument(doc.id()), "Transaction::replaceDocument", "Document does not exist");
 
     m_writeTrans->replaceDocument(doc, operations);
 }
 
-void Transaction::commit()
+bool Transaction::commit()
 {
     Q_ASSERT(m_txn);
     Q_ASSERT(m_writeTrans);
 
     m_writeTrans->commit();
+    const WriteTransaction::TermChanges termChanges = m_writeTrans->termChanges();
+    const bool urlsChanged = m_writeTrans->urlsChanged();
     delete m_writeTrans;
     m_writeTrans = 0;
 
+    MDB_envinfo info;
+    mdb_env_info(m_env, &info);
+
+    const size_t txnId = mdb_txn_id(m_txn);
     int rc = mdb_txn_commit(m_txn);
+    m_txn = 0;
+    m_db.m_mapLock.unlock();
+    m_db.m_threadTransactions.localData()--;
+
+    // A write which ran out of space leaves the transaction in an error
+    // state, so committing it fails with MDB_BAD_TXN
+    if (isMapFull(rc)) {
+        qWarning() << "The database ran out of space:" << mdb_strerror(rc);
+        m_db.growMapSize(info.me_mapsize, true);
+        return false;
+    }
     Q_ASSERT_X(rc == 0, "Transaction::commit", mdb_strerror(rc));
+    if (rc) {
+        return false;
+    }
 
-    m_txn = 0;
+    if (termChanges.unknown) {
+        m_db.m_termDictionary.clear();
+    } else {
+        m_db.m_termDictionary.update(txnId, termChanges.added, termChanges.removed);
+    }
+    m_db.m_urlCache.update(txnId, urlsChanged);
+    return true;
 }
 
 void Transaction::abort()
 {
     Q_ASSERT(m_txn);
+    Q_ASSERT(!m_suspended);
 
     mdb_txn_abort(m_txn);
     m_txn = 0;
+    m_db.m_mapLock.unlock();
+    m_db.m_threadTransactions.localData()--;
 
     delete m_writeTrans;
     m_writeTrans = 0;
 }
 
+void Transaction::suspend()
+{
+    Q_ASSERT(m_txn);
+    Q_ASSERT(!m_writeTrans);
+    Q_ASSERT(!m_suspended);
+
+    {
+        QMutexLocker locker(&m_db.m_suspendedLock);
+        m_db.m_suspendedTransactions.insert(this);
+    }
+    m_suspended = true;
+    m_db.m_threadTransactions.localData()--;
+    m_db.m_mapLock.unlock();
+}
+
+bool Transaction::resume()
+{
+    Q_ASSERT(m_suspended);
+    Q_ASSERT_X(!m_db.m_threadTransactions.localData(), "Transaction::resume",
+               "A thread can only hold one transaction, see Database::m_mapLock");
+
+    // The memory map does not change while the lock is held, so the
+    // transaction stays as it is found here
+    m_db.m_mapLock.lockForRead();
+
+    bool ended;
+    {
+        QMutexLocker locker(&m_db.m_suspendedLock);
+        m_db.m_suspendedTransactions.remove(this);
+        ended = !m_txn;
+    }
+    m_suspended = false;
+
+    if (ended) {
+        begin(MDB_RDONLY);
+    }
+    m_db.m_threadTransactions.localData()++;
+    return !ended;
+}
+
 //
 // Queries
 //
@@ -293,7 +529,22 @@ PostingIterator* Transaction::postingIterator(const EngineQuery& query) const
         if (query.op() == EngineQuery::Equal) {
             return postingDb.iter(query.term());
         } else if (query.op() == EngineQuery::StartsWith) {
+            const QSharedPointer<const TermDictionary> dictionary = termDictionary();
+            postingDb.setTermDictionary(dictionary.data());
             return postingDb.prefixIter(query.term());
+        } else if (query.op() == EngineQuery::Fuzzy) {
+            const QSharedPointer<const TermDictionary> dictionary = termDictionary();
+            postingDb.setTermDictionary(dictionary.data());
+
+            const QByteArray prefix = query.term().left(query.prefixSize());
+            const QByteArray word = query.term().mid(query.prefixSize());
+            return postingDb.fuzzyIter(prefix, word, query.maxEdits());
+        } else if (query.op() == EngineQuery::Substring) {
+            if (!m_dbis.fileNameTrigramDbi) {
+                return 0;
+            }
+            FilenameTrigramDB trigramDb(m_dbis.fileNameTrigramDbi, m_txn);
+            return trigramDb.iter(query.term(), m_dbis.idFilenameDbi);
         } else {
             Q_ASSERT(0);
         }
@@ -309,7 +560,7 @@ PostingIterator* Transaction::postingIterator(const EngineQuery& query) const
     if (query.op() == EngineQuery::Phrase) {
         for (const EngineQuery& q : query.subQueries()) {
             Q_ASSERT_X(q.leaf(), "Transaction::toPostingIterator", "Phrase queries must contain leaf queries");
-            vec << positionDb.iter(q.term());
+            vec << positionDb.iter(q.term(), postingDb.termFrequency(q.term()));
         }
 
         return new PhraseAndIterator(vec);
@@ -331,7 +582,10 @@ PostingIterator* Transaction::postingIterator(const EngineQuery& query) const
 
 PostingIterator* Transaction::postingCompIterator(const QByteArray& prefix, const QByteArray& value, PostingDB::Comparator com) const
 {
+    const QSharedPointer<const TermDictionary> dictionary = termDictionary();
+
     PostingDB postingDb(m_dbis.postingDbi, m_txn);
+    postingDb.setTermDictionary(dictionary.data());
     return postingDb.compIter(prefix, value, com);
 }
 
@@ -349,7 +603,7 @@ PostingIterator* Transaction::mTimeRangeIter(quint32 beginTime, quint32 endTime)
 
 PostingIterator* Transaction::docUrlIter(quint64 id) const
 {
-    DocumentUrlDB docUrlDb(m_dbis.idTreeDbi, m_dbis.idFilenameDbi, m_txn);
+    DocumentUrlDB docUrlDb(m_dbis.idTreeDbi, m_dbis.idFilenameDbi, m_dbis.fileNameIdDbi, m_txn);
     return docUrlDb.iter(id);
 }
 
@@ -363,14 +617,46 @@ QVector<quint64> Transaction::exec(const EngineQuery& query, int limit) const
         return results;
     }
 
-    while (it->next() && limit) {
-        results << it->docId();
-        limit--;
+    quint64 block[PostingIterator::BlockSize];
+    while (limit) {
+        const int size = limit > 0 ? qMin(limit, static_cast<int>(PostingIterator::BlockSize)) : PostingIterator::BlockSize;
+        const int count = it->nextBlock(block, size);
+        if (!count) {
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            results << block[i];
+        }
+        if (limit > 0) {
+            limit -= count;
+        }
     }
 
+    delete it;
     return results;
 }
 
+bool Transaction::cachedQueryResults(const QByteArray& key, QVector<quint64>* ids) const
+{
+    Q_ASSERT(m_txn);
+
+    if (m_writeTrans) {
+        return false;
+    }
+    return m_db.m_resultCache.get(m_txn, key, ids);
+}
+
+void Transaction::cacheQueryResults(const QByteArray& key, const QVector<quint64>& ids) const
+{
+    Q_ASSERT(m_txn);
+
+    // The changes of a write transaction might still be aborted
+    if (!m_writeTrans) {
+        m_db.m_resultCache.insert(m_txn, key, ids);
+    }
+}
+
 //
 // Introspection
 //
@@ -421,6 +707,7 @@ DatabaseSize Transaction::dbSize()
 
     dbSize.idTree = dbiSize(m_txn, m_dbis.idTreeDbi);
     dbSize.idFilename = dbiSize(m_txn, m_dbis.idFilenameDbi);
+    dbSize.fileNameId = m_dbis.fileNameIdDbi ? dbiSize(m_txn, m_dbis.fileNameIdDbi) : 0;
 
     dbSize.docTime = dbiSize(m_txn, m_dbis.docTimeDbi);
     dbSize.docData = dbiSize(m_txn, m_dbis.docDataDbi);
@@ -429,14 +716,22 @@ DatabaseSize Transaction::dbSize()
     dbSize.failedIds = dbiSize(m_txn, m_dbis.failedIdDbi);
 
     dbSize.mtimeDb = dbiSize(m_txn, m_dbis.mtimeDbi);
+    dbSize.fileNameTrigrams = m_dbis.fileNameTrigramDbi ? dbiSize(m_txn, m_dbis.fileNameTrigramDbi) : 0;
 
     dbSize.expectedSize = dbSize.positionDb + dbSize.positionDb + dbSize.docTerms + dbSize.docFilenameTerms
                   + dbSize.docXattrTerms + dbSize.idTree + dbSize.idFilename + dbSize.docTime
-                  + dbSize.docData + dbSize.contentIndexingIds + dbSize.failedIds + dbSize.mtimeDb;
+                  + dbSize.docData + dbSize.contentIndexingIds + dbSize.failedIds + dbSize.mtimeDb
+                  + dbSize.fileNameId + dbSize.fileNameTrigrams;
 
     MDB_envinfo info;
     mdb_env_info(m_env, &info);
-    dbSize.actualSize = info.me_last_pgno * 4096; // TODO: separate page size
+
+    MDB_stat stat;
+    mdb_env_stat(m_env, &stat);
+
+    dbSize.actualSize = info.me_last_pgno * stat.ms_psize;
+    dbSize.mapSize = info.me_mapsize;
+    dbSize.headroom = info.me_mapsize - static_cast<size_t>(info.me_last_pgno + 1) * stat.ms_psize;
 
     return dbSize;
 }
@@ -449,7 +744,7 @@ void Transaction::checkFsTree()
     DocumentDB documentTermsDB(m_dbis.docTermsDbi, m_txn);
     DocumentDB documentXattrTermsDB(m_dbis.docXattrTermsDbi, m_txn);
     DocumentDB documentFileNameTermsDB(m_dbis.docFilenameTermsDbi, m_txn);
-    DocumentUrlDB docUrlDb(m_dbis.idTreeDbi, m_dbis.idFilenameDbi, m_txn);
+    DocumentUrlDB docUrlDb(m_dbis.idTreeDbi, m_dbis.idFilenameDbi, m_dbis.fileNameIdDbi, m_txn);
     PostingDB postingDb(m_dbis.postingDbi, m_txn);
 
     auto map = postingDb.toTestMap();
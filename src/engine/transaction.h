@@ -27,6 +27,7 @@
 #include "writetransaction.h"
 #include "documenttimedb.h"
 
+#include <QSharedPointer>
 #include <QString>
 #include <lmdb.h>
 
@@ -38,6 +39,8 @@ class PostingIterator;
 class EngineQuery;
 class DatabaseSize;
 class DBState;
+class BulkLoader;
+class TermDictionary;
 
 class BALOO_ENGINE_EXPORT Transaction
 {
@@ -67,8 +70,27 @@ public:
 
     DocumentTimeDB::TimeInfo documentTimeInfo(quint64 id) const;
 
+    /**
+     * Returns the \p count most recently modified documents of \p ids, which
+     * have to be sorted, newest first. All of them are ordered if \p count
+     * is negative.
+     */
+    QVector<quint64> newestDocuments(const QVector<quint64>& ids, int count) const;
+
     QVector<quint64> exec(const EngineQuery& query, int limit = -1) const;
 
+    /**
+     * Sets \p ids to the results of the query \p key, if an earlier read-only
+     * transaction which saw the same data cached them. Returns false if not.
+     */
+    bool cachedQueryResults(const QByteArray& key, QVector<quint64>* ids) const;
+
+    /**
+     * Caches all the results of the query \p key for later read-only
+     * transactions. Does nothing in a write transaction.
+     */
+    void cacheQueryResults(const QByteArray& key, const QVector<quint64>& ids) const;
+
     PostingIterator* postingIterator(const EngineQuery& query) const;
     PostingIterator* postingCompIterator(const QByteArray& prefix, const QByteArray& value, PostingDB::Comparator com) const;
     PostingIterator* mTimeIter(quint32 mtime, MTimeDB::Comparator com) const;
@@ -93,10 +115,41 @@ public:
     //
     // Transaction handling
     //
-    void commit();
+    /**
+     * Returns false if the changes did not fit into the database. The
+     * database grows in that case, and the changes can be made again in
+     * a new Transaction.
+     */
+    bool commit();
     void abort();
     bool hasChanges() const;
 
+    /**
+     * Gives up the database's lock while a read-only transaction is not
+     * used, so that the database can grow in the meantime. Nothing can be
+     * read from it until resume() is called.
+     */
+    void suspend();
+
+    /**
+     * Makes a suspended transaction usable again. Returns false if the
+     * database grew in the meantime. A new transaction, which might see
+     * newer data, has then taken its place, and the iterators created
+     * before can only be deleted.
+     */
+    bool resume();
+
+    /**
+     * Returns true once a change did not fit into the database. All the
+     * later changes are ignored, and commit() returns false.
+     */
+    bool isFull() const;
+
+    /**
+     * \sa WriteTransaction::setMemoryBudget
+     */
+    void setMemoryBudget(qint64 bytes);
+
     //
     // Write Methods
     //
@@ -117,6 +170,34 @@ public:
     void setPhaseOne(quint64 id);
     void removePhaseOne(quint64 id);
 
+    /**
+     * Removes all the documents, and everything known about them, from
+     * the database
+     */
+    void clear();
+
+    /**
+     * Converts the posting lists of an index created with database
+     * version 2 to the compressed format
+     */
+    void upgradePostingDb();
+
+    /**
+     * The terms of the documents added from now on are handed to
+     * \p loader. They become searchable once writeBulkLoad() is called.
+     */
+    void setBulkLoader(BulkLoader* loader);
+
+    /**
+     * Writes all the terms collected by \p loader to the posting and
+     * position lists.
+     *
+     * Returns false if some of the terms were lost, in which case the
+     * transaction should be aborted, or if they did not fit into the
+     * database. See BulkLoader::write().
+     */
+    bool writeBulkLoad(BulkLoader* loader);
+
     // Debugging
     void checkFsTree();
     void checkTermsDbinPostingDb();
@@ -125,11 +206,23 @@ public:
 private:
     Transaction(const Transaction& rhs) = delete;
 
+    void begin(uint flags);
+
+    /**
+     * Returns the dictionary to look up the terms of prefix queries in, or
+     * null if there is none yet. It can lag behind the changes of other
+     * processes, see TermDictionaryCache.
+     */
+    QSharedPointer<const TermDictionary> termDictionary() const;
+
+    const Database& m_db;
     const DatabaseDbis& m_dbis;
     MDB_txn* m_txn;
     MDB_env* m_env;
     WriteTransaction* m_writeTrans;
+    bool m_suspended;
 
+    friend class Database;
     friend class DBState; // for testing
 };
 }
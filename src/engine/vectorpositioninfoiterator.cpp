@@ -41,6 +41,23 @@ quint64 VectorPositionInfoIterator::next()
     return m_vector[m_pos].docId;
 }
 
+quint64 VectorPositionInfoIterator::skipTo(quint64 docId)
+{
+    if (m_pos >= m_vector.size()) {
+        return 0;
+    }
+
+    const int from = qMax(m_pos, 0);
+    m_pos = gallopingLowerBound(m_vector.constBegin() + from, m_vector.constEnd(), PositionInfo(docId)) - m_vector.constBegin();
+    if (m_pos >= m_vector.size()) {
+        m_pos = m_vector.size();
+        m_vector.clear();
+        return 0;
+    }
+
+    return m_vector[m_pos].docId;
+}
+
 quint64 VectorPositionInfoIterator::docId() const
 {
     if (m_pos < 0 || m_pos >= m_vector.size()) {
@@ -59,5 +76,7 @@ QVector<uint> VectorPositionInfoIterator::positions()
     return m_vector[m_pos].positions;
 }
 
-
-
+quint64 VectorPositionInfoIterator::estimatedSize() const
+{
+    return m_vector.size();
+}
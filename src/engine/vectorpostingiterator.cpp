@@ -20,6 +20,8 @@
 
 #include "vectorpostingiterator.h"
 
+#include <cstring>
+
 using namespace Baloo;
 
 VectorPostingIterator::VectorPostingIterator(const QVector<quint64>& values)
@@ -48,3 +50,44 @@ quint64 VectorPostingIterator::next()
     m_pos++;
     return m_values[m_pos];
 }
+
+quint64 VectorPostingIterator::skipTo(quint64 docId)
+{
+    if (m_pos >= m_values.size()) {
+        return 0;
+    }
+
+    const int from = qMax(m_pos, 0);
+    m_pos = gallopingLowerBound(m_values.constBegin() + from, m_values.constEnd(), docId) - m_values.constBegin();
+    if (m_pos >= m_values.size()) {
+        m_pos = m_values.size();
+        m_values.clear();
+        return 0;
+    }
+
+    return m_values[m_pos];
+}
+
+int VectorPostingIterator::nextBlock(quint64* ids, int size)
+{
+    const int count = qMin(size, m_values.size() - m_pos - 1);
+    if (count <= 0) {
+        m_pos = m_values.size();
+        m_values.clear();
+        return 0;
+    }
+
+    memcpy(ids, m_values.constData() + m_pos + 1, count * sizeof(quint64));
+    m_pos += count;
+    return count;
+}
+
+quint64 VectorPostingIterator::estimatedSize() const
+{
+    return m_values.size();
+}
+
+bool VectorPostingIterator::hasExactSize() const
+{
+    return true;
+}
@@ -33,6 +33,10 @@ public:
 
     quint64 docId() const Q_DECL_OVERRIDE;
     quint64 next() Q_DECL_OVERRIDE;
+    quint64 skipTo(quint64 docId) Q_DECL_OVERRIDE;
+    int nextBlock(quint64* ids, int size) Q_DECL_OVERRIDE;
+    quint64 estimatedSize() const Q_DECL_OVERRIDE;
+    bool hasExactSize() const Q_DECL_OVERRIDE;
 
 private:
     QVector<quint64> m_values;
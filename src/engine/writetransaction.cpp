@@ -26,15 +26,138 @@
 #include "documentdb.h"
 #include "documenturldb.h"
 #include "documentiddb.h"
+#include "idfilenamedb.h"
+#include "filenametrigramdb.h"
 #include "positiondb.h"
 #include "documenttimedb.h"
 #include "documentdatadb.h"
 #include "mtimedb.h"
+#include "metadatadb.h"
+#include "bulkloader.h"
+#include "chunkedlist.h"
+#include "mapfull.h"
+#include "postingcodec.h"
+#include "positioncodec.h"
+
+#include <QAtomicInt>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
 
 using namespace Baloo;
 
+// Rough size of a term in m_pendingOperations, besides the term itself
+static const int s_pendingTermSize = 64;
+
+// Number of terms whose chunks are fetched, encoded and stored together
+static const int s_mergeBatchSize = 4096;
+
+// Batches with fewer terms are not worth handing to other threads
+static const int s_minParallelMerges = 256;
+
+namespace {
+
+struct TermMerge {
+    QVector<WriteTransaction::Operation> operations;
+    PostingChunks* postings;
+    PositionChunks* positions;
+
+    // Whether the term has a posting list before and after the merge
+    bool existed;
+    bool exists;
+};
+
+/*
+ * Applies the operations of one term to its chunks and encodes them.
+ * Nothing is written to the database, so this can run on any thread.
+ */
+void mergeTerm(TermMerge& merge)
+{
+    QVector<WriteTransaction::Operation>& operations = merge.operations;
+    std::stable_sort(operations.begin(), operations.end(), [](const WriteTransaction::Operation& lhs, const WriteTransaction::Operation& rhs) {
+        return lhs.data.docId < rhs.data.docId;
+    });
+
+    PostingList addedIds;
+    PostingList removedIds;
+    QVector<PositionInfo> addedPositions;
+    PostingList removedPositions;
+
+    // The last operation on a document decides whether it is part of the
+    // posting list. Additions without positions leave those untouched.
+    for (int i = 0; i < operations.size();) {
+        const quint64 id = operations[i].data.docId;
+        const WriteTransaction::Operation* last = 0;
+        const WriteTransaction::Operation* lastPositions = 0;
+        for (; i < operations.size() && operations[i].data.docId == id; i++) {
+            const WriteTransaction::Operation& op = operations[i];
+            last = &op;
+            if (op.type != WriteTransaction::AddId || !op.data.positions.isEmpty()) {
+                lastPositions = &op;
+            }
+        }
+
+        if (last->type == WriteTransaction::AddId) {
+            addedIds << id;
+        } else {
+            removedIds << id;
+        }
+
+        if (lastPositions) {
+            if (lastPositions->type == WriteTransaction::AddId) {
+                addedPositions << lastPositions->data;
+            } else {
+                removedPositions << id;
+            }
+        }
+    }
+
+    merge.postings->merge(addedIds, removedIds);
+    merge.exists = !merge.postings->isEmpty();
+    merge.postings->encode();
+
+    if (merge.positions) {
+        merge.positions->merge(addedPositions, removedPositions);
+        merge.positions->encode();
+    }
+}
+
+/*
+ * Merges terms until none are left. Every thread picks the next term
+ * from the shared counter, so large terms do not hold back the others.
+ */
+class MergeTask : public QRunnable
+{
+public:
+    MergeTask(TermMerge* merges, int count, QAtomicInt* next)
+        : m_merges(merges)
+        , m_count(count)
+        , m_next(next)
+    {}
+
+    void run() Q_DECL_OVERRIDE {
+        int i;
+        while ((i = m_next->fetchAndAddRelaxed(1)) < m_count) {
+            mergeTerm(m_merges[i]);
+        }
+    }
+
+private:
+    TermMerge* m_merges;
+    int m_count;
+    QAtomicInt* m_next;
+};
+
+}
+
 void WriteTransaction::addDocument(const Document& doc)
 {
+    if (isFull()) {
+        return;
+    }
+
     quint64 id = doc.id();
 
     DocumentDB documentTermsDB(m_dbis.docTermsDbi, m_txn);
@@ -44,7 +167,7 @@ void WriteTransaction::addDocument(const Document& doc)
     DocumentDataDB docDataDB(m_dbis.docDataDbi, m_txn);
     DocumentIdDB contentIndexingDB(m_dbis.contentIndexingDbi, m_txn);
     MTimeDB mtimeDB(m_dbis.mtimeDbi, m_txn);
-    DocumentUrlDB docUrlDB(m_dbis.idTreeDbi, m_dbis.idFilenameDbi, m_txn);
+    DocumentUrlDB docUrlDB(m_dbis.idTreeDbi, m_dbis.idFilenameDbi, m_dbis.fileNameIdDbi, m_txn);
 
     Q_ASSERT(!documentTermsDB.contains(id));
     Q_ASSERT(!documentXattrTermsDB.contains(id));
@@ -57,6 +180,11 @@ void WriteTransaction::addDocument(const Document& doc)
         return;
     }
 
+    if (m_dbis.fileNameTrigramDbi) {
+        IdFilenameDB idFilenameDB(m_dbis.idFilenameDbi, m_txn);
+        updateFileNameTrigrams(id, QByteArray(), idFilenameDB.get(id).name);
+    }
+
     QVector<QByteArray> docTerms = addTerms(id, doc.m_terms);
     documentTermsDB.put(id, docTerms);
 
@@ -93,14 +221,27 @@ QVector<QByteArray> WriteTransaction::addTerms(quint64 id, const QMap<QByteArray
     QMapIterator<QByteArray, Document::TermData> it(terms);
     while (it.hasNext()) {
         const QByteArray term = it.next().key();
+
+        // The TermGenerator never creates such terms, but Document accepts
+        // any QByteArray
+        Q_ASSERT_X(isValidTerm(term), "WriteTransaction::addTerms", "Terms cannot contain a 0 byte");
+        if (!isValidTerm(term)) {
+            continue;
+        }
         termList.append(term);
 
+        // A loader which could not write its runs remembers it, see BulkLoader::hasFailed()
+        if (m_bulkLoader) {
+            m_bulkLoader->add(term, id, it.value().positions);
+            continue;
+        }
+
         Operation op;
         op.type = AddId;
         op.data.docId = id;
         op.data.positions = it.value().positions;
 
-        m_pendingOperations[term].append(op);
+        addOperation(term, op);
     }
 
     return termList;
@@ -109,6 +250,10 @@ QVector<QByteArray> WriteTransaction::addTerms(quint64 id, const QMap<QByteArray
 
 void WriteTransaction::removeDocument(quint64 id)
 {
+    if (isFull()) {
+        return;
+    }
+
     DocumentDB documentTermsDB(m_dbis.docTermsDbi, m_txn);
     DocumentDB documentXattrTermsDB(m_dbis.docXattrTermsDbi, m_txn);
     DocumentDB documentFileNameTermsDB(m_dbis.docFilenameTermsDbi, m_txn);
@@ -117,7 +262,7 @@ void WriteTransaction::removeDocument(quint64 id)
     DocumentIdDB contentIndexingDB(m_dbis.contentIndexingDbi, m_txn);
     DocumentIdDB failedIndexingDB(m_dbis.failedIdDbi, m_txn);
     MTimeDB mtimeDB(m_dbis.mtimeDbi, m_txn);
-    DocumentUrlDB docUrlDB(m_dbis.idTreeDbi, m_dbis.idFilenameDbi, m_txn);
+    DocumentUrlDB docUrlDB(m_dbis.idTreeDbi, m_dbis.idFilenameDbi, m_dbis.fileNameIdDbi, m_txn);
 
     removeTerms(id, documentTermsDB.get(id));
     removeTerms(id, documentXattrTermsDB.get(id));
@@ -127,6 +272,12 @@ void WriteTransaction::removeDocument(quint64 id)
     documentXattrTermsDB.del(id);
     documentFileNameTermsDB.del(id);
 
+    if (m_dbis.fileNameTrigramDbi) {
+        IdFilenameDB idFilenameDB(m_dbis.idFilenameDbi, m_txn);
+        updateFileNameTrigrams(id, idFilenameDB.get(id).name, QByteArray());
+    }
+
+    m_urlsChanged = true;
     docUrlDB.del(id, [&docTimeDB](quint64 id) {
         return !docTimeDB.contains(id);
     });
@@ -150,13 +301,17 @@ void WriteTransaction::removeTerms(quint64 id, const QVector<QByteArray>& terms)
         op.type = RemoveId;
         op.data.docId = id;
 
-        m_pendingOperations[term].append(op);
+        addOperation(term, op);
     }
 }
 
 void WriteTransaction::removeRecursively(quint64 parentId)
 {
-    DocumentUrlDB docUrlDB(m_dbis.idTreeDbi, m_dbis.idFilenameDbi, m_txn);
+    if (isFull()) {
+        return;
+    }
+
+    DocumentUrlDB docUrlDB(m_dbis.idTreeDbi, m_dbis.idFilenameDbi, m_dbis.fileNameIdDbi, m_txn);
 
     const QVector<quint64> children = docUrlDB.getChildren(parentId);
     for (quint64 id : children) {
@@ -167,13 +322,17 @@ void WriteTransaction::removeRecursively(quint64 parentId)
 
 void WriteTransaction::replaceDocument(const Document& doc, DocumentOperations operations)
 {
+    if (isFull()) {
+        return;
+    }
+
     DocumentDB documentTermsDB(m_dbis.docTermsDbi, m_txn);
     DocumentDB documentXattrTermsDB(m_dbis.docXattrTermsDbi, m_txn);
     DocumentDB documentFileNameTermsDB(m_dbis.docFilenameTermsDbi, m_txn);
     DocumentTimeDB docTimeDB(m_dbis.docTimeDbi, m_txn);
     DocumentDataDB docDataDB(m_dbis.docDataDbi, m_txn);
     MTimeDB mtimeDB(m_dbis.mtimeDbi, m_txn);
-    DocumentUrlDB docUrlDB(m_dbis.idTreeDbi, m_dbis.idFilenameDbi, m_txn);
+    DocumentUrlDB docUrlDB(m_dbis.idTreeDbi, m_dbis.idFilenameDbi, m_dbis.fileNameIdDbi, m_txn);
 
     const quint64 id = doc.id();
 
@@ -226,9 +385,17 @@ void WriteTransaction::replaceDocument(const Document& doc, DocumentOperations o
     }
 
     if (operations & DocumentUrl) {
+        IdFilenameDB idFilenameDB(m_dbis.idFilenameDbi, m_txn);
+        const QByteArray oldName = idFilenameDB.get(id).name;
+
+        m_urlsChanged = true;
         docUrlDB.replace(id, doc.url(), [&docTimeDB](quint64 id) {
             return !docTimeDB.contains(id);
         });;
+
+        if (m_dbis.fileNameTrigramDbi) {
+            updateFileNameTrigrams(id, oldName, idFilenameDB.get(id).name);
+        }
     }
 }
 
@@ -240,92 +407,281 @@ QVector< QByteArray > WriteTransaction::replaceTerms(quint64 id, const QVector<Q
         op.type = RemoveId;
         op.data.docId = id;
 
-        m_pendingOperations[term].append(op);
+        addOperation(term, op);
     }
 
     return addTerms(id, terms);
 }
 
-template<typename T>
-static void insert(QVector<T>& vec, const T& id)
+void WriteTransaction::addOperation(const QByteArray& term, const Operation& op)
 {
-    if (vec.isEmpty()) {
-        vec.append(id);
-    } else {
-        auto it = std::upper_bound(vec.begin(), vec.end(), id);
-
-        // Merge the id if it does not
-        auto prev = it - 1;
-        if (*prev != id) {
-            vec.insert(it, id);
-        }
+    auto it = m_pendingOperations.find(term);
+    if (it == m_pendingOperations.end()) {
+        it = m_pendingOperations.insert(term, QVector<Operation>());
+        m_pendingMemory += s_pendingTermSize + term.size();
+    }
+    it->append(op);
+    m_pendingMemory += sizeof(Operation) + op.data.positions.size() * sizeof(uint);
+
+    // Merging early only writes to the open LMDB transaction, so nothing
+    // becomes visible before commit()
+    if (m_memoryBudget > 0 && m_pendingMemory > m_memoryBudget) {
+        mergePendingOperations();
     }
 }
 
-template<typename T>
-static void removeOne(QVector<T>& vec, const T& id)
+void WriteTransaction::updateFileNameTrigrams(quint64 id, const QByteArray& oldName, const QByteArray& newName)
 {
-    const int idx = vec.indexOf(id);
-    if (idx >= 0) {
-        vec.remove(idx);
+    if (!m_dbis.fileNameTrigramDbi || oldName == newName) {
+        return;
+    }
+
+    const QVector<QByteArray> oldTrigrams = FilenameTrigramDB::trigrams(oldName);
+    const QVector<QByteArray> newTrigrams = FilenameTrigramDB::trigrams(newName);
+
+    // Both lists are sorted, so the trigrams both names share are skipped
+    QVector<QPair<QByteArray, OperationType> > changes;
+    auto oldIt = oldTrigrams.constBegin();
+    auto newIt = newTrigrams.constBegin();
+    while (oldIt != oldTrigrams.constEnd() || newIt != newTrigrams.constEnd()) {
+        if (newIt == newTrigrams.constEnd() || (oldIt != oldTrigrams.constEnd() && *oldIt < *newIt)) {
+            changes << qMakePair(*oldIt++, RemoveId);
+        } else if (oldIt == oldTrigrams.constEnd() || *newIt < *oldIt) {
+            changes << qMakePair(*newIt++, AddId);
+        } else {
+            ++oldIt;
+            ++newIt;
+        }
+    }
+
+    for (const auto& change : changes) {
+        Operation op;
+        op.type = change.second;
+        op.data.docId = id;
+
+        auto it = m_pendingTrigramOperations.find(change.first);
+        if (it == m_pendingTrigramOperations.end()) {
+            it = m_pendingTrigramOperations.insert(change.first, QVector<Operation>());
+            m_pendingMemory += s_pendingTermSize + change.first.size();
+        }
+        it->append(op);
+        m_pendingMemory += sizeof(Operation);
+    }
+
+    if (m_memoryBudget > 0 && m_pendingMemory > m_memoryBudget) {
+        mergePendingOperations();
     }
 }
 
 void WriteTransaction::commit()
 {
-    PostingDB postingDB(m_dbis.postingDbi, m_txn);
-    PositionDB positionDB(m_dbis.positionDBi, m_txn);
+    mergePendingOperations();
+    m_hasMergedOperations = false;
 
-    QHashIterator<QByteArray, QVector<Operation> > iter(m_pendingOperations);
-    while (iter.hasNext()) {
-        iter.next();
+    // Tells the url caches of all the processes to drop their paths
+    if (m_urlsChanged && m_dbis.metadataDbi && !isFull()) {
+        MetadataDB metadataDB(m_dbis.metadataDbi, m_txn);
+        metadataDB.put(MetadataDB::UrlGeneration, metadataDB.get(MetadataDB::UrlGeneration) + 1);
+    }
+}
+
+/*
+ * LMDB does not tell whether a transaction can still be used, but fails
+ * everything on it once a write failed. Asking for the size of a database
+ * is cheap.
+ */
+bool WriteTransaction::isFull()
+{
+    if (!m_full) {
+        MDB_stat stat;
+        m_full = isMapFull(mdb_stat(m_txn, m_dbis.postingDbi, &stat));
+    }
+    return m_full;
+}
 
-        const QByteArray& term = iter.key();
-        const QVector<Operation> operations = iter.value();
+void WriteTransaction::updateTermChanges(const QByteArray& term, bool added)
+{
+    QSet<QByteArray>& changes = added ? m_termChanges.added : m_termChanges.removed;
+    QSet<QByteArray>& reverted = added ? m_termChanges.removed : m_termChanges.added;
+    if (!reverted.remove(term)) {
+        changes.insert(term);
+    }
+}
 
-        PostingList list = postingDB.get(term);
+void WriteTransaction::clear()
+{
+    const MDB_dbi dbis[] = {
+        m_dbis.postingDbi, m_dbis.positionDBi,
+        m_dbis.docTermsDbi, m_dbis.docFilenameTermsDbi, m_dbis.docXattrTermsDbi,
+        m_dbis.idTreeDbi, m_dbis.idFilenameDbi, m_dbis.fileNameIdDbi,
+        m_dbis.docTimeDbi, m_dbis.docDataDbi, m_dbis.contentIndexingDbi,
+        m_dbis.mtimeDbi, m_dbis.failedIdDbi, m_dbis.fileNameTrigramDbi
+    };
+
+    // The optional databases are 0 when they do not exist
+    for (MDB_dbi dbi : dbis) {
+        if (!dbi) {
+            continue;
+        }
+        int rc = mdb_drop(m_txn, dbi, 0);
+        Q_ASSERT_X(rc == 0 || isMapFull(rc), "WriteTransaction::clear", mdb_strerror(rc));
+    }
 
-        bool fetchedPositionList = false;
-        QVector<PositionInfo> positionList;
+    m_pendingOperations.clear();
+    m_pendingTrigramOperations.clear();
+    m_pendingMemory = 0;
 
-        for (const Operation& op : operations) {
-            quint64 id = op.data.docId;
+    m_hasMergedOperations = true;
+    m_termChanges.unknown = true;
+    m_urlsChanged = true;
+}
 
-            if (op.type == AddId) {
-                insert(list, id);
+bool WriteTransaction::writeBulkLoad(BulkLoader* loader)
+{
+    if (isFull()) {
+        return false;
+    }
 
-                if (!op.data.positions.isEmpty()) {
-                    if (!fetchedPositionList) {
-                        positionList = positionDB.get(term);
-                        fetchedPositionList = true;
-                    }
-                    insert(positionList, op.data);
-                }
-            }
-            else {
-                removeOne(list, id);
-                if (!fetchedPositionList) {
-                    positionList = positionDB.get(term);
-                    fetchedPositionList = true;
+    m_termChanges.unknown = true;
+    return loader->write(m_txn, m_dbis.postingDbi, m_dbis.positionDBi);
+}
+
+/*
+ * The trigram lists are short and only hold ids, so they are merged on
+ * this thread
+ */
+void WriteTransaction::mergeTrigramOperations()
+{
+    if (m_pendingTrigramOperations.isEmpty()) {
+        return;
+    }
+
+    QVector<QByteArray> trigrams;
+    trigrams.reserve(m_pendingTrigramOperations.size());
+    for (auto it = m_pendingTrigramOperations.constBegin(); it != m_pendingTrigramOperations.constEnd(); ++it) {
+        trigrams << it.key();
+    }
+    std::sort(trigrams.begin(), trigrams.end());
+
+    MDB_cursor* cursor;
+    int rc = mdb_cursor_open(m_txn, m_dbis.fileNameTrigramDbi, &cursor);
+    if (isMapFull(rc)) {
+        m_full = true;
+        m_pendingTrigramOperations.clear();
+        return;
+    }
+    Q_ASSERT_X(rc == 0, "WriteTransaction::mergeTrigramOperations", mdb_strerror(rc));
+
+    for (const QByteArray& trigram : trigrams) {
+        PostingChunks chunks(cursor, trigram, PostingChunkSize);
+
+        TermMerge merge;
+        merge.operations = m_pendingTrigramOperations.value(trigram);
+        merge.postings = &chunks;
+        merge.positions = 0;
+        merge.existed = merge.exists = false;
+        mergeTerm(merge);
+
+        if (!chunks.store()) {
+            m_full = true;
+            break;
+        }
+    }
+
+    mdb_cursor_close(cursor);
+    m_pendingTrigramOperations.clear();
+    m_hasMergedOperations = true;
+}
+
+void WriteTransaction::mergePendingOperations()
+{
+    mergeTrigramOperations();
+    if (m_pendingOperations.isEmpty() || isFull()) {
+        m_pendingOperations.clear();
+        m_pendingMemory = 0;
+        return;
+    }
+
+    // Sorting the terms lets a single cursor walk each database forwards
+    QVector<QByteArray> terms;
+    terms.reserve(m_pendingOperations.size());
+    for (auto it = m_pendingOperations.constBegin(); it != m_pendingOperations.constEnd(); ++it) {
+        terms << it.key();
+    }
+    std::sort(terms.begin(), terms.end());
+
+    MDB_cursor* postingCursor;
+    int rc = mdb_cursor_open(m_txn, m_dbis.postingDbi, &postingCursor);
+    Q_ASSERT_X(rc == 0, "WriteTransaction::commit", mdb_strerror(rc));
+
+    MDB_cursor* positionCursor;
+    rc = mdb_cursor_open(m_txn, m_dbis.positionDBi, &positionCursor);
+    Q_ASSERT_X(rc == 0, "WriteTransaction::commit", mdb_strerror(rc));
+
+    // LMDB only allows one writer, but decoding, merging and encoding the
+    // lists does not touch the database. Each batch is therefore fetched,
+    // encoded by all the threads and then stored, in that order, since the
+    // fetched values are only valid until the next write.
+    QThreadPool threadPool;
+    const int threadCount = QThread::idealThreadCount();
+    threadPool.setMaxThreadCount(qMax(1, threadCount - 1));
+
+    QVector<TermMerge> merges;
+    merges.reserve(qMin(terms.size(), s_mergeBatchSize));
+
+    for (int start = 0; start < terms.size() && !m_full; start += s_mergeBatchSize) {
+        const int end = qMin(start + s_mergeBatchSize, terms.size());
+
+        merges.clear();
+        for (int i = start; i < end; i++) {
+            const QByteArray& term = terms[i];
+
+            TermMerge merge;
+            merge.operations = m_pendingOperations.value(term);
+            merge.postings = new PostingChunks(postingCursor, term, PostingChunkSize);
+            merge.positions = 0;
+            merge.existed = !merge.postings->isEmpty();
+            merge.exists = merge.existed;
+
+            for (const Operation& op : merge.operations) {
+                if (op.type != AddId || !op.data.positions.isEmpty()) {
+                    merge.positions = new PositionChunks(positionCursor, term, PositionChunkSize);
+                    break;
                 }
-                removeOne(positionList, PositionInfo(id));
             }
+            merges << merge;
         }
 
-        if (!list.isEmpty()) {
-            postingDB.put(term, list);
-        } else {
-            postingDB.del(term);
+        QAtomicInt next(0);
+        MergeTask task(merges.data(), merges.size(), &next);
+        if (threadCount > 1 && merges.size() >= s_minParallelMerges) {
+            for (int i = 1; i < threadCount; i++) {
+                threadPool.start(new MergeTask(merges.data(), merges.size(), &next));
+            }
         }
+        task.run();
+        threadPool.waitForDone();
 
-        if (fetchedPositionList) {
-            if (!positionList.isEmpty()) {
-                positionDB.put(term, positionList);
-            } else {
-                positionDB.del(term);
+        for (int i = 0; i < merges.size(); i++) {
+            const TermMerge& merge = merges[i];
+            if (merge.existed != merge.exists) {
+                updateTermChanges(terms[start + i], merge.exists);
+            }
+
+            // Once something did not fit, the rest is only cleaned up
+            m_full = m_full || !merge.postings->store();
+            delete merge.postings;
+
+            if (merge.positions) {
+                m_full = m_full || !merge.positions->store();
+                delete merge.positions;
             }
         }
     }
 
+    mdb_cursor_close(postingCursor);
+    mdb_cursor_close(positionCursor);
     m_pendingOperations.clear();
+    m_pendingMemory = 0;
+    m_hasMergedOperations = true;
 }
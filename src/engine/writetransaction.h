@@ -27,16 +27,48 @@
 #include "databasedbis.h"
 #include "documenturldb.h"
 
+#include <QSet>
+
 namespace Baloo {
 
+class BulkLoader;
+
 class BALOO_ENGINE_EXPORT WriteTransaction
 {
 public:
     WriteTransaction(DatabaseDbis dbis, MDB_txn* txn)
         : m_txn(txn)
         , m_dbis(dbis)
+        , m_bulkLoader(0)
+        , m_memoryBudget(DefaultMemoryBudget)
+        , m_pendingMemory(0)
+        , m_hasMergedOperations(false)
+        , m_urlsChanged(false)
+        , m_full(false)
     {}
 
+    enum {
+        DefaultMemoryBudget = 64 * 1024 * 1024
+    };
+
+    /**
+     * Limits the memory used by the pending term operations to roughly
+     * \p bytes. Once they grow past it, they are merged into the posting
+     * and position lists of the open transaction. A budget of 0 keeps
+     * everything in memory until commit().
+     */
+    void setMemoryBudget(qint64 bytes) {
+        m_memoryBudget = bytes;
+    }
+
+    /**
+     * Hands the terms of every added document to \p loader instead of
+     * queuing them for commit(). Only meant for filling an empty database.
+     */
+    void setBulkLoader(BulkLoader* loader) {
+        m_bulkLoader = loader;
+    }
+
     void addDocument(const Document& doc);
     void removeDocument(quint64 id);
 
@@ -57,7 +89,11 @@ public:
      */
     template <typename Functor>
     void removeRecursively(quint64 parentId, Functor shouldDelete) {
-        DocumentUrlDB docUrlDB(m_dbis.idTreeDbi, m_dbis.idFilenameDbi, m_txn);
+        if (isFull()) {
+            return;
+        }
+
+        DocumentUrlDB docUrlDB(m_dbis.idTreeDbi, m_dbis.idFilenameDbi, m_dbis.fileNameIdDbi, m_txn);
 
         if (shouldDelete(parentId)) {
             removeRecursively(parentId);
@@ -73,9 +109,52 @@ public:
     void replaceDocument(const Document& doc, DocumentOperations operations);
     void commit();
 
+    /**
+     * Empties all the databases, including the operations which have not
+     * been merged yet
+     */
+    void clear();
+
+    /**
+     * Writes all the terms collected by \p loader to the posting and
+     * position lists. Returns false if they could not all be written,
+     * see BulkLoader::write().
+     */
+    bool writeBulkLoad(BulkLoader* loader);
+
+    /**
+     * The terms which were added to or removed from the PostingDB
+     */
+    struct TermChanges {
+        QSet<QByteArray> added;
+        QSet<QByteArray> removed;
+
+        // Set when terms were written without keeping track of them
+        bool unknown = false;
+    };
+    const TermChanges& termChanges() const {
+        return m_termChanges;
+    }
+
+    /**
+     * Returns true if documents were moved or removed, which changes the
+     * urls of the ones below them
+     */
+    bool urlsChanged() const {
+        return m_urlsChanged;
+    }
+
     bool hasChanges() const {
-        return !m_pendingOperations.isEmpty();
+        return m_hasMergedOperations || !m_pendingOperations.isEmpty() || !m_pendingTrigramOperations.isEmpty();
     }
+
+    /**
+     * Returns true once a write did not fit into the memory map. LMDB
+     * refuses everything else on the transaction from then on, so all
+     * further changes are ignored and committing it fails.
+     */
+    bool isFull();
+
     enum OperationType {
         AddId,
         RemoveId
@@ -95,10 +174,32 @@ private:
                                      const QMap<QByteArray, Document::TermData>& terms);
     void removeTerms(quint64 id, const QVector<QByteArray>& terms);
 
+    /*
+     * Queues the changes to the FilenameTrigramDB when the file name of
+     * document \p id changes from \p oldName to \p newName. Either may be
+     * empty.
+     */
+    void updateFileNameTrigrams(quint64 id, const QByteArray& oldName, const QByteArray& newName);
+
+    void addOperation(const QByteArray& term, const Operation& op);
+    void mergePendingOperations();
+    void mergeTrigramOperations();
+    void updateTermChanges(const QByteArray& term, bool added);
+
     QHash<QByteArray, QVector<Operation> > m_pendingOperations;
+    QHash<QByteArray, QVector<Operation> > m_pendingTrigramOperations;
 
     MDB_txn* m_txn;
     DatabaseDbis m_dbis;
+    BulkLoader* m_bulkLoader;
+
+    qint64 m_memoryBudget;
+    qint64 m_pendingMemory;
+    bool m_hasMergedOperations;
+    bool m_urlsChanged;
+    bool m_full;
+
+    TermChanges m_termChanges;
 };
 }
 
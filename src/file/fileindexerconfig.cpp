@@ -337,6 +337,18 @@ bool FileIndexerConfig::initialUpdateDisabled() const
     return m_config.group("General").readEntry("disable initial update", true);
 }
 
+qint64 FileIndexerConfig::firstRunMemoryBudget() const
+{
+    const qint64 megaBytes = m_config.group("General").readEntry("first run memory budget", 64);
+    return qMax<qint64>(megaBytes, 1) * 1024 * 1024;
+}
+
+qint64 FileIndexerConfig::transactionMemoryBudget() const
+{
+    const qint64 megaBytes = m_config.group("General").readEntry("transaction memory budget", 64);
+    return qMax<qint64>(megaBytes, 1) * 1024 * 1024;
+}
+
 int FileIndexerConfig::databaseVersion() const
 {
     return m_config.group("General").readEntry("dbVersion", 0);
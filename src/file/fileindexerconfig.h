@@ -82,6 +82,20 @@ public:
      */
     bool initialUpdateDisabled() const;
 
+    /**
+     * A "hidden" config option which limits the memory, in bytes, used
+     * to collect the terms during the initial run before they are
+     * written to sorted runs on disk. Configured in MiB.
+     */
+    qint64 firstRunMemoryBudget() const;
+
+    /**
+     * A "hidden" config option which limits the memory, in bytes, used
+     * by the pending operations of a write transaction before they are
+     * merged into the database. Configured in MiB.
+     */
+    qint64 transactionMemoryBudget() const;
+
     /**
      * Check if \p path should be indexed taking into account
      * the includeFolders(), the excludeFolders(), and the
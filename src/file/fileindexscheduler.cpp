@@ -35,6 +35,10 @@
 
 using namespace Baloo;
 
+// Indexing which failed is retried after this many msecs, as trying again
+// right away would most likely fail the same way
+static const int s_retryInterval = 5 * 60 * 1000;
+
 FileIndexScheduler::FileIndexScheduler(Database* db, FileIndexerConfig* config, QObject* parent)
     : QObject(parent)
     , m_db(db)
@@ -50,6 +54,10 @@ FileIndexScheduler::FileIndexScheduler(Database* db, FileIndexerConfig* config,
 
     m_threadPool.setMaxThreadCount(1);
 
+    m_firstRunRetryTimer.setSingleShot(true);
+    m_firstRunRetryTimer.setInterval(s_retryInterval);
+    connect(&m_firstRunRetryTimer, &QTimer::timeout, this, &FileIndexScheduler::scheduleIndexing);
+
     connect(&m_powerMonitor, &PowerStateMonitor::powerManagementStatusChanged,
             this, &FileIndexScheduler::powerManagementStatusChanged);
 
@@ -76,8 +84,19 @@ void FileIndexScheduler::scheduleIndexing()
     }
 
     if (m_config->isInitialRun()) {
+        // Nothing else can be indexed before the first run is done
+        if (m_firstRunRetryTimer.isActive()) {
+            m_indexerState = Idle;
+            Q_EMIT stateChanged(m_indexerState);
+            return;
+        }
+
         auto runnable = new FirstRunIndexer(m_db, m_config, m_config->includeFolders());
         connect(runnable, &FirstRunIndexer::done, this, &FileIndexScheduler::scheduleIndexing);
+        connect(runnable, &FirstRunIndexer::failed, this, [this]() {
+            m_firstRunRetryTimer.start();
+            scheduleIndexing();
+        });
 
         m_threadPool.start(runnable);
         m_indexerState = FirstRun;
@@ -88,6 +107,13 @@ void FileIndexScheduler::scheduleIndexing()
     if (!m_newFiles.isEmpty()) {
         auto runnable = new NewFileIndexer(m_db, m_config, m_newFiles);
         connect(runnable, &NewFileIndexer::done, this, &FileIndexScheduler::scheduleIndexing);
+        connect(runnable, &NewFileIndexer::failed, this, [this](const QStringList& files) {
+            QTimer::singleShot(s_retryInterval, this, [this, files]() {
+                for (const QString& file : files) {
+                    indexNewFile(file);
+                }
+            });
+        });
 
         m_threadPool.start(runnable);
         m_newFiles.clear();
@@ -99,6 +125,13 @@ void FileIndexScheduler::scheduleIndexing()
     if (!m_modifiedFiles.isEmpty()) {
         auto runnable = new ModifiedFileIndexer(m_db, m_config, m_modifiedFiles);
         connect(runnable, &ModifiedFileIndexer::done, this, &FileIndexScheduler::scheduleIndexing);
+        connect(runnable, &ModifiedFileIndexer::failed, this, [this](const QStringList& files) {
+            QTimer::singleShot(s_retryInterval, this, [this, files]() {
+                for (const QString& file : files) {
+                    indexModifiedFile(file);
+                }
+            });
+        });
 
         m_threadPool.start(runnable);
         m_modifiedFiles.clear();
@@ -110,6 +143,13 @@ void FileIndexScheduler::scheduleIndexing()
     if (!m_xattrFiles.isEmpty()) {
         auto runnable = new XAttrIndexer(m_db, m_config, m_xattrFiles);
         connect(runnable, &XAttrIndexer::done, this, &FileIndexScheduler::scheduleIndexing);
+        connect(runnable, &XAttrIndexer::failed, this, [this](const QStringList& files) {
+            QTimer::singleShot(s_retryInterval, this, [this, files]() {
+                for (const QString& file : files) {
+                    indexXAttrFile(file);
+                }
+            });
+        });
 
         m_threadPool.start(runnable);
         m_xattrFiles.clear();
@@ -128,6 +168,9 @@ void FileIndexScheduler::scheduleIndexing()
     if (m_checkUnindexedFiles) {
         auto runnable = new UnindexedFileIndexer(m_db, m_config);
         connect(runnable, &UnindexedFileIndexer::done, this, &FileIndexScheduler::scheduleIndexing);
+        connect(runnable, &UnindexedFileIndexer::failed, this, [this]() {
+            QTimer::singleShot(s_retryInterval, this, &FileIndexScheduler::checkUnindexedFiles);
+        });
 
         m_threadPool.start(runnable);
         m_checkUnindexedFiles = false;
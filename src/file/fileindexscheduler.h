@@ -96,6 +96,7 @@ private:
     QStringList m_xattrFiles;
 
     QThreadPool m_threadPool;
+    QTimer m_firstRunRetryTimer;
 
     FileContentIndexerProvider m_provider;
     FileContentIndexer* m_contentIndexer;
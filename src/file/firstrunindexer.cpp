@@ -24,8 +24,11 @@
 
 #include "database.h"
 #include "transaction.h"
+#include "bulkloader.h"
 
 #include <QMimeDatabase>
+#include <QTemporaryDir>
+#include <QDebug>
 
 using namespace Baloo;
 
@@ -42,46 +45,142 @@ FirstRunIndexer::FirstRunIndexer(Database* db, FileIndexerConfig* config, const
 void FirstRunIndexer::run()
 {
     Q_ASSERT(m_config->isInitialRun());
+
+    if (indexFolders()) {
+        m_config->setInitialRun(false);
+        Q_EMIT done();
+        return;
+    }
+
+    // The documents committed so far have no terms, so they are thrown away
+    // and the first run starts over later
+    if (!clearIndex()) {
+        qWarning() << "Could not clear the index after the first run failed";
+    }
+    Q_EMIT failed();
+}
+
+bool FirstRunIndexer::indexFolders()
+{
+    // A first run which failed earlier may have left documents behind
+    bool isEmpty = false;
     {
         Transaction tr(m_db, Transaction::ReadOnly);
-        Q_ASSERT_X(tr.size() == 0, "FirstRunIndexer", "The database is not empty on first run");
+        isEmpty = tr.size() == 0;
+    }
+    if (!isEmpty && !clearIndex()) {
+        return false;
     }
 
-    QMimeDatabase mimeDb;
+    // The terms of all the documents are collected in sorted runs on disk,
+    // and only written to the posting lists once everything has been seen.
+    // Without a place for the runs they are written along with the documents.
+    QTemporaryDir runDir(m_db->path() + QStringLiteral("/firstrun-XXXXXX"));
+    if (!runDir.isValid()) {
+        qWarning() << "Could not create a directory for the first run in" << m_db->path();
+    }
+    BulkLoader loader(runDir.path(), m_config->firstRunMemoryBudget());
+    BulkLoader* bulkLoader = runDir.isValid() ? &loader : nullptr;
 
+    // The documents are committed without their terms, so the first run is
+    // only done once the terms have been written as well. Should baloo_file
+    // not get that far, main() throws the index away on the next start.
     for (const QString& folder : m_folders) {
-        Transaction tr(m_db, Transaction::ReadWrite);
+        if (bulkLoader && !bulkLoader->checkpoint()) {
+            return false;
+        }
 
-        FilteredDirIterator it(m_config, folder);
-        while (!it.next().isEmpty()) {
-            QString mimetype = mimeDb.mimeTypeForFile(it.filePath(), QMimeDatabase::MatchExtension).name();
-            if (!m_config->shouldMimeTypeBeIndexed(mimetype)) {
-                continue;
-            }
-            BasicIndexingJob::IndexingLevel level =
-                m_config->onlyBasicIndexing() ? BasicIndexingJob::NoLevel : BasicIndexingJob::MarkForContentIndexing;
-            BasicIndexingJob job(it.filePath(), mimetype, level);
-            if (!job.index()) {
-                continue;
+        // The database grows when the folder does not fit, after which the
+        // folder is indexed once more
+        bool indexed = indexFolder(folder, bulkLoader);
+        if (!indexed && !(bulkLoader && bulkLoader->hasFailed())) {
+            if (bulkLoader) {
+                bulkLoader->rollback();
             }
+            indexed = indexFolder(folder, bulkLoader);
+        }
+        if (!indexed) {
+            qWarning() << "The first run could not index" << folder;
+            return false;
+        }
+    }
 
-            // Even though this is the first run, because 2 hard links will resolve to the same id,
-            // we land up crashing (due to the asserts in addDocument).
-            // Hence we are checking before.
-            // FIXME: Silently ignore hard links!
-            //
-            if (tr.hasDocument(job.document().id())) {
-                continue;
+    if (bulkLoader) {
+        // The whole index is written at once, so the database needs to grow
+        // first. Should that not be enough, commit() grows it some more and
+        // the terms are written once again.
+        m_db->reserve(loader.size());
+        if (!writeTerms(&loader) && (loader.hasFailed() || !writeTerms(&loader))) {
+            if (loader.hasFailed()) {
+                qWarning() << "The first run could not read back the terms from" << runDir.path();
+            } else {
+                qWarning() << "The first run could not write the terms";
             }
-            tr.addDocument(job.document());
+            return false;
         }
+    }
+
+    return true;
+}
 
-        // FIXME: This would consume too much memory. We should make some more commits
-        //        based on how much memory we consume
-        tr.commit();
+bool FirstRunIndexer::writeTerms(BulkLoader* loader)
+{
+    Transaction tr(m_db, Transaction::ReadWrite);
+    if (!tr.writeBulkLoad(loader) && loader->hasFailed()) {
+        tr.abort();
+        return false;
+    }
+    return tr.commit();
+}
+
+bool FirstRunIndexer::clearIndex()
+{
+    Transaction tr(m_db, Transaction::ReadWrite);
+    tr.clear();
+    return tr.commit();
+}
+
+bool FirstRunIndexer::indexFolder(const QString& folder, BulkLoader* loader)
+{
+    QMimeDatabase mimeDb;
+
+    Transaction tr(m_db, Transaction::ReadWrite);
+    if (loader) {
+        tr.setBulkLoader(loader);
     }
 
-    m_config->setInitialRun(false);
+    FilteredDirIterator it(m_config, folder);
+    while (!it.next().isEmpty()) {
+        // Nothing more is written once the database is full
+        if (tr.isFull()) {
+            break;
+        }
+
+        QString mimetype = mimeDb.mimeTypeForFile(it.filePath(), QMimeDatabase::MatchExtension).name();
+        if (!m_config->shouldMimeTypeBeIndexed(mimetype)) {
+            continue;
+        }
+        BasicIndexingJob::IndexingLevel level =
+            m_config->onlyBasicIndexing() ? BasicIndexingJob::NoLevel : BasicIndexingJob::MarkForContentIndexing;
+        BasicIndexingJob job(it.filePath(), mimetype, level);
+        if (!job.index()) {
+            continue;
+        }
 
-    Q_EMIT done();
+        // Even though this is the first run, because 2 hard links will resolve to the same id,
+        // we land up crashing (due to the asserts in addDocument).
+        // Hence we are checking before.
+        // FIXME: Silently ignore hard links!
+        //
+        if (tr.hasDocument(job.document().id())) {
+            continue;
+        }
+        tr.addDocument(job.document());
+    }
+
+    if (loader && loader->hasFailed()) {
+        tr.abort();
+        return false;
+    }
+    return tr.commit();
 }
@@ -26,6 +26,7 @@
 
 namespace Baloo {
 
+class BulkLoader;
 class Database;
 class FileIndexerConfig;
 
@@ -40,7 +41,34 @@ public:
 Q_SIGNALS:
     void done();
 
+    /**
+     * Emitted instead of done() when the index could not be built. The
+     * database is left empty, and the initial run is still to be done.
+     */
+    void failed();
+
 private:
+    /**
+     * Builds the index of all the folders, starting from an empty one
+     */
+    bool indexFolders();
+
+    /**
+     * Adds all the files in \p folder in one transaction. Their terms are
+     * handed to \p loader, unless it is null.
+     *
+     * Returns false if the transaction could not be committed.
+     */
+    bool indexFolder(const QString& folder, BulkLoader* loader);
+
+    /**
+     * Writes the terms collected by \p loader in one transaction. Returns
+     * false if they were lost or did not fit into the database.
+     */
+    bool writeTerms(BulkLoader* loader);
+
+    bool clearIndex();
+
     Database* m_db;
     FileIndexerConfig* m_config;
 
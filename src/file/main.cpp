@@ -25,6 +25,7 @@
 #include <KLocalizedString>
 
 #include <QDebug>
+#include <QDir>
 #include <QFileInfo>
 #include <iostream>
 
@@ -73,6 +74,18 @@ int main(int argc, char** argv)
         migrator.migrate();
     }
 
+    // A first run which did not finish leaves documents behind whose terms
+    // were never written, so it starts over from an empty index
+    if (indexerConfig.isInitialRun()) {
+        QFile::remove(path + "/index");
+
+        QDir dbDir(path);
+        const QStringList runDirs = dbDir.entryList({QStringLiteral("firstrun-*")}, QDir::Dirs | QDir::NoDotAndDotDot);
+        for (const QString& runDir : runDirs) {
+            QDir(dbDir.filePath(runDir)).removeRecursively();
+        }
+    }
+
     if (!QFile::exists(path + "/index")) {
         indexerConfig.setInitialRun(true);
     }
@@ -19,9 +19,12 @@
 
 #include "migrator.h"
 #include "fileindexerconfig.h"
+#include "database.h"
+#include "transaction.h"
 
 #include <QFile>
 #include <QDir>
+#include <QDebug>
 
 using namespace Baloo;
 
@@ -36,9 +39,21 @@ Migrator::Migrator(const QString& dbPath, FileIndexerConfig* config)
 
 /*
  * Changing this version number indicates that the old index should be deleted
- * and the indexing should be started from scratch.
+ * and the indexing should be started from scratch, unless migrate() knows how
+ * to upgrade it in place.
  */
-static int s_dbVersion = 2;
+static int s_dbVersion = 5;
+
+/*
+ * Converts all the posting lists in one transaction. Returns false if it
+ * could not be committed.
+ */
+static bool upgradePostingDb(const Database& db)
+{
+    Transaction tr(db, Transaction::ReadWrite);
+    tr.upgradePostingDb();
+    return tr.commit();
+}
 
 bool Migrator::migrationRequired()
 {
@@ -50,6 +65,35 @@ void Migrator::migrate()
     Q_ASSERT(migrationRequired());
 
     int dbVersion = m_config->databaseVersion();
+    if (dbVersion >= 2 && dbVersion <= 4 && QFile::exists(m_dbPath + "/index")) {
+        // Version 3 only changed how the posting lists are encoded,
+        // version 4 how the IdTreeDB stores the children of a folder,
+        // which is converted when the database is opened for writing, and
+        // version 5 added the indexes on the file names
+        QFile::remove(m_dbPath + "/index-lock");
+
+        // The database grows when the upgraded lists do not fit, after which
+        // they are upgraded once more. If that fails as well the index is
+        // built from scratch, as it cannot be read in the old format anymore.
+        bool upgraded = false;
+        bool indexesBuilt = false;
+        {
+            Database db(m_dbPath);
+            if (db.open(Database::CreateDatabase)) {
+                upgraded = dbVersion != 2 || upgradePostingDb(db) || upgradePostingDb(db);
+                indexesBuilt = upgraded && (db.buildFileNameIndexes() || db.buildFileNameIndexes());
+            }
+        }
+
+        // The database works without the file name indexes, so building
+        // them is tried again on the next start
+        if (upgraded) {
+            m_config->setDatabaseVersion(indexesBuilt ? s_dbVersion : 4);
+            return;
+        }
+        qWarning() << "Could not upgrade the index in" << m_dbPath;
+    }
+
     if (dbVersion == 0 && QFile::exists(m_dbPath + "/file")) {
         QDir dir(m_dbPath + "/file");
         dir.removeRecursively();
@@ -29,6 +29,7 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QDateTime>
+#include <QDebug>
 
 using namespace Baloo;
 
@@ -43,14 +44,31 @@ ModifiedFileIndexer::ModifiedFileIndexer(Database* db, FileIndexerConfig* config
 }
 
 void ModifiedFileIndexer::run()
+{
+    // The database grows when the files do not fit, after which they are
+    // indexed once more
+    if (!indexFiles() && !indexFiles()) {
+        qWarning() << "Could not index" << m_files.size() << "files, as the database is full";
+        Q_EMIT failed(m_files);
+    }
+    Q_EMIT done();
+}
+
+bool ModifiedFileIndexer::indexFiles()
 {
     QMimeDatabase mimeDb;
 
     Transaction tr(m_db, Transaction::ReadWrite);
+    tr.setMemoryBudget(m_config->transactionMemoryBudget());
 
     for (const QString& filePath : m_files) {
         Q_ASSERT(!filePath.endsWith('/'));
 
+        // Nothing more is written once the database is full
+        if (tr.isFull()) {
+            break;
+        }
+
         QString fileName = filePath.mid(filePath.lastIndexOf('/') + 1);
         if (!m_config->shouldFileBeIndexed(fileName)) {
             continue;
@@ -100,6 +118,5 @@ void ModifiedFileIndexer::run()
         }
     }
 
-    tr.commit();
-    Q_EMIT done();
+    return tr.commit();
 }
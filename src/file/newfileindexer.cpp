@@ -25,6 +25,7 @@
 #include "transaction.h"
 
 #include <QMimeDatabase>
+#include <QDebug>
 
 using namespace Baloo;
 
@@ -39,14 +40,31 @@ NewFileIndexer::NewFileIndexer(Database* db, FileIndexerConfig* config, const QS
 }
 
 void NewFileIndexer::run()
+{
+    // The database grows when the files do not fit, after which they are
+    // indexed once more
+    if (!indexFiles() && !indexFiles()) {
+        qWarning() << "Could not index" << m_files.size() << "files, as the database is full";
+        Q_EMIT failed(m_files);
+    }
+    Q_EMIT done();
+}
+
+bool NewFileIndexer::indexFiles()
 {
     QMimeDatabase mimeDb;
 
     Transaction tr(m_db, Transaction::ReadWrite);
+    tr.setMemoryBudget(m_config->transactionMemoryBudget());
 
     for (const QString& filePath : m_files) {
         Q_ASSERT(!filePath.endsWith('/'));
 
+        // Nothing more is written once the database is full
+        if (tr.isFull()) {
+            break;
+        }
+
         QString fileName = filePath.mid(filePath.lastIndexOf('/') + 1);
         if (!m_config->shouldFileBeIndexed(fileName)) {
             continue;
@@ -72,6 +90,5 @@ void NewFileIndexer::run()
         tr.addDocument(job.document());
     }
 
-    tr.commit();
-    Q_EMIT done();
+    return tr.commit();
 }
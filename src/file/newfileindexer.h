@@ -43,7 +43,18 @@ public:
 Q_SIGNALS:
     void done();
 
+    /**
+     * Emitted before done() when \p files could not be indexed, as they
+     * did not fit into the database even after it grew
+     */
+    void failed(const QStringList& files);
+
 private:
+    /**
+     * Returns false if the files did not fit into the database
+     */
+    bool indexFiles();
+
     Database* m_db;
     FileIndexerConfig* m_config;
     QStringList m_files;
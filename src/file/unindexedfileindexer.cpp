@@ -40,43 +40,63 @@ UnindexedFileIndexer::UnindexedFileIndexer(Database* db, FileIndexerConfig* conf
 
 void UnindexedFileIndexer::run()
 {
-    QMimeDatabase m_mimeDb;
-    QStringList includeFolders = m_config->includeFolders();
-
+    bool indexed = true;
+    const QStringList includeFolders = m_config->includeFolders();
     for (const QString& includeFolder : includeFolders) {
-        Transaction tr(m_db, Transaction::ReadWrite);
-        UnIndexedFileIterator it(m_config, &tr, includeFolder);
+        // The database grows when the files do not fit, after which the
+        // folder is indexed once more
+        if (!indexFolder(includeFolder) && !indexFolder(includeFolder)) {
+            qWarning() << "Could not index the files in" << includeFolder << "as the database is full";
+            indexed = false;
+        }
+    }
 
-        while (!it.next().isEmpty()) {
-            QString mime = m_mimeDb.mimeTypeForFile(it.filePath(), QMimeDatabase::MatchExtension).name();
-            BasicIndexingJob::IndexingLevel level = m_config->onlyBasicIndexing() ? BasicIndexingJob::NoLevel
-                : BasicIndexingJob::MarkForContentIndexing;
-            BasicIndexingJob job(it.filePath(), mime, level);
-            job.index();
+    if (!indexed) {
+        Q_EMIT failed();
+    }
+    Q_EMIT done();
+}
 
-            // We handle modified files by simply updating the mTime and filename in the Db and marking them for ContentIndexing
-            const quint64 id = job.document().id();
-            if (tr.hasDocument(id)) {
+bool UnindexedFileIndexer::indexFolder(const QString& includeFolder)
+{
+    QMimeDatabase mimeDb;
 
-                DocumentOperations ops = DocumentTime;
-                if (it.cTimeChanged()) {
-                    ops |= XAttrTerms;
-                    if (tr.documentUrl(id) != it.filePath()) {
-                        ops |= (FileNameTerms | DocumentUrl);
-                    }
-                }
-                tr.replaceDocument(job.document(), ops);
+    Transaction tr(m_db, Transaction::ReadWrite);
+    tr.setMemoryBudget(m_config->transactionMemoryBudget());
+    UnIndexedFileIterator it(m_config, &tr, includeFolder);
 
-                if (it.mTimeChanged()) {
-                    tr.setPhaseOne(id);
+    while (!it.next().isEmpty()) {
+        // Nothing more is written once the database is full
+        if (tr.isFull()) {
+            break;
+        }
+
+        QString mime = mimeDb.mimeTypeForFile(it.filePath(), QMimeDatabase::MatchExtension).name();
+        BasicIndexingJob::IndexingLevel level = m_config->onlyBasicIndexing() ? BasicIndexingJob::NoLevel
+            : BasicIndexingJob::MarkForContentIndexing;
+        BasicIndexingJob job(it.filePath(), mime, level);
+        job.index();
+
+        // We handle modified files by simply updating the mTime and filename in the Db and marking them for ContentIndexing
+        const quint64 id = job.document().id();
+        if (tr.hasDocument(id)) {
+
+            DocumentOperations ops = DocumentTime;
+            if (it.cTimeChanged()) {
+                ops |= XAttrTerms;
+                if (tr.documentUrl(id) != it.filePath()) {
+                    ops |= (FileNameTerms | DocumentUrl);
                 }
+            }
+            tr.replaceDocument(job.document(), ops);
 
-            } else { // New file
-                tr.addDocument(job.document());
+            if (it.mTimeChanged()) {
+                tr.setPhaseOne(id);
             }
+
+        } else { // New file
+            tr.addDocument(job.document());
         }
-        tr.commit();
     }
-
-    Q_EMIT done();
+    return tr.commit();
 }
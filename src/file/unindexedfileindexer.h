@@ -42,7 +42,18 @@ public:
 Q_SIGNALS:
     void done();
 
+    /**
+     * Emitted before done() when some of the files could not be indexed,
+     * as they did not fit into the database even after it grew
+     */
+    void failed();
+
 private:
+    /**
+     * Returns false if the files did not fit into the database
+     */
+    bool indexFolder(const QString& folder);
+
     Database* m_db;
     FileIndexerConfig* m_config;
 };
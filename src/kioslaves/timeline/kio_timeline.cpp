@@ -225,27 +225,23 @@ void TimelineProtocol::listDays(int month, int year)
 bool TimelineProtocol::filesInDate(const QDate& date)
 {
     Query query;
-    query.setLimit(1);
     query.setDateFilter(date.year(), date.month(), date.day());
     query.setSortingOption(Query::SortNone);
 
-    ResultIterator it = query.exec();
-    return it.next();
+    return query.exists();
 }
 
 
 void TimelineProtocol::listThisYearsMonths()
 {
     Query query;
-    query.setLimit(1);
     query.setSortingOption(Query::SortNone);
 
     int year = QDate::currentDate().year();
     int currentMonth = QDate::currentDate().month();
     for (int month = 1; month <= currentMonth; ++month) {
         query.setDateFilter(year, month);
-        ResultIterator it = query.exec();
-        if (it.next()) {
+        if (query.exists()) {
             listEntry(createMonthUDSEntry(month, year));
         }
     }
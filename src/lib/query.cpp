@@ -61,8 +61,41 @@ public:
 
     SortingOption m_sortingOption;
     QString m_includeFolder;
+
+    Term term() const;
 };
 
+/*
+ * Combines the search term with the types, folder and date filters
+ */
+Term Query::Private::term() const
+{
+    Term term(m_term);
+    if (!m_types.isEmpty()) {
+        for (const QString& type : m_types) {
+            term = term && Term(QStringLiteral("type"), type);
+        }
+    }
+
+    if (!m_includeFolder.isEmpty()) {
+        term = term && Term(QStringLiteral("includefolder"), m_includeFolder);
+    }
+
+    if (m_yearFilter || m_monthFilter || m_dayFilter) {
+        QByteArray ba = QByteArray::number(m_yearFilter);
+        if (m_monthFilter < 10)
+            ba += '0';
+        ba += QByteArray::number(m_monthFilter);
+        if (m_dayFilter < 10)
+            ba += '0';
+        ba += QByteArray::number(m_dayFilter);
+
+        term = term && Term(QStringLiteral("modified"), ba, Term::Equal);
+    }
+
+    return term;
+}
+
 Query::Query()
     : d(new Private)
 {
@@ -183,32 +216,20 @@ void Query::setIncludeFolder(const QString& folder)
 
 ResultIterator Query::exec()
 {
-    Term term(d->m_term);
-    if (!d->m_types.isEmpty()) {
-        for (const QString& type : d->m_types) {
-            term = term && Term(QStringLiteral("type"), type);
-        }
-    }
-
-    if (!d->m_includeFolder.isEmpty()) {
-        term = term && Term(QStringLiteral("includefolder"), d->m_includeFolder);
-    }
-
-    if (d->m_yearFilter || d->m_monthFilter || d->m_dayFilter) {
-        QByteArray ba = QByteArray::number(d->m_yearFilter);
-        if (d->m_monthFilter < 10)
-            ba += '0';
-        ba += QByteArray::number(d->m_monthFilter);
-        if (d->m_dayFilter < 10)
-            ba += '0';
-        ba += QByteArray::number(d->m_dayFilter);
+    SearchStore searchStore;
+    return ResultIterator(searchStore.exec(d->term(), d->m_offset, d->m_limit, d->m_sortingOption == SortAuto));
+}
 
-        term = term && Term(QStringLiteral("modified"), ba, Term::Equal);
-    }
+uint Query::count()
+{
+    SearchStore searchStore;
+    return searchStore.count(d->term(), d->m_offset, d->m_limit);
+}
 
+bool Query::exists()
+{
     SearchStore searchStore;
-    QStringList result = searchStore.exec(term, d->m_offset, d->m_limit, d->m_sortingOption == SortAuto);
-    return ResultIterator(result);
+    return searchStore.count(d->term(), d->m_offset, 1) > 0;
 }
 
 QByteArray Query::toJSON()
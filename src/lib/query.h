@@ -140,6 +140,18 @@ public:
 
     ResultIterator exec();
 
+    /**
+     * Returns the number of results exec() would return. The paths of the
+     * files are not looked up, and the sorting option is ignored.
+     */
+    uint count();
+
+    /**
+     * Returns true if exec() would return any result. The search stops at
+     * the first one.
+     */
+    bool exists();
+
     QByteArray toJSON();
     static Query fromJSON(const QByteArray& arr);
 
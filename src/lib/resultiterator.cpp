@@ -23,32 +23,30 @@
 #include "resultiterator.h"
 #include "searchstore.h"
 
-#include <QVector>
-
 using namespace Baloo;
 
 class Baloo::ResultIteratorPrivate {
 public:
-    ResultIteratorPrivate() : pos(-1)
+    ResultIteratorPrivate() : results(0)
     {}
 
     ~ResultIteratorPrivate() {
+        delete results;
     }
 
-    QStringList results;
-    int pos;
+    SearchResults* results;
 };
 
-ResultIterator::ResultIterator(const QStringList& results)
+ResultIterator::ResultIterator(SearchResults* results)
     : d(new ResultIteratorPrivate)
 {
     d->results = results;
-    d->pos = -1;
 }
 
-ResultIterator::ResultIterator(const ResultIterator& rhs)
+ResultIterator::ResultIterator(ResultIterator&& rhs)
     : d(rhs.d)
 {
+    rhs.d = 0;
 }
 
 ResultIterator::~ResultIterator()
@@ -58,12 +56,17 @@ ResultIterator::~ResultIterator()
 
 bool ResultIterator::next()
 {
-    d->pos++;
-    return d->pos < d->results.size();
+    return d->results && d->results->next();
 }
 
 QString ResultIterator::filePath() const
 {
-    Q_ASSERT(d->pos >= 0 && d->pos < d->results.size());
-    return d->results.at(d->pos);
+    Q_ASSERT(d->results && d->results->docId());
+    return d->results->filePath();
+}
+
+quint64 ResultIterator::documentId() const
+{
+    Q_ASSERT(d->results);
+    return d->results->docId();
 }
@@ -30,20 +30,38 @@
 namespace Baloo {
 
 class SearchStore;
+class SearchResults;
 class Result;
 class ResultIteratorPrivate;
 
+/**
+ * Iterates over the results of a Query. They are read from the database as
+ * they are asked for, so destroying the iterator early cancels the query.
+ */
 class BALOO_CORE_EXPORT ResultIterator
 {
 public:
-    ResultIterator(const ResultIterator& rhs);
+    ResultIterator(ResultIterator&& rhs);
     ~ResultIterator();
 
+    ResultIterator(const ResultIterator& rhs) = delete;
+    ResultIterator& operator=(const ResultIterator& rhs) = delete;
+
     bool next();
+
+    /**
+     * Returns the path of the current result. It is only looked up when
+     * asked for.
+     */
     QString filePath() const;
 
+    /**
+     * Returns the id of the current result
+     */
+    quint64 documentId() const;
+
 private:
-    ResultIterator(const QStringList& results);
+    ResultIterator(SearchResults* results);
     ResultIteratorPrivate* d;
 
     friend class Query;
@@ -35,6 +35,8 @@
 
 #include <QStandardPaths>
 #include <QFile>
+#include <QDataStream>
+#include <QScopedPointer>
 
 #include <KFileMetaData/PropertyInfo>
 #include <KFileMetaData/TypeInfo>
@@ -64,72 +66,299 @@ SearchStore::~SearchStore()
 {
 }
 
-// Return the result with-in [offset, offset + limit)
-QStringList SearchStore::exec(const Term& term, uint offset, int limit, bool sortResults)
+SearchResults::SearchResults(const SearchStore& store, Transaction* tr, const QVector<quint64>& ids)
+    : m_store(store)
+    , m_tr(tr)
+    , m_it(0)
+    , m_ids(ids)
+    , m_pos(-1)
+    , m_skip(0)
+    , m_remaining(0)
+    , m_lastId(0)
+    , m_restarted(false)
+    , m_docId(0)
 {
-    if (!m_db || !m_db->isOpen()) {
-        return QStringList();
-    }
+    m_tr->suspend();
+}
 
-    Transaction tr(m_db, Transaction::ReadOnly);
-    QScopedPointer<PostingIterator> it(constructQuery(&tr, term));
-    if (!it) {
-        return QStringList();
+SearchResults::SearchResults(const SearchStore& store, Transaction* tr, PostingIterator* it, const Term& term,
+                             uint offset, int limit, const QByteArray& cacheKey)
+    : m_store(store)
+    , m_term(term)
+    , m_tr(tr)
+    , m_it(it)
+    , m_pos(-1)
+    , m_skip(offset)
+    , m_remaining(limit)
+    , m_lastId(0)
+    , m_restarted(false)
+    , m_cacheKey(cacheKey)
+    , m_docId(0)
+{
+    m_tr->suspend();
+}
+
+SearchResults::~SearchResults()
+{
+    finish();
+}
+
+void SearchResults::finish()
+{
+    delete m_it;
+    m_it = 0;
+
+    delete m_tr;
+    m_tr = 0;
+}
+
+/*
+ * Makes the transaction usable again. If the database grew in the meantime
+ * the transaction was replaced, and the query is run again in the new one.
+ */
+void SearchResults::resume()
+{
+    if (m_tr->resume() || !m_it) {
+        return;
     }
 
-    if (sortResults) {
-        QVector<quint64> resultIds;
-        while (it->next()) {
-            quint64 id = it->docId();
-            resultIds << id;
+    delete m_it;
+    m_it = m_store.constructQuery(m_tr, m_term);
+    m_restarted = m_lastId != 0;
+
+    // The results of two versions of the database are not cached
+    m_cacheKey.clear();
+    m_cachedIds.clear();
+}
 
-            Q_ASSERT(id > 0);
+/*
+ * Reads the next block of results from the iterator, after skipping the
+ * offset. The iterator is deleted once it has nothing more to give.
+ */
+void SearchResults::readBlock()
+{
+    resume();
+
+    m_ids.clear();
+    m_pos = 0;
+
+    quint64 block[PostingIterator::BlockSize];
+    while (m_it && m_ids.isEmpty()) {
+        int size = PostingIterator::BlockSize;
+        if (m_remaining >= 0) {
+            size = static_cast<int>(qMin<quint64>(size, static_cast<quint64>(m_skip) + m_remaining));
         }
 
-        // No enough result within range, no need to sort.
-        if (offset >= static_cast<uint>(resultIds.size())) {
-            return QStringList();
+        int count = 0;
+        if (m_restarted) {
+            // Continue after the last document read before
+            block[0] = m_it->skipTo(m_lastId + 1);
+            count = block[0] ? 1 : 0;
+            m_restarted = false;
+        } else if (size) {
+            count = m_it->nextBlock(block, size);
         }
 
-        auto compFunc = [&tr](const quint64 lhs, const quint64 rhs) {
-            return tr.documentTimeInfo(lhs).mTime > tr.documentTimeInfo(rhs).mTime;
-        };
+        if (!count) {
+            if (!m_cacheKey.isEmpty()) {
+                m_tr->cacheQueryResults(m_cacheKey, m_cachedIds);
+            }
+            delete m_it;
+            m_it = 0;
+            break;
+        }
+        m_lastId = block[count - 1];
 
-        std::sort(resultIds.begin(), resultIds.end(), compFunc);
-        if (limit < 0) {
-            limit = resultIds.size();
+        if (!m_cacheKey.isEmpty()) {
+            for (int i = 0; i < count; i++) {
+                m_cachedIds << block[i];
+            }
         }
 
-        QStringList results;
-        const uint end = qMin(static_cast<uint>(resultIds.size()), offset + static_cast<uint>(limit));
-        for (uint i = offset; i < end; i++) {
-            const quint64 id = resultIds[i];
-            const QString filePath = tr.documentUrl(id);
+        const int skipped = static_cast<int>(qMin<uint>(m_skip, count));
+        m_skip -= skipped;
+        for (int i = skipped; i < count; i++) {
+            Q_ASSERT(block[i] > 0);
+            m_ids << block[i];
+        }
 
-            results << filePath;
+        if (m_remaining >= 0) {
+            m_ids.resize(qMin(m_ids.size(), m_remaining));
+            m_remaining -= m_ids.size();
         }
 
-        return results;
+        // Nothing more is needed from the iterator
+        if (!m_remaining) {
+            delete m_it;
+            m_it = 0;
+        }
     }
-    else {
-        uint i = 0;
-        QStringList results;
-        const uint end = offset + static_cast<uint>(limit);
 
-        while (it->next() && (limit < 0 || i < end)) {
-            quint64 id = it->docId();
-            Q_ASSERT(id > 0);
+    m_tr->suspend();
+}
+
+quint64 SearchResults::next()
+{
+    m_docId = 0;
+    if (!m_tr) {
+        return 0;
+    }
+
+    m_pos++;
+    if (m_pos >= m_ids.size() && m_it) {
+        readBlock();
+    }
+
+    if (m_pos < m_ids.size()) {
+        m_docId = m_ids[m_pos];
+    } else {
+        finish();
+    }
+    return m_docId;
+}
+
+quint64 SearchResults::docId() const
+{
+    return m_docId;
+}
+
+QString SearchResults::filePath()
+{
+    Q_ASSERT(m_docId);
+
+    resume();
+    const QString path = m_tr->documentUrl(m_docId);
+    m_tr->suspend();
+
+    return path;
+}
+
+/*
+ * Returns the same key for terms which match the same documents. The order
+ * of the sub terms of an And or an Or does not matter, so they are sorted.
+ */
+static QByteArray cacheKey(const Term& term)
+{
+    QByteArray key;
+    QDataStream stream(&key, QIODevice::WriteOnly);
+    stream << static_cast<int>(term.operation()) << term.isNegated();
+
+    if (term.operation() == Term::And || term.operation() == Term::Or) {
+        QVector<QByteArray> subKeys;
+        for (const Term& t : term.subTerms()) {
+            subKeys << cacheKey(t);
+        }
+        std::sort(subKeys.begin(), subKeys.end());
+
+        for (const QByteArray& subKey : subKeys) {
+            stream << subKey;
+        }
+    } else {
+        stream << term.property().toLower() << static_cast<int>(term.comparator()) << term.value();
+    }
+
+    return key;
+}
+
+// Return the result with-in [offset, offset + limit)
+SearchResults* SearchStore::exec(const Term& term, uint offset, int limit, bool sortResults)
+{
+    if (!m_db || !m_db->isOpen()) {
+        return 0;
+    }
+
+    QScopedPointer<Transaction> tr(new Transaction(m_db, Transaction::ReadOnly));
+
+    // Repeated queries are served from the cache, until the database changes
+    const QByteArray key = cacheKey(term);
+    QVector<quint64> resultIds;
+    if (!tr->cachedQueryResults(key, &resultIds)) {
+        PostingIterator* it = constructQuery(tr.data(), term);
+        if (!it) {
+            tr->cacheQueryResults(key, resultIds);
+            return 0;
+        }
+
+        // The results are read as they are asked for. All of them are only
+        // read, and cached, when there is no limit.
+        if (!sortResults) {
+            return new SearchResults(*this, tr.take(), it, term, offset, limit, limit < 0 ? key : QByteArray());
+        }
 
-            if (i >= offset) {
-                results << tr.documentUrl(it->docId());
-                Q_ASSERT(!results.last().isEmpty());
+        quint64 block[PostingIterator::BlockSize];
+        while (int count = it->nextBlock(block, PostingIterator::BlockSize)) {
+            for (int i = 0; i < count; i++) {
+                Q_ASSERT(block[i] > 0);
+                resultIds << block[i];
             }
+        }
+        delete it;
+
+        tr->cacheQueryResults(key, resultIds);
+    }
+
+    // No enough result within range, no need to sort.
+    if (offset >= static_cast<uint>(resultIds.size())) {
+        return 0;
+    }
 
-            i++;
+    quint64 end = resultIds.size();
+    if (limit >= 0) {
+        end = qMin(end, static_cast<quint64>(offset) + limit);
+    }
+
+    // Only the results up to the end of the range need to be ordered
+    if (sortResults) {
+        resultIds = tr->newestDocuments(resultIds, limit >= 0 ? static_cast<int>(end) : -1);
+    }
+
+    return new SearchResults(*this, tr.take(), resultIds.mid(offset, end - offset));
+}
+
+uint SearchStore::count(const Term& term, uint offset, int limit)
+{
+    if (!m_db || !m_db->isOpen()) {
+        return 0;
+    }
+
+    Transaction tr(m_db, Transaction::ReadOnly);
+
+    // Reading no more than this is enough to know the count
+    const quint64 end = limit >= 0 ? static_cast<quint64>(offset) + limit : ~quint64(0);
+
+    quint64 total = 0;
+    QVector<quint64> resultIds;
+    if (tr.cachedQueryResults(cacheKey(term), &resultIds)) {
+        total = resultIds.size();
+    }
+    else {
+        PostingIterator* it = constructQuery(&tr, term);
+        if (!it) {
+            return 0;
         }
 
-        return results;
+        // The size of a single posting list is stored with it
+        if (it->hasExactSize()) {
+            total = it->estimatedSize();
+        }
+        else {
+            quint64 block[PostingIterator::BlockSize];
+            while (total < end) {
+                const int size = static_cast<int>(qMin<quint64>(end - total, PostingIterator::BlockSize));
+                const int count = it->nextBlock(block, size);
+                if (!count) {
+                    break;
+                }
+                total += count;
+            }
+        }
+        delete it;
+    }
+
+    if (total <= offset) {
+        return 0;
     }
+    return static_cast<uint>(qMin(total, end) - offset);
 }
 
 QByteArray SearchStore::fetchPrefix(const QByteArray& property) const
@@ -280,6 +509,12 @@ PostingIterator* SearchStore::constructQuery(Transaction* tr, const Term& term)
     auto com = term.comparator();
     if (com == Term::Contains) {
         EngineQuery q = constructContainsQuery(prefix, value.toString());
+
+        // The words only match at their start, the trigrams anywhere in the name
+        if (property == "filename") {
+            const EngineQuery substring(QFile::encodeName(value.toString()), EngineQuery::Substring);
+            q = EngineQuery({q, substring}, EngineQuery::Or);
+        }
         return tr->postingIterator(q);
     }
 
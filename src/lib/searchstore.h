@@ -26,6 +26,7 @@
 #include <QString>
 #include <QDateTime>
 #include <QHash>
+#include <QVector>
 #include "term.h"
 
 namespace Baloo {
@@ -35,6 +36,7 @@ class Database;
 class Transaction;
 class EngineQuery;
 class PostingIterator;
+class SearchResults;
 
 class SearchStore
 {
@@ -42,7 +44,18 @@ public:
     SearchStore();
     ~SearchStore();
 
-    QStringList exec(const Term& term, uint offset, int limit, bool sortResults);
+    /**
+     * Returns the results within [offset, offset + limit), or null if there
+     * are none. Unsorted results are read as they are asked for.
+     */
+    SearchResults* exec(const Term& term, uint offset, int limit, bool sortResults);
+
+    /**
+     * Returns how many results exec() would return, without looking up
+     * their urls. It stops reading once \p offset + \p limit of them have
+     * been found.
+     */
+    uint count(const Term& term, uint offset, int limit);
 
 private:
     QByteArray fetchPrefix(const QByteArray& property) const;
@@ -58,6 +71,65 @@ private:
 
     PostingIterator* constructRatingQuery(Transaction* tr, int rating);
     PostingIterator* constructMTimeQuery(Transaction* tr, const QDateTime& dt, Term::Comparator com);
+
+    friend class SearchResults;
+};
+
+/**
+ * The results of a query. They are read from the query's transaction a
+ * block at a time as they are asked for, and the url of a result is only
+ * looked up when filePath() is called.
+ *
+ * The transaction is suspended in between, so that it does not keep the
+ * database from growing. If the database did grow, the query is run again
+ * and continues after the last document which was read.
+ */
+class SearchResults
+{
+public:
+    ~SearchResults();
+
+    /**
+     * Moves to the next result and returns its id, or 0 if there are no
+     * more. The transaction is closed once the end has been reached.
+     */
+    quint64 next();
+    quint64 docId() const;
+    QString filePath();
+
+private:
+    SearchResults(const SearchStore& store, Transaction* tr, const QVector<quint64>& ids);
+
+    /**
+     * Returns up to \p limit documents of \p it after skipping \p offset of
+     * them. If \p cacheKey is set all of them are read and cached.
+     */
+    SearchResults(const SearchStore& store, Transaction* tr, PostingIterator* it, const Term& term,
+                  uint offset, int limit, const QByteArray& cacheKey);
+
+    void resume();
+    void readBlock();
+    void finish();
+
+    SearchStore m_store;
+    Term m_term;
+
+    Transaction* m_tr;
+    PostingIterator* m_it;
+    QVector<quint64> m_ids;
+    int m_pos;
+
+    uint m_skip;
+    int m_remaining;
+    quint64 m_lastId;
+    bool m_restarted;
+
+    QByteArray m_cacheKey;
+    QVector<quint64> m_cachedIds;
+
+    quint64 m_docId;
+
+    friend class SearchStore;
 };
 
 }
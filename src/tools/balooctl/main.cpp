@@ -287,7 +287,9 @@ int main(int argc, char* argv[])
 
         uint ts = size.expectedSize;
         out << "Actual Size: " << format.formatByteSize(size.actualSize, 2) << "\n";
-        out << "Expected Size: " << format.formatByteSize(size.expectedSize, 2) << "\n\n";
+        out << "Expected Size: " << format.formatByteSize(size.expectedSize, 2) << "\n";
+        out << "Map Size: " << format.formatByteSize(size.mapSize, 2) << "\n";
+        out << "Headroom: " << format.formatByteSize(size.headroom, 2) << "\n\n";
         prFunc(QStringLiteral("PostingDB"), size.postingDb, ts);
         prFunc(QStringLiteral("PosistionDB"), size.positionDb, ts);
         prFunc(QStringLiteral("DocTerms"), size.docTerms, ts);
@@ -295,11 +297,13 @@ int main(int argc, char* argv[])
         prFunc(QStringLiteral("DocXattrTerms"), size.docXattrTerms, ts);
         prFunc(QStringLiteral("IdTree"), size.idTree, ts);
         prFunc(QStringLiteral("IdFileName"), size.idFilename, ts);
+        prFunc(QStringLiteral("FileNameId"), size.fileNameId, ts);
         prFunc(QStringLiteral("DocTime"), size.docTime, ts);
         prFunc(QStringLiteral("DocData"), size.docData, ts);
         prFunc(QStringLiteral("ContentIndexingDB"), size.contentIndexingIds, ts);
         prFunc(QStringLiteral("FailedIdsDB"), size.failedIds, ts);
         prFunc(QStringLiteral("MTimeDB"), size.mtimeDb, ts);
+        prFunc(QStringLiteral("FilenameTrigramDB"), size.fileNameTrigrams, ts);
 
         return 0;
     }